@@ -24,7 +24,12 @@ enum class CommandLineAction {
     SET_DHCP,
     SET_MODBUS_TCP,
     SET_MODBUS_TCP_PORT,
-    SET_NAME
+    SET_NAME,
+    PROVISION,
+    SET_RELAYS,
+    WATCH_DIGITAL_INPUTS,
+    INTERLOCK,
+    SEQUENCE
 };
 
 struct CoilReadArgs {
@@ -75,14 +80,38 @@ struct CommandLineOptions {
     std::vector<RegistersReadArgs> read_registers_args;
     std::vector<RegisterWriteArgs> write_register_args;
     std::vector<RegistersWriteArgs> write_registers_args;
+    std::vector<std::string> set_relays_args;  ///< --set-relays: relay patterns, applied in order
     
+    int coalesce_gap = 8;          ///< --coalesce-gap: unrequested addresses bridged when merging reads
+    int pipeline_depth = 0;        ///< --pipeline: Modbus requests kept in flight (0/1 = one at a time)
+    std::string sequence_file;                 ///< --sequence: relay timeline file
+    std::vector<std::string> interlock_args;   ///< --interlock: "DIn -> RELAYm" rules
+    std::string watch_rate = "100Hz";  ///< --rate: poll rate of --watch-digital-inputs / --interlock
     int scan_timeout_ms = 3000;
     int wait_timeout_ms = 30000;
+    bool wait_modbus = false;      ///< --wait-modbus: after a reboot, also wait for Modbus TCP
+    bool dry_run = false;          ///< --dry-run: show configuration diffs without sending
+    bool stats = false;            ///< --stats: print per-operation latency statistics at exit
     bool ip_explicitly_set = false;
-    std::vector<std::string> extra_subnets; ///< --extra-subnet: additional /24s to sweep
-
-    std::string target_mac;       ///< --mac: target device MAC address
-    std::string target_name;      ///< --name: target device name
+    std::vector<std::string> extra_subnets; ///< --extra-subnet: additional CIDR ranges to sweep
+    int probe_rate = 0;                     ///< --probe-rate: sweep probes per second (0 = unpaced)
+    bool adaptive_scan = false;             ///< --adaptive-scan: stop once replies have died down
+    bool use_cache = true;                  ///< false with --no-cache
+    int cache_ttl_seconds = 86400;          ///< --cache-ttl: max age of cached discoveries
+    bool daemon = false;                    ///< --daemon: serve commands over a Unix domain socket
+    bool via_daemon = false;                ///< --via-daemon: forward this command to the daemon
+    std::string daemon_socket;              ///< --daemon-socket: control socket path (empty = default)
+
+    std::string target_mac;       ///< --mac: target device MAC address (the first one)
+    std::string target_name;      ///< --name: target device name (the first one)
+    std::vector<std::string> target_ips;    ///< -i: every given device address
+    std::vector<std::string> target_macs;   ///< --mac: every given MAC address
+    std::vector<std::string> target_names;  ///< --name: every given device name
+    bool all_discovered = false;  ///< --all-discovered: target every device found by a scan
+    int parallel = 32;            ///< --parallel: devices served at once with several targets
+    bool fleet_member = false;    ///< One device of a multi-target run: ip_address was resolved by
+                                  ///< the parent, target_mac pins it for VirCom actions, and the
+                                  ///< discovery cache is not written
     std::string set_ip_address;   ///< --set-ip: new static IP
     std::string set_subnet_mask;  ///< --set-ip: new subnet mask
     std::string set_gateway;      ///< --set-ip: new gateway
@@ -90,12 +119,15 @@ struct CommandLineOptions {
     int modbus_tcp_port = 502;     ///< --set-modbus-tcp: Modbus TCP port
     int set_port_value = 0;        ///< --set-modbus-tcp-port: new listening port
     std::string set_name;          ///< --set-name: new device name (max 9 chars)
+    std::string provision_manifest; ///< --provision: manifest of desired device configurations
+    std::string trace_file;        ///< --trace: write a Chrome trace-event JSON file
 
     bool debug = false;
 }; 
 
 CommandLineOptions parse_command_line(int argc, char* argv[]);
 std::string dump_command_line_options(const CommandLineOptions& options);
+std::string action_to_string(CommandLineAction action);
     
 } // namespace waveshare
 
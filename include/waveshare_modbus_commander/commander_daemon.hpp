@@ -0,0 +1,38 @@
+#ifndef WAVESHARE_COMMANDER_DAEMON_HPP
+#define WAVESHARE_COMMANDER_DAEMON_HPP
+
+#include <functional>
+#include <string>
+
+namespace waveshare {
+
+/// Default control socket of `--daemon`:
+/// $XDG_RUNTIME_DIR/waveshare-commander.sock, falling back to
+/// /tmp/waveshare-commander-<uid>.sock.
+std::string default_daemon_socket_path();
+
+/// Executes one command line as main() would and returns its exit code.
+using CommandRunner = std::function<int(int argc, char* argv[])>;
+
+/// Serve commands on the Unix domain socket @p socket_path until SIGINT
+/// or SIGTERM.
+///
+/// Commands are executed one at a time, each in a child process forked
+/// from the daemon.  The child writes directly to the client's stdout
+/// and stderr (passed over the socket) and inherits the daemon's open
+/// Modbus connections (see ModbusConnectionPool); connections the child
+/// had to open are opened in the daemon afterwards, so the next command
+/// for that device finds them warm.  Ctrl-C in the client is forwarded
+/// to the child, so interrupted commands clean up as usual.
+///
+/// @return Exit code for the daemon process.
+int run_daemon(const std::string& socket_path, const CommandRunner& run, bool debug);
+
+/// Have the daemon listening on @p socket_path execute @p argv in the
+/// current working directory.
+/// @return The command's exit code.
+int run_via_daemon(const std::string& socket_path, int argc, char* argv[]);
+
+} // namespace waveshare
+
+#endif // WAVESHARE_COMMANDER_DAEMON_HPP
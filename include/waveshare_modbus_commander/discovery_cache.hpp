@@ -0,0 +1,71 @@
+#ifndef WAVESHARE_DISCOVERY_CACHE_HPP
+#define WAVESHARE_DISCOVERY_CACHE_HPP
+
+#include "waveshare_modbus_commander/network_scanner.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace waveshare {
+
+/// On-disk cache of VirCom discovery results, keyed by MAC address.
+///
+/// Device addresses rarely change, so `--mac` / `--name` lookups can be
+/// answered from here and confirmed with a single unicast probe instead
+/// of a full broadcast scan.  Each entry keeps the device's IP, port,
+/// name and raw VirCom response together with the time it was last seen.
+///
+/// The file is plain text, one device per line:
+///   seen_at <TAB> mac <TAB> ip <TAB> port <TAB> name <TAB> raw_response (hex)
+class DiscoveryCache {
+public:
+    /// Default cache file: $XDG_CACHE_HOME/waveshare-commander/devices.cache,
+    /// falling back to ~/.cache (or %LOCALAPPDATA% on Windows).
+    /// Returns an empty string if no suitable directory is known.
+    static std::string default_path();
+
+    explicit DiscoveryCache(std::string path);
+
+    /// Read the cache file.  A missing or unreadable file yields an
+    /// empty cache; malformed lines are skipped.
+    void load();
+
+    /// Write the cache file atomically, via a temporary file with a
+    /// unique name, so concurrent writers never publish a torn file.
+    /// @return true on success.
+    bool save() const;
+
+    /// Record @p devices as seen now, replacing older entries with the
+    /// same MAC.
+    void update(const std::vector<DiscoveredDevice>& devices);
+
+    /// Find a fresh entry by MAC, device name, or IP (whichever is
+    /// non-empty; exactly one must be given).  A name only matches when
+    /// it is unique among the fresh entries.
+    ///
+    /// @param ttl_seconds  Entries older than this are ignored.
+    std::optional<DiscoveredDevice> find(const std::string& mac,
+                                         const std::string& name,
+                                         const std::string& ip,
+                                         int ttl_seconds) const;
+
+    /// IP addresses of all fresh entries, most recently seen first.
+    std::vector<std::string> known_ips(int ttl_seconds) const;
+
+private:
+    struct Entry {
+        DiscoveredDevice device;
+        int64_t seen_at = 0;  ///< Unix time (seconds)
+    };
+
+    std::vector<const Entry*> fresh_entries(int ttl_seconds) const;
+
+    std::string path_;
+    std::vector<Entry> entries_;
+};
+
+} // namespace waveshare
+
+#endif // WAVESHARE_DISCOVERY_CACHE_HPP
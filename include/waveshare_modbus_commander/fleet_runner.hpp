@@ -0,0 +1,49 @@
+#ifndef WAVESHARE_FLEET_RUNNER_HPP
+#define WAVESHARE_FLEET_RUNNER_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace waveshare {
+
+/// One device of a multi-target run.
+struct FleetTarget {
+    std::string label;          ///< Name used in output (device name or IP)
+    std::string ip_address;     ///< Empty if the device was not found
+    int port = 502;
+    std::string mac_address;    ///< Empty if unknown (plain -i targets)
+    std::string error;          ///< Why the device cannot be used, if it cannot
+};
+
+/// Outcome of running the actions against one device.
+struct FleetResult {
+    FleetTarget target;
+    bool ran = false;           ///< false for targets with an error and runs that could not start
+    int exit_code = 1;
+    int64_t elapsed_ms = 0;
+};
+
+/// Run @p run once per target, up to @p parallel at a time.
+///
+/// On POSIX each run happens in a forked process, so the runs cannot
+/// disturb each other; their output (stdout and stderr) is relayed line
+/// by line with a "[label]" prefix as it arrives.  The total time is that
+/// of the slowest device rather than the sum.  Ctrl-C reaches every run,
+/// and the function still waits for all of them to finish.  On Windows
+/// the targets are run one after another.
+///
+/// Targets with an error are not run; they appear in the result as such.
+///
+/// @return One result per target, in the order of @p targets.
+std::vector<FleetResult> run_on_fleet(const std::vector<FleetTarget>& targets,
+                                      int parallel,
+                                      const std::function<int(const FleetTarget&)>& run);
+
+/// Per-device summary of run_on_fleet() as a table.
+std::string format_fleet_results(const std::vector<FleetResult>& results);
+
+} // namespace waveshare
+
+#endif // WAVESHARE_FLEET_RUNNER_HPP
@@ -0,0 +1,74 @@
+#ifndef WAVESHARE_INPUT_POLLER_HPP
+#define WAVESHARE_INPUT_POLLER_HPP
+
+#include "waveshare_modbus_commander/latency_histogram.hpp"
+
+#include <modbus/modbus.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace waveshare {
+
+/// Parse a polling rate, given as a frequency ("200Hz", "1kHz", or a
+/// plain number of Hz) or as a period ("5ms", "250us", "1s").
+/// @return false (with @p error set) if @p text is not a valid rate.
+bool parse_rate(const std::string& text, std::chrono::nanoseconds& period, std::string& error);
+
+/// Reads the digital inputs (FC02) at a fixed rate.
+///
+/// Deadlines are absolute (start + n * period), so the time a read takes
+/// does not shift the cadence.  When a read ends after the next deadline
+/// has passed, the deadlines in between are skipped and counted as missed
+/// instead of being polled in a burst.
+class InputPoller {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// @param ctx     libmodbus context of a connected device.
+    /// @param period  Time between polls.
+    /// @param count   Number of inputs, starting at address 0 (max 32).
+    InputPoller(modbus_t* ctx, std::chrono::nanoseconds period, uint16_t count = 8);
+
+    /// Wait for the next deadline and read the inputs; bit i of @p inputs
+    /// is input i + 1.  The first call reads immediately.
+    /// @return false if the read failed (see last_error()).
+    bool poll(uint32_t& inputs);
+
+    /// When the reply of the last successful poll arrived.
+    Clock::time_point sampled_at() const { return sampled_at_; }
+
+    /// When the first poll started.
+    Clock::time_point started() const { return started_; }
+
+    std::chrono::nanoseconds period() const { return period_; }
+    uint16_t count() const { return count_; }
+
+    uint64_t polls() const { return polls_; }
+    uint64_t missed() const { return missed_; }
+    uint64_t failures() const { return failures_; }
+
+    /// Request-to-reply time of every poll.
+    const LatencyHistogram& latency() const { return latency_; }
+
+    const std::string& last_error() const { return last_error_; }
+
+private:
+    modbus_t* ctx_;
+    std::chrono::nanoseconds period_;
+    uint16_t count_;
+    bool first_ = true;
+    Clock::time_point started_{};
+    Clock::time_point next_{};
+    Clock::time_point sampled_at_{};
+    uint64_t polls_ = 0;
+    uint64_t missed_ = 0;
+    uint64_t failures_ = 0;
+    LatencyHistogram latency_;
+    std::string last_error_;
+};
+
+} // namespace waveshare
+
+#endif // WAVESHARE_INPUT_POLLER_HPP
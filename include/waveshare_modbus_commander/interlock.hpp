@@ -0,0 +1,59 @@
+#ifndef WAVESHARE_INTERLOCK_HPP
+#define WAVESHARE_INTERLOCK_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace waveshare {
+
+/// Number of digital inputs (DI1-DI8) on the Waveshare relay boards.
+constexpr int INPUT_COUNT = 8;
+
+/// One "condition -> action" rule of --interlock.
+///
+/// The condition is a digital input being on (`DI3`) or off (`!DI3`).
+/// The rule fires when its condition becomes true, and on the first poll
+/// if it is already true then.  Its action switches relays on (`RELAY5`,
+/// `ALL_ON`) or off (`!RELAY5`, `ALL_OFF`).
+struct InterlockRule {
+    int input = 1;          ///< 1-based digital input
+    bool when_on = true;    ///< false for "!DIn"
+    uint8_t set = 0;        ///< Relays switched on when the rule fires
+    uint8_t clear = 0;      ///< Relays switched off when the rule fires
+    std::string text;       ///< The rule as given, for messages
+};
+
+/// Parse --interlock arguments.  Each argument holds one or more rules
+/// separated by ',' or ';', e.g. "DI3 -> RELAY5, !DI1 -> ALL_OFF".
+/// @return false (with @p error set) if a rule is not valid.
+bool parse_interlock_rules(const std::vector<std::string>& args,
+                           std::vector<InterlockRule>& rules,
+                           std::string& error);
+
+/// Apply the rules that fire between @p previous (nullopt on the first
+/// poll) and @p inputs to the relay mask @p relays, in order, so a later
+/// rule wins over an earlier one for the same relay.
+/// @param fired  Receives the indices of the rules that fired.
+/// @return The new relay mask.
+uint8_t apply_interlock_rules(const std::vector<InterlockRule>& rules,
+                              std::optional<uint32_t> previous,
+                              uint32_t inputs,
+                              uint8_t relays,
+                              std::vector<size_t>& fired);
+
+/// Net effect of the rules @p fired, applied in order.
+struct RelayChange {
+    uint8_t on = 0;         ///< Relays to switch on
+    uint8_t off = 0;        ///< Relays to switch off
+};
+
+/// The relays the rules @p fired (indices into @p rules) switch, where a
+/// later rule wins over an earlier one for the same relay.  Relays no
+/// fired rule mentions are in neither mask.
+RelayChange interlock_change(const std::vector<InterlockRule>& rules, const std::vector<size_t>& fired);
+
+} // namespace waveshare
+
+#endif // WAVESHARE_INTERLOCK_HPP
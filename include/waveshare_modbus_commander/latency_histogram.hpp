@@ -0,0 +1,86 @@
+#ifndef WAVESHARE_LATENCY_HISTOGRAM_HPP
+#define WAVESHARE_LATENCY_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace waveshare {
+
+/// Log-linear histogram of durations with microsecond resolution.
+///
+/// Every power-of-two range of microseconds is split into SUB_BUCKETS
+/// equal buckets, so a recorded value is known to within 1/SUB_BUCKETS
+/// (12.5 %) from 1 µs up to hours, in a fixed array of counters.
+/// record() does no allocation and no floating point.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 3;
+    static constexpr uint64_t SUB_BUCKETS = 1u << SUB_BITS;
+    static constexpr int MAX_BITS = 40;     ///< 2^40 µs ~ 12 days
+    static constexpr size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+    void record(std::chrono::nanoseconds duration)
+    {
+        auto us = static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0) / 1000);
+        ++counts_[bucket_of(us)];
+        ++count_;
+        sum_us_ += us;
+        min_us_ = std::min(min_us_, us);
+        max_us_ = std::max(max_us_, us);
+    }
+
+    /// Add the samples of @p other.
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const { return count_; }
+    std::chrono::microseconds min() const { return std::chrono::microseconds(count_ ? min_us_ : 0); }
+    std::chrono::microseconds max() const { return std::chrono::microseconds(max_us_); }
+    std::chrono::microseconds mean() const
+    {
+        return std::chrono::microseconds(count_ ? sum_us_ / count_ : 0);
+    }
+
+    /// Value below which @p percent of the samples lie (upper edge of the
+    /// bucket, capped at max()).
+    std::chrono::microseconds percentile(double percent) const;
+
+    /// One line: count, min, p50, p90, p99, p99.9 and max.
+    std::string format_summary() const;
+
+    /// One line per non-empty bucket with its range, count and a bar.
+    std::string format_buckets(int bar_width = 40) const;
+
+private:
+    static size_t bucket_of(uint64_t us)
+    {
+        if (us < SUB_BUCKETS) return static_cast<size_t>(us);
+        int octave = std::bit_width(us) - 1;            // >= SUB_BITS
+        if (octave >= MAX_BITS) return BUCKETS - 1;
+        auto sub = (us >> (octave - SUB_BITS)) & (SUB_BUCKETS - 1);
+        return static_cast<size_t>((octave - SUB_BITS + 1) * SUB_BUCKETS + sub);
+    }
+
+    /// Smallest value (µs) that falls into @p bucket.
+    static uint64_t lower_bound_of(size_t bucket);
+
+    std::array<uint64_t, BUCKETS> counts_{};
+    uint64_t count_ = 0;
+    uint64_t sum_us_ = 0;
+    uint64_t min_us_ = UINT64_MAX;
+    uint64_t max_us_ = 0;
+};
+
+/// Format @p d compactly: "850 us", "12.34 ms", "1.250 s".
+std::string format_duration(std::chrono::microseconds d);
+
+/// Parse "1.5", "1.5s", "500ms" or "250us" (seconds without a unit).
+/// @return false if @p text is not a non-negative duration.
+bool parse_duration(const std::string& text, std::chrono::nanoseconds& duration);
+
+} // namespace waveshare
+
+#endif // WAVESHARE_LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,93 @@
+#ifndef WAVESHARE_MODBUS_BATCH_HPP
+#define WAVESHARE_MODBUS_BATCH_HPP
+
+#include <modbus/modbus.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace waveshare {
+
+/// A contiguous block of Modbus addresses.
+struct AddressRange {
+    uint16_t start = 0;
+    uint16_t count = 0;
+};
+
+/// Sort and de-duplicate @p addresses and merge them into ranges.  Two
+/// addresses share a range when at most @p max_gap unrequested addresses
+/// lie between them and the range stays within @p max_count addresses.
+std::vector<AddressRange> coalesce_addresses(std::vector<uint16_t> addresses,
+                                             int max_gap,
+                                             int max_count);
+
+/// Result of reading one coil as part of a batch.
+struct CoilReading {
+    uint16_t address = 0;
+    bool ok = false;
+    bool value = false;
+    std::string error;    ///< Set when !ok
+};
+
+/// Result of reading one holding register as part of a batch.
+struct RegisterReading {
+    uint16_t address = 0;
+    bool ok = false;
+    uint16_t value = 0;
+    std::string error;    ///< Set when !ok
+};
+
+/// Read @p addresses with as few FC01 (read coils) requests as possible
+/// (see coalesce_addresses()).  A range the device rejects is retried
+/// address by address, so unmapped addresses inside a gap cannot fail
+/// the requested ones.
+///
+/// @param ctx           libmodbus context of a connected device.
+/// @param addresses     Coils to read, in output order (duplicates allowed).
+/// @param max_gap       Gap tolerance for merging.
+/// @param transactions  If non-null, receives the number of requests sent.
+/// @return One reading per entry of @p addresses, in the same order.
+std::vector<CoilReading> read_coils_batched(modbus_t* ctx,
+                                            const std::vector<uint16_t>& addresses,
+                                            int max_gap,
+                                            int* transactions = nullptr);
+
+/// Like read_coils_batched(), for holding registers (FC03).
+std::vector<RegisterReading> read_registers_batched(modbus_t* ctx,
+                                                    const std::vector<uint16_t>& addresses,
+                                                    int max_gap,
+                                                    int* transactions = nullptr);
+
+/// One requested coil write.
+struct CoilWrite {
+    uint16_t address = 0;
+    bool state = false;
+};
+
+/// Outcome of one requested coil write.
+struct CoilWriteResult {
+    uint16_t address = 0;
+    bool state = false;
+    bool ok = false;
+    bool superseded = false;  ///< A later write to the same coil replaced this one
+    std::string error;        ///< Set when !ok
+};
+
+/// Write @p writes with as few transactions as possible.  When the same
+/// coil is written twice the last state wins.  Contiguous addresses are
+/// written together with FC15 (write multiple coils), so they switch at
+/// the same moment; a lone address uses FC05.  Coils that were not
+/// requested are never written, so each separate run is its own request.
+///
+/// @param ctx           libmodbus context of a connected device.
+/// @param writes        Writes in request order.
+/// @param transactions  If non-null, receives the number of requests sent.
+/// @return One result per entry of @p writes, in the same order.
+std::vector<CoilWriteResult> write_coils_batched(modbus_t* ctx,
+                                                 const std::vector<CoilWrite>& writes,
+                                                 int* transactions = nullptr);
+
+} // namespace waveshare
+
+#endif // WAVESHARE_MODBUS_BATCH_HPP
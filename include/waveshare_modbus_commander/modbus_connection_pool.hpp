@@ -0,0 +1,53 @@
+#ifndef WAVESHARE_MODBUS_CONNECTION_POOL_HPP
+#define WAVESHARE_MODBUS_CONNECTION_POOL_HPP
+
+#include "libmodbus_cpp/modbus_connection.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace waveshare {
+
+/// Open Modbus TCP connections, one per device address.
+///
+/// A single command uses the pool like create_modbus_connection().  In
+/// `--daemon` mode the pool outlives the commands: each command runs in
+/// a child forked from the daemon, so it inherits the open connections
+/// and skips the TCP handshake.
+class ModbusConnectionPool {
+public:
+    /// Connection to @p ip_address:@p port, opened if necessary.
+    /// @throws std::runtime_error if the connection fails
+    libmodbus_cpp::ModbusConnection& get(const std::string& ip_address, int port, int timeout_seconds);
+
+    /// Open the connection to @p key ("ip:port") unless it is already open.
+    /// @return false if connecting failed.
+    bool open(const std::string& key, int timeout_seconds);
+
+    /// Close the connection to @p key ("ip:port"), if open.
+    void close(const std::string& key) { connections_.erase(key); }
+
+    /// Close connections that the device has closed or that hold unread
+    /// data (e.g. a reply that arrived after a timeout).
+    void prune();
+
+    /// Identity (local TCP port) of each connection, keyed "ip:port".
+    std::map<std::string, int> snapshot();
+
+    /// Keys of connections that were opened, or reconnected by libmodbus,
+    /// since @p before (a result of snapshot()) was taken.
+    std::vector<std::string> changed_since(const std::map<std::string, int>& before);
+
+    size_t size() const { return connections_.size(); }
+
+private:
+    std::map<std::string, libmodbus_cpp::ModbusConnection> connections_;
+};
+
+/// The process-wide pool.
+ModbusConnectionPool& modbus_connection_pool();
+
+} // namespace waveshare
+
+#endif // WAVESHARE_MODBUS_CONNECTION_POOL_HPP
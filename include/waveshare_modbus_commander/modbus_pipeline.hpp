@@ -0,0 +1,122 @@
+#ifndef WAVESHARE_MODBUS_PIPELINE_HPP
+#define WAVESHARE_MODBUS_PIPELINE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#  include "waveshare_modbus_commander/socket_compat.hpp"
+#endif
+
+namespace waveshare {
+
+/// Modbus TCP client that keeps several requests in flight.
+///
+/// Requests are queued with the read_* / write_* calls and sent by
+/// execute(), up to `depth` at a time; replies are matched to their
+/// requests by the MBAP transaction ID.  A device processes the requests
+/// of one connection in order, so writes keep their relative order.
+///
+/// Some devices do not tolerate pipelining: they drop requests that
+/// arrive while one is pending, answer out of protocol, or close the
+/// connection.  On any such symptom the client reconnects, switches to
+/// depth 1 for the rest of its life and re-sends, in order, every
+/// request from the first unanswered one on, including those answered
+/// since.  An unanswered write may have been carried out already, so it
+/// can take effect twice, but never after a write queued behind it.
+class PipelinedModbusClient {
+public:
+    /// Outcome of one request.
+    struct Reply {
+        bool ok = false;
+        std::string error;               ///< Set when !ok
+        std::vector<bool> bits;          ///< FC01/FC02 results
+        std::vector<uint16_t> registers; ///< FC03 results
+    };
+
+    /// @param ip          Device address.
+    /// @param port        Modbus TCP port.
+    /// @param timeout_ms  Response timeout per request.
+    /// @param depth       Maximum requests in flight (1 = serial).
+    /// @param unit_id     Modbus unit (slave) ID.
+    PipelinedModbusClient(std::string ip, int port, int timeout_ms, int depth,
+                          uint8_t unit_id = 1);
+    ~PipelinedModbusClient();
+
+    PipelinedModbusClient(const PipelinedModbusClient&) = delete;
+    PipelinedModbusClient& operator=(const PipelinedModbusClient&) = delete;
+
+    /// Open the TCP connection.  @return false (with @p error) on failure.
+    bool connect(std::string& error);
+
+    /// Queue a request; each returns the ID to pass to reply().
+    size_t read_coils(uint16_t address, uint16_t count);
+    size_t read_discrete_inputs(uint16_t address, uint16_t count);
+    size_t read_registers(uint16_t address, uint16_t count);
+    size_t write_coil(uint16_t address, bool state);
+    size_t write_coils(uint16_t address, const std::vector<bool>& states);
+    size_t write_register(uint16_t address, uint16_t value);
+    size_t write_registers(uint16_t address, const std::vector<uint16_t>& values);
+
+    /// Send every queued request and collect the replies.
+    void execute();
+
+    /// Result of request @p id (valid after execute()).
+    const Reply& reply(size_t id) const { return requests_.at(id).reply; }
+
+    /// Requests queued since the last clear().
+    size_t size() const { return requests_.size(); }
+
+    /// Forget all requests and replies.  The connection stays open.
+    void clear() { requests_.clear(); }
+
+    /// Requests in flight at most (drops to 1 after a fallback).
+    int depth() const { return depth_; }
+
+    /// True once the device made the client fall back to serial mode.
+    bool fell_back() const { return fell_back_; }
+
+    /// Print frame-level diagnostics.
+    void set_debug(bool debug) { debug_ = debug; }
+
+private:
+    struct Request {
+        uint8_t function = 0;
+        uint16_t address = 0;
+        uint16_t count = 0;               ///< Bits/registers to read or written
+        std::vector<uint8_t> pdu;         ///< Function code + data
+        Reply reply;
+        bool done = false;
+        std::chrono::steady_clock::time_point sent_at;  ///< Only set with --stats
+    };
+
+    size_t enqueue(uint8_t function, uint16_t address, uint16_t count, std::vector<uint8_t> data);
+    bool connect_socket(std::string& error);
+    bool reconnect();
+    void disconnect();
+    bool send_request(size_t index, uint16_t tid);
+    void complete(Request& request, const uint8_t* pdu, size_t len);
+    void fail_remaining(const std::string& error);
+
+    std::string ip_;
+    int port_;
+    int timeout_ms_;
+    int depth_;
+    uint8_t unit_id_;
+    bool fell_back_ = false;
+    bool debug_ = false;
+
+#ifdef _WIN32
+    WinsockInit wsa_init_;                ///< The client may be the process's only socket user
+#endif
+    intptr_t sock_ = -1;                  ///< socket_t, kept opaque in the header
+    uint16_t next_tid_ = 1;
+    std::vector<Request> requests_;
+};
+
+} // namespace waveshare
+
+#endif // WAVESHARE_MODBUS_PIPELINE_HPP
@@ -3,6 +3,7 @@
 
 #include <array>
 #include <cstdint>
+#include <functional>
 #include <optional>
 #include <string>
 #include <vector>
@@ -32,26 +33,107 @@ struct DiscoveredDevice {
     std::array<uint8_t, VIRCOM_PACKET_SIZE> raw_response{};
 };
 
+/// Parameters for scan_network().
+struct ScanOptions {
+    /// Wait for responses after the last probe (ms).  A paced sweep of
+    /// @ref extra_subnets adds its own duration, so this does not bound
+    /// the whole scan.
+    int timeout_ms = 3000;
+    bool debug = false;     ///< Print diagnostic information
+    std::string target_ip;  ///< Optional specific IP to probe via unicast
+
+    /// Ranges to sweep with unicast probes, in CIDR notation
+    /// (e.g. "10.20.0.0/20"; a bare address means its /24).
+    std::vector<std::string> extra_subnets;
+
+    /// Sweep probes per second (token bucket), 0 = unpaced.
+    int probe_rate = 0;
+
+    /// Addresses probed via unicast before anything else, e.g. the
+    /// last-known IPs from the discovery cache.
+    std::vector<std::string> priority_ips;
+
+    /// Skip broadcasts and the WSL2 auto-sweep; probe only the unicast
+    /// targets and @ref extra_subnets.
+    bool unicast_only = false;
+
+    /// End the scan once replies have stopped arriving: when no new
+    /// device has answered for a quiet window derived from the observed
+    /// round-trip times.  The wait after the last probe never exceeds
+    /// @ref timeout_ms, and a scan without any reply always runs to it.
+    bool adaptive = false;
+
+    /// Optional predicate that ends the scan as soon as a response
+    /// satisfies it; @ref timeout_ms then only bounds the wait.
+    std::function<bool(const DiscoveredDevice&)> stop_when;
+};
+
 /// Scan the local network for Waveshare devices using the VirCom
 /// UDP broadcast protocol.  Sends a search request to all available
 /// broadcast addresses and collects responses within the given timeout.
 ///
 /// The scan targets (in order):
+///   0. Unicast to each of ScanOptions::priority_ips
 ///   1. 255.255.255.255 (limited broadcast — works on the local L2 segment)
 ///   2. Per-interface directed broadcasts (e.g. 192.168.178.255)
-///   3. Unicast to @p target_ip, if non-empty (useful from NATed environments
-///      such as WSL2 where broadcasts don't reach the physical LAN)
-///   4. Unicast sweep of all /24 subnets in @p extra_subnets
+///   3. Unicast to ScanOptions::target_ip, if non-empty (useful from NATed
+///      environments such as WSL2 where broadcasts don't reach the physical LAN)
+///   4. Unicast sweep of all ranges in ScanOptions::extra_subnets
 ///   5. (WSL2 only) auto-discovered Windows-host subnets via DNS
 ///
-/// @param timeout_ms     How long to wait for responses (milliseconds).
+/// Sweep ranges are merged so each host is probed once, and the sweep is
+/// interleaved with receiving so replies are not dropped behind a burst.
+///
+/// @return Vector of discovered devices (may be empty).
+std::vector<DiscoveredDevice> scan_network(const ScanOptions& options);
+
+/// Convenience overload of scan_network(const ScanOptions&).
+///
+/// @param timeout_ms     How long to wait for responses after the last probe (milliseconds).
 /// @param debug          Print diagnostic information if true.
 /// @param target_ip      Optional specific IP to probe via unicast.
-/// @param extra_subnets  Additional /24 subnets to sweep (e.g. {"192.168.1.0"}).
+/// @param extra_subnets  Additional ranges to sweep (e.g. {"192.168.1.0/24"}).
+/// @param stop_when      Optional predicate that ends the scan early.
 /// @return Vector of discovered devices (may be empty).
 std::vector<DiscoveredDevice> scan_network(int timeout_ms, bool debug,
                                            const std::string& target_ip = {},
-                                           const std::vector<std::string>& extra_subnets = {});
+                                           const std::vector<std::string>& extra_subnets = {},
+                                           const std::function<bool(const DiscoveredDevice&)>& stop_when = {});
+
+/// Build a scan_network() stop predicate that accepts the device
+/// resolve_target_device() would pick for the same identifiers.
+/// Returns an empty function (no early exit) when no identifier or
+/// more than one identifier is given, because the full device list
+/// is needed to auto-select or to report the error.  A name also gets
+/// no early exit: resolve_target_device() must see every device with
+/// that name to reject an ambiguous one.
+std::function<bool(const DiscoveredDevice&)> make_target_matcher(
+    const std::string& mac,
+    const std::string& name,
+    const std::string& ip);
+
+/// Ask a single device for its VirCom configuration with one unicast
+/// search request, without any broadcast.  Used to confirm that a
+/// cached address is still valid.
+///
+/// @param ip          Address to probe.
+/// @param mac         MAC the answering device must have.
+/// @param timeout_ms  How long to wait for the answer (milliseconds).
+/// @param debug       Print diagnostic information.
+/// @return The device's current configuration, or std::nullopt.
+std::optional<DiscoveredDevice> probe_device(const std::string& ip,
+                                             const std::string& mac,
+                                             int timeout_ms,
+                                             bool debug);
+
+/// Parse a 170-byte VirCom search response into @p dev.
+/// @return true if @p data is a well-formed response.
+bool parse_vircom_response(const uint8_t* data, size_t len, DiscoveredDevice& dev);
+
+/// True if @p devices already holds a device with @p device's IP address.
+/// scan_network() drops such duplicates, which arrive when a device
+/// answers more than one of the probes (e.g. a broadcast and a unicast).
+bool is_duplicate_device(const std::vector<DiscoveredDevice>& devices, const DiscoveredDevice& device);
 
 /// Format a list of discovered devices as a human-readable table.
 std::string format_device_table(const std::vector<DiscoveredDevice>& devices);
@@ -74,6 +156,93 @@ const DiscoveredDevice* resolve_target_device(
     const std::string& ip,
     std::string& error);
 
+/// A set of VirCom configuration changes applied with a single SET_CONFIG
+/// (and therefore a single reboot).  Unset fields keep the device's
+/// current value.
+struct DeviceConfigChange {
+    std::optional<std::string> ip;       ///< Static IP (requires mask/gateway/dns)
+    std::optional<std::string> mask;
+    std::optional<std::string> gateway;
+    std::optional<std::string> dns;
+    std::optional<bool> dhcp;            ///< true = DHCP, false = static
+    bool modbus_tcp = false;             ///< Modbus TCP protocol, TCP Server work mode
+    std::optional<uint16_t> port;        ///< Listening port
+    std::optional<std::string> name;     ///< Device name (max 9 ASCII characters)
+
+    /// True if no field is set.
+    bool empty() const;
+
+    /// Overlay the fields set in @p later (later settings win).
+    void merge(const DeviceConfigChange& later);
+
+    /// Address the device will use after the change, or empty if it
+    /// keeps its address or switches to DHCP.
+    std::string expected_ip() const;
+};
+
+/// One-line human-readable summary of @p change,
+/// e.g. "IP 10.0.0.5/255.255.255.0 gw 10.0.0.1 dns 8.8.8.8, port 502".
+std::string format_config_change(const DeviceConfigChange& change);
+
+/// Build the SET_CONFIG packet for @p change, using @p device's raw
+/// VirCom response as the template.
+/// @return false (after printing the reason) if a field is invalid.
+bool build_config_packet(const DiscoveredDevice& device,
+                         const DeviceConfigChange& change,
+                         std::array<uint8_t, VIRCOM_PACKET_SIZE>& packet);
+
+/// One byte in which a SET_CONFIG packet differs from the device's
+/// current configuration.
+struct ConfigByteDiff {
+    size_t offset = 0;
+    uint8_t before = 0;
+    uint8_t after = 0;
+};
+
+/// Compare @p packet with @p device's raw VirCom response, ignoring the
+/// command byte.  An empty result means the device is already configured.
+std::vector<ConfigByteDiff> diff_config_packet(const DiscoveredDevice& device,
+                                               const std::array<uint8_t, VIRCOM_PACKET_SIZE>& packet);
+
+/// Format @p diff one byte per line with the field it belongs to,
+/// e.g. "  0x13 port:     0x01 -> 0x13".
+std::string format_config_diff(const std::vector<ConfigByteDiff>& diff);
+
+/// Retry policy for acknowledged SET_CONFIG delivery.
+struct ConfigDeliveryOptions {
+    int max_attempts = 4;          ///< SET_CONFIG transmissions before giving up
+    int initial_timeout_ms = 400;  ///< Confirmation window of the first attempt (doubles per retry)
+    int max_timeout_ms = 3200;     ///< Upper bound for the confirmation window
+    bool debug = false;            ///< Print diagnostic information
+};
+
+/// Outcome of deliver_device_config().
+struct ConfigDeliveryResult {
+    bool acknowledged = false;     ///< The device confirmed the change
+    bool went_silent = false;      ///< Confirmed by the device going silent to reboot
+    int attempts = 0;              ///< SET_CONFIG transmissions (1 = no retry)
+    int packets_sent = 0;          ///< All datagrams sent (SET_CONFIG and confirmation probes)
+    int elapsed_ms = 0;            ///< Time until confirmation or giving up
+};
+
+/// Send the SET_CONFIG for @p change and confirm that @p device got it.
+///
+/// Confirmation is either a VirCom answer that already carries the new
+/// configuration, or the device going silent (rebooting to apply it).
+/// While the device keeps answering with its old configuration, the
+/// packet is resent with a doubling confirmation window.
+ConfigDeliveryResult deliver_device_config(const DiscoveredDevice& device,
+                                                const DeviceConfigChange& change,
+                                                const ConfigDeliveryOptions& options);
+
+/// Apply all fields of @p change to @p device in one acknowledged
+/// SET_CONFIG (see deliver_device_config()).  The device reboots
+/// afterwards; see wait_for_device_reboot().
+/// @return true if the device confirmed the change.
+bool apply_device_config(const DiscoveredDevice& device,
+                         const DeviceConfigChange& change,
+                         bool debug);
+
 /// Set a device to a static IP configuration via VirCom SET_CONFIG.
 /// The device is identified by its MAC address.
 /// @param device      The device (from scan_network) to configure.
@@ -90,9 +259,36 @@ bool set_device_ip(const DiscoveredDevice& device,
                    const std::string& new_dns,
                    bool debug);
 
+/// Where and how to watch for a device coming back from a reboot.
+struct RebootWatchOptions {
+    int wait_timeout_ms = 30000;  ///< How long to wait (milliseconds)
+    bool debug = false;           ///< Print diagnostic information
+    std::string expected_ip;      ///< Address from the SET_CONFIG payload (empty = unknown, e.g. DHCP)
+    std::string previous_ip;      ///< Address before the change
+    uint16_t modbus_port = 0;     ///< Also wait until this Modbus TCP port accepts connections (0 = off)
+    bool already_silent = false;  ///< The device was already seen going down (e.g. by deliver_device_config())
+};
+
 /// Wait for a device (identified by MAC) to reappear on the network
 /// after a configuration change that triggers a reboot.
-/// Scans periodically until the device is found or the timeout expires.
+///
+/// Keeps one socket open and probes the expected and previous addresses
+/// plus all broadcast addresses, starting at short intervals and backing
+/// off once the device has been seen silent, i.e. has missed several
+/// probe rounds in a row.  A reply counts once that happened (or carries
+/// the expected new address, or a settle time has passed), so the answer
+/// of the not-yet-rebooted device is not mistaken for its return.  With
+/// RebootWatchOptions::modbus_port set, a Modbus TCP connect is raced
+/// alongside and the device only counts as back once both succeed.
+///
+/// @param mac_address  MAC address to look for.
+/// @param options      Watch parameters.
+/// @return The rediscovered device, or std::nullopt on timeout.
+std::optional<DiscoveredDevice> wait_for_device_reboot(
+    const std::string& mac_address,
+    const RebootWatchOptions& options);
+
+/// Convenience overload of wait_for_device_reboot() without address hints.
 ///
 /// @param mac_address     MAC address to look for.
 /// @param wait_timeout_ms How long to wait (milliseconds).
@@ -103,6 +299,48 @@ std::optional<DiscoveredDevice> wait_for_device_reboot(
     int wait_timeout_ms,
     bool debug);
 
+/// One device of a fleet provisioning run.
+struct ProvisionTarget {
+    DiscoveredDevice device;     ///< As discovered before the change
+    DeviceConfigChange change;   ///< Configuration to apply
+};
+
+/// What happened to a device during provisioning.
+enum class ProvisionStatus {
+    CONFIGURED,          ///< Change confirmed and the device came back
+    ALREADY_CONFIGURED,  ///< Nothing to change (set by the caller)
+    NOT_FOUND,           ///< Not discovered (set by the caller)
+    INVALID,             ///< The change could not be built into a packet
+    CONFIG_FAILED,       ///< SET_CONFIG was never confirmed
+    REBOOT_TIMEOUT,      ///< Confirmed, but did not reappear in time
+};
+
+/// Result for one device of provision_devices().
+struct ProvisionOutcome {
+    std::string mac_address;
+    ProvisionStatus status = ProvisionStatus::CONFIG_FAILED;
+    DiscoveredDevice device;            ///< After the reboot (else as before)
+    ConfigDeliveryResult delivery;      ///< SET_CONFIG delivery statistics
+    int reboot_ms = 0;                  ///< From confirmation until the device answered again
+};
+
+/// Configure many devices at once: all SET_CONFIGs are delivered
+/// concurrently (see deliver_device_config()) and every reboot is
+/// tracked from a single socket, so the whole run takes about as long
+/// as the slowest device rather than the sum of all reboots.
+///
+/// @param targets          Devices with their changes.
+/// @param delivery         Retry policy for each SET_CONFIG.
+/// @param wait_timeout_ms  Per-device reboot timeout, counted from confirmation.
+/// @return One outcome per target, in the same order.
+std::vector<ProvisionOutcome> provision_devices(const std::vector<ProvisionTarget>& targets,
+                                                const ConfigDeliveryOptions& delivery,
+                                                int wait_timeout_ms);
+
+/// Format provisioning outcomes as a status table with configuration
+/// and reboot times.
+std::string format_provision_table(const std::vector<ProvisionOutcome>& outcomes);
+
 /// Set a device to DHCP mode via VirCom SET_CONFIG.
 /// After sending the command, waits for the device to reappear on the
 /// network with a new (DHCP-assigned) IP address.
@@ -0,0 +1,121 @@
+#ifndef WAVESHARE_OPERATION_STATS_HPP
+#define WAVESHARE_OPERATION_STATS_HPP
+
+#include "waveshare_modbus_commander/trace.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+namespace waveshare {
+
+/// Operations whose latency --stats reports.
+enum class StatOp : uint8_t {
+    CONNECT,                ///< Modbus TCP connect
+    READ_COILS,             ///< FC01
+    READ_DISCRETE_INPUTS,   ///< FC02
+    READ_REGISTERS,         ///< FC03
+    WRITE_COIL,             ///< FC05
+    WRITE_REGISTER,         ///< FC06
+    WRITE_COILS,            ///< FC15
+    WRITE_REGISTERS,        ///< FC16
+    SCAN,                   ///< VirCom network scan
+    SET_CONFIG,             ///< VirCom SET_CONFIG until confirmed
+    REBOOT_WAIT,            ///< Waiting for a device to come back
+    COUNT
+};
+
+/// Display name, e.g. "FC01 read coils".
+const char* stat_op_name(StatOp op);
+
+/// The operation of a Modbus function code, if it is one of the above.
+std::optional<StatOp> stat_op_for_function(uint8_t function);
+
+namespace detail {
+extern bool operation_stats_enabled;
+}
+
+/// Whether --stats is on.  This is all a disabled OpTimer costs.
+inline bool operation_stats_enabled() { return detail::operation_stats_enabled; }
+
+/// Start recording; call before any other thread or process is started.
+void enable_operation_stats();
+
+/// Forget everything recorded so far (e.g. in a forked child).
+void reset_operation_stats();
+
+/// Record one operation.  Thread-safe.
+void record_operation(StatOp op, std::chrono::nanoseconds elapsed, bool ok);
+
+/// Table of every operation seen: count, errors, p50, p90, p99 and max.
+std::string format_operation_stats();
+
+/// Times an operation from construction to destruction when --stats is
+/// on; otherwise it does nothing.  The operation counts as an error if
+/// fail() was called or the scope is left by an exception.  With --trace
+/// the operation is also recorded as a span.
+class OpTimer {
+public:
+    explicit OpTimer(StatOp op)
+        :
+#if WAVESHARE_HAVE_TRACE
+          span_(stat_op_name(op)),
+#endif
+          op_(op)
+    {
+        if (operation_stats_enabled()) {
+            active_ = true;
+            exceptions_ = std::uncaught_exceptions();
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~OpTimer()
+    {
+        if (active_) {
+            int saved_errno = errno;    // callers report the operation's error afterwards
+            record_operation(op_, std::chrono::steady_clock::now() - start_,
+                             ok_ && std::uncaught_exceptions() == exceptions_);
+            errno = saved_errno;
+        }
+    }
+
+    OpTimer(const OpTimer&) = delete;
+    OpTimer& operator=(const OpTimer&) = delete;
+
+    /// Count the operation as an error.
+    void fail() { ok_ = false; }
+
+private:
+#if WAVESHARE_HAVE_TRACE
+    TraceSpan span_;
+#endif
+    StatOp op_;
+    bool active_ = false;
+    bool ok_ = true;
+    int exceptions_ = 0;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/// Run @p call, a Modbus call returning bool or a libmodbus-style int
+/// (-1 on error), as operation @p op and return its result.
+template <typename Call>
+auto timed(StatOp op, Call&& call)
+{
+    OpTimer timer(op);
+    auto result = call();
+    if constexpr (std::is_same_v<decltype(result), bool>) {
+        if (!result) timer.fail();
+    } else {
+        if (result < 0) timer.fail();
+    }
+    return result;
+}
+
+} // namespace waveshare
+
+#endif // WAVESHARE_OPERATION_STATS_HPP
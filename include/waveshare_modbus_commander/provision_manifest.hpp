@@ -0,0 +1,38 @@
+#ifndef WAVESHARE_PROVISION_MANIFEST_HPP
+#define WAVESHARE_PROVISION_MANIFEST_HPP
+
+#include "waveshare_modbus_commander/network_scanner.hpp"
+
+#include <string>
+#include <vector>
+
+namespace waveshare {
+
+/// Desired configuration of one device in a provisioning manifest.
+struct ProvisionEntry {
+    std::string mac_address;    ///< Lower-case, colon-separated
+    DeviceConfigChange change;  ///< Fields to set; unset fields are left alone
+};
+
+/// Load a provisioning manifest (`--provision`).
+///
+/// Both formats describe one device per record with the keys
+/// `mac` (required), `ip`, `mask`, `gateway`, `dns`, `name`, `port`,
+/// `protocol` and `dhcp`.  Missing or empty values keep the device's
+/// current setting; `ip` may be `dhcp`.  `protocol` accepts `modbus_tcp`.
+///
+/// - `.csv`:  a header row naming the columns, then one row per device.
+///   Blank lines and lines starting with `#` are ignored.
+/// - `.json`: an array of objects, or an object with a `devices` array.
+///
+/// @param path     Manifest file; the format follows the extension.
+/// @param entries  Receives one entry per device.
+/// @param error    Receives a description (with line number) on failure.
+/// @return true on success.
+bool load_provision_manifest(const std::string& path,
+                             std::vector<ProvisionEntry>& entries,
+                             std::string& error);
+
+} // namespace waveshare
+
+#endif // WAVESHARE_PROVISION_MANIFEST_HPP
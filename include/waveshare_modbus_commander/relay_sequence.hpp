@@ -0,0 +1,45 @@
+#ifndef WAVESHARE_RELAY_SEQUENCE_HPP
+#define WAVESHARE_RELAY_SEQUENCE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace waveshare {
+
+/// One step of a relay sequence: at @c offset from the start of the
+/// cycle, the relays are set to @c mask.
+struct SequenceStep {
+    std::chrono::nanoseconds offset{};
+    uint8_t mask = 0;   ///< bit 0 = relay 1
+    int line = 0;       ///< Line in the sequence file (0 if built in code)
+};
+
+/// A timeline of relay patterns (`--sequence`).
+struct RelaySequence {
+    std::vector<SequenceStep> steps;            ///< Ordered by offset
+    std::optional<std::chrono::nanoseconds> cycle; ///< Set: repeat every cycle
+};
+
+/// Load a sequence file.
+///
+/// One step per line: a time offset from the start of the cycle and a
+/// relay pattern in the --set-relays syntax (`0b10110001`, `0xB1`,
+/// `1,5,6,8`, `none`, `all`).  Offsets are seconds (`1.5`) or carry a
+/// unit (`1.5s`, `500ms`, `250us`); a leading `+` makes an offset
+/// relative to the previous step.  A final `<offset> loop` line repeats
+/// the sequence with that cycle length; without it the sequence runs
+/// once.  Blank lines and everything after `#` are ignored.
+///
+/// @param error  Receives a description (with line number) on failure.
+/// @return true on success.
+bool load_relay_sequence(const std::string& path, RelaySequence& sequence, std::string& error);
+
+/// Parse the contents of a sequence file; see load_relay_sequence().
+bool parse_relay_sequence(const std::string& text, RelaySequence& sequence, std::string& error);
+
+} // namespace waveshare
+
+#endif // WAVESHARE_RELAY_SEQUENCE_HPP
@@ -0,0 +1,255 @@
+#ifndef WAVESHARE_RELAY_SIMULATOR_HPP
+#define WAVESHARE_RELAY_SIMULATOR_HPP
+
+#include "waveshare_modbus_commander/network_scanner.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace waveshare {
+
+/// How a simulated relay board behaves (see RelaySimulator).
+struct SimulatorOptions {
+    std::string ip_address = "127.0.0.1";       ///< Address the board reports and serves Modbus TCP on
+    uint16_t modbus_port = 5020;                ///< Modbus TCP port until a SET_CONFIG changes it
+    std::string mac_address = "02:00:00:00:00:01";
+    std::string device_name = "SIM01";          ///< Max 9 characters
+    bool vircom = true;                         ///< Answer VirCom on UDP port 1092
+
+    std::chrono::microseconds latency{0};       ///< Added to every reply
+    std::chrono::microseconds jitter{0};        ///< Uniformly distributed extra delay, 0 to jitter
+    double loss = 0.0;                          ///< Probability that a request goes unanswered
+    std::chrono::milliseconds reboot_time{3000}; ///< Silence after a SET_CONFIG
+    uint32_t seed = 0;                          ///< Seed for jitter and loss (0 = random)
+
+    uint8_t inputs = 0;                         ///< Discrete inputs, bit 0 = DI1
+    std::chrono::milliseconds input_period{0};  ///< Non-zero: the inputs count up in binary at this period
+
+    bool debug = false;                         ///< Log every request
+};
+
+/// State of one Waveshare Modbus POE ETH relay board, without any I/O.
+///
+/// Modbus: coils 0-7 are the relays (a single-coil write to 0x00FF
+/// switches all of them), discrete inputs 0-7 the digital inputs, and
+/// holding registers 0-255 plain storage.  Other addresses and function
+/// codes are answered with the Modbus exception a real device sends.
+/// VirCom: the board answers searches with its configuration and takes
+/// SET_CONFIG packets carrying its MAC.
+class SimulatedBoard {
+public:
+    static constexpr uint16_t RELAY_COUNT = 8;
+    static constexpr uint16_t INPUT_COUNT = 8;
+    static constexpr uint16_t REGISTER_COUNT = 256;
+    static constexpr uint16_t ALL_RELAYS = 0x00FF;  ///< Coil address that switches every relay
+
+    /// @throws std::invalid_argument if the address, MAC or name in
+    ///         @p options cannot be represented in a VirCom packet.
+    explicit SimulatedBoard(const SimulatorOptions& options);
+
+    /// Execute the request @p pdu (function code and data, without the
+    /// MBAP header) and return the response PDU.
+    std::vector<uint8_t> handle_modbus(const uint8_t* pdu, size_t len);
+
+    /// VirCom search response carrying the current configuration.
+    const std::array<uint8_t, VIRCOM_PACKET_SIZE>& vircom_response() const { return config_; }
+
+    /// Take a SET_CONFIG packet.  @return false if @p packet is not a
+    /// SET_CONFIG for this board's MAC.
+    bool apply_config(const uint8_t* packet, size_t len);
+
+    /// Power cycle: the relays drop out, configuration and registers stay.
+    void reboot() { relays_ = 0; }
+
+    void set_inputs(uint8_t inputs) { inputs_ = inputs; }
+    uint8_t relays() const { return relays_; }
+    uint8_t inputs() const { return inputs_; }
+    uint16_t register_value(uint16_t address) const { return registers_.at(address); }
+
+    std::string ip_address() const;
+    uint16_t modbus_port() const;
+    std::string mac_address() const;
+    std::string device_name() const;
+
+private:
+    uint8_t relays_ = 0;            ///< bit 0 = relay 1
+    uint8_t inputs_ = 0;            ///< bit 0 = DI1
+    std::array<uint16_t, REGISTER_COUNT> registers_{};
+    std::array<uint8_t, VIRCOM_PACKET_SIZE> config_{};
+};
+
+/// What a RelaySimulator has served so far.
+struct SimulatorCounters {
+    uint64_t modbus_requests = 0;   ///< Modbus requests received
+    uint64_t modbus_dropped = 0;    ///< ... of which were lost on purpose
+    uint64_t connections = 0;       ///< Modbus TCP connections accepted
+    uint64_t vircom_requests = 0;   ///< VirCom searches and SET_CONFIGs received
+    uint64_t vircom_dropped = 0;    ///< ... of which were lost on purpose
+    uint64_t reboots = 0;           ///< Applied SET_CONFIGs
+};
+
+/// A SimulatedBoard served on the network, for exercising the commander
+/// without hardware.
+///
+/// Modbus TCP is served on the board's configured address and port and
+/// VirCom on UDP port 1092 of every local address, so the commander finds
+/// the board with `--scan-network -i 127.0.0.1` and can reconfigure it.
+/// Each reply is held back by the configured latency plus jitter, and a
+/// request may be dropped to model loss; one connection is answered in
+/// order, like the real device does.  After a SET_CONFIG the board goes
+/// silent for the reboot time and comes back with the new configuration
+/// (any address in 127.0.0.0/8 works on Linux).
+///
+/// POSIX only.
+class RelaySimulator {
+public:
+    /// @throws std::invalid_argument as SimulatedBoard does.
+    explicit RelaySimulator(const SimulatorOptions& options);
+    ~RelaySimulator();
+    RelaySimulator(const RelaySimulator&) = delete;
+    RelaySimulator& operator=(const RelaySimulator&) = delete;
+
+    /// Open the sockets.  @return false (with @p error set) if a port is
+    /// taken or the configured address is not local.
+    bool start(std::string& error);
+
+    /// Serve until @p stop becomes true (checked at least every 100 ms).
+    void run(const std::atomic<bool>& stop);
+
+    /// Snapshot of the counters; may be called from another thread.
+    SimulatorCounters counters() const;
+
+    /// Port the Modbus TCP server currently listens on.
+    uint16_t modbus_port() const { return listen_port_.load(); }
+
+private:
+    struct Connection;
+    struct Pending;
+
+    bool listen_modbus(std::string& error);
+    void close_modbus();
+    void read_vircom();
+    void accept_connections();
+    bool read_connection(Connection& conn);
+    void deliver(const Pending& pending);
+    std::chrono::nanoseconds reply_delay();
+    bool lose();
+    uint8_t current_inputs() const;
+
+    SimulatorOptions options_;
+    SimulatedBoard board_;
+    int udp_ = -1;
+    int listener_ = -1;
+    std::atomic<uint16_t> listen_port_{0};
+    std::vector<Connection> connections_;
+    std::vector<Pending> pending_;          ///< Min-heap on the due time
+    uint64_t next_connection_id_ = 1;
+    uint64_t next_sequence_ = 0;
+    bool rebooting_ = false;
+    std::chrono::steady_clock::time_point back_at_{};
+    std::chrono::steady_clock::time_point started_at_{};
+    std::mt19937 random_;
+
+    std::atomic<uint64_t> modbus_requests_{0};
+    std::atomic<uint64_t> modbus_dropped_{0};
+    std::atomic<uint64_t> connections_accepted_{0};
+    std::atomic<uint64_t> vircom_requests_{0};
+    std::atomic<uint64_t> vircom_dropped_{0};
+    std::atomic<uint64_t> reboots_{0};
+};
+
+/// How a simulated fleet of VirCom devices behaves (see VirComFleet).
+struct FleetOptions {
+    std::string first_ip = "127.1.0.1";         ///< Address of device 1; the others follow consecutively
+    uint32_t count = 500;                       ///< Number of devices
+
+    std::chrono::microseconds latency{0};       ///< Response delay of every device
+    std::chrono::microseconds delay_spread{0};  ///< Each device adds its own fixed 0 to delay_spread
+    double loss = 0.0;                          ///< Probability that a device ignores a search
+    double loss_spread = 0.0;                   ///< Each device adds its own fixed 0 to loss_spread
+    uint32_t seed = 0;                          ///< Seed for the per-device values and loss (0 = random)
+
+    bool debug = false;                         ///< Log every search
+};
+
+/// What a VirComFleet has served so far.
+struct FleetCounters {
+    uint64_t searches = 0;          ///< Searches addressed to a device (a broadcast counts once per device)
+    uint64_t replies = 0;           ///< Responses handed to the kernel
+    uint64_t dropped = 0;           ///< Searches lost on purpose
+    uint64_t send_errors = 0;       ///< Responses the kernel refused (e.g. send buffer full)
+};
+
+/// Many VirCom-only devices served from one UDP socket, for measuring
+/// discovery at scale without a lab full of boards.
+///
+/// Device i (counting from 0) has the address first_ip + i, the MAC
+/// 02:00:01:00:hh:ll and the name FLEETnnnn (i + 1 in both), and answers
+/// searches unicast to its address from that address, like a real device
+/// on the LAN.  Searches to 255.255.255.255 or a directed broadcast are
+/// answered by every device.  Searches to other addresses are ignored, so
+/// a sweep of subnet() sees the fleet and nothing else.
+///
+/// The addresses must be local: any address in 127.0.0.0/8 is on Linux,
+/// elsewhere they are loopback aliases or the far end of a veth pair in a
+/// network namespace.  Needs IP_PKTINFO (Linux).  POSIX only.
+class VirComFleet {
+public:
+    static constexpr uint32_t MAX_DEVICES = 9999;   ///< Four digits of device name
+
+    /// @throws std::invalid_argument if @p options describe no devices,
+    ///         too many, or an invalid first address.
+    explicit VirComFleet(const FleetOptions& options);
+    ~VirComFleet();
+    VirComFleet(const VirComFleet&) = delete;
+    VirComFleet& operator=(const VirComFleet&) = delete;
+
+    /// Open the VirCom socket.  @return false (with @p error set) if
+    /// UDP port 1092 is taken or IP_PKTINFO is not available.
+    bool start(std::string& error);
+
+    /// Serve until @p stop becomes true (checked at least every 100 ms).
+    void run(const std::atomic<bool>& stop);
+
+    /// Snapshot of the counters; may be called from another thread.
+    FleetCounters counters() const;
+
+    uint32_t size() const { return options_.count; }
+
+    /// Smallest CIDR range whose hosts include every device, for
+    /// ScanOptions::extra_subnets (e.g. "127.1.0.0/22").
+    std::string subnet() const;
+
+    std::string ip_address(uint32_t index) const;
+    std::string mac_address(uint32_t index) const;
+    std::string device_name(uint32_t index) const;
+
+private:
+    struct Device;
+    struct Reply;
+
+    void read_searches();
+    void send_reply(const Reply& reply);
+
+    FleetOptions options_;
+    uint32_t first_ip_ = 0;                 ///< Host byte order
+    std::vector<Device> devices_;
+    int udp_ = -1;
+    std::vector<Reply> pending_;            ///< Min-heap on the due time
+    uint64_t next_sequence_ = 0;
+    std::mt19937 random_;
+
+    std::atomic<uint64_t> searches_{0};
+    std::atomic<uint64_t> replies_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> send_errors_{0};
+};
+
+} // namespace waveshare
+
+#endif // WAVESHARE_RELAY_SIMULATOR_HPP
@@ -0,0 +1,79 @@
+#ifndef WAVESHARE_RELAY_STATE_HPP
+#define WAVESHARE_RELAY_STATE_HPP
+
+#include <modbus/modbus.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace waveshare {
+
+/// Number of relays (coils 0x0000-0x0007) on the Waveshare relay boards.
+constexpr int RELAY_COUNT = 8;
+
+/// Parse a relay pattern into a mask (bit 0 = relay 1 = coil 0x0000).
+///
+/// Accepted forms: binary `0b10110001` (rightmost digit = relay 1), hex
+/// `0xB1`, a list of 1-based relay numbers `1,5,6,8`, and the words
+/// `none` and `all`.  An empty pattern is an error, so that all relays
+/// off must be asked for explicitly.
+/// @return false (with @p error set) if @p text is not a valid pattern.
+bool parse_relay_mask(const std::string& text, uint8_t& mask, std::string& error);
+
+/// Format @p mask as the list of relays that are on, e.g. "1,5,6,8"
+/// (or "none").
+std::string format_relay_mask(uint8_t mask);
+
+/// Relay states as last read from or written to the device.
+///
+/// The first apply() reads all relays once (FC01); afterwards the
+/// shadow copy is compared with the requested pattern and only a real
+/// change is written, as one FC15 covering all relays.  Writes made by
+/// other clients are not seen until invalidate() forces a new read, and
+/// apply() overwrites them; apply_change() only writes the relays it is
+/// asked to switch.
+class RelayShadow {
+public:
+    enum class Result {
+        UNCHANGED,  ///< Already in the requested state; nothing sent
+        WRITTEN,    ///< The pattern was written
+        FAILED,     ///< Reading or writing failed; see last_error()
+    };
+
+    explicit RelayShadow(modbus_t* ctx);
+
+    /// Bring the relays to @p mask.
+    Result apply(uint8_t mask);
+
+    /// Switch the relays in @p on on and those in @p off off, leaving all
+    /// others alone: each run of adjacent relays is one write (FC05 for a
+    /// single relay, FC15 for several), so relays changed by other clients
+    /// are not overwritten.  Needs no shadow copy and always writes.
+    Result apply_change(uint8_t on, uint8_t off);
+
+    /// Read the relays now (FC01) into the shadow copy.
+    /// @return false if the read failed; the shadow copy is then unknown.
+    bool refresh();
+
+    /// Forget the shadow copy; the next apply() reads the device again.
+    void invalidate() { state_.reset(); }
+
+    /// The shadow copy, if known.
+    std::optional<uint8_t> state() const { return state_; }
+
+    const std::string& last_error() const { return last_error_; }
+
+    /// Modbus requests sent so far.
+    int transactions() const { return transactions_; }
+
+private:
+    modbus_t* ctx_;
+    std::optional<uint8_t> state_;
+    std::string last_error_;
+    int transactions_ = 0;
+};
+
+} // namespace waveshare
+
+#endif // WAVESHARE_RELAY_STATE_HPP
@@ -0,0 +1,117 @@
+#ifndef WAVESHARE_SOCKET_COMPAT_HPP
+#define WAVESHARE_SOCKET_COMPAT_HPP
+
+// Minimal portability layer over Winsock and BSD sockets, shared by the
+// VirCom scanner and the Modbus TCP transports.
+
+// Platform-specific socket headers
+#ifdef _WIN32
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
+#  include <iphlpapi.h>
+#  pragma comment(lib, "ws2_32.lib")
+#  pragma comment(lib, "iphlpapi.lib")
+   using socket_t = SOCKET;
+   constexpr socket_t INVALID_SOCK = INVALID_SOCKET;
+   inline int close_socket(socket_t s) { return closesocket(s); }
+   inline int set_socket_nonblocking(socket_t s) {
+       u_long mode = 1;
+       return ioctlsocket(s, FIONBIO, &mode);
+   }
+   inline int get_last_socket_error() { return WSAGetLastError(); }
+   inline bool would_block(int err) { return err == WSAEWOULDBLOCK; }
+   /// Block until @p s is readable or @p timeout_ms elapses.
+   /// Returns > 0 when readable, 0 on timeout, < 0 on error.
+   inline int wait_readable(socket_t s, int timeout_ms) {
+       fd_set readfds;
+       FD_ZERO(&readfds);
+       FD_SET(s, &readfds);
+       timeval tv{timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+       return ::select(0, &readfds, nullptr, nullptr, &tv);
+   }
+   /// Like wait_readable(), additionally watching @p wr (if valid) for
+   /// completion of a non-blocking connect().
+   inline int wait_read_write(socket_t rd, socket_t wr, int timeout_ms,
+                              bool& readable, bool& writable) {
+       fd_set readfds, writefds, exceptfds;
+       FD_ZERO(&readfds);
+       FD_ZERO(&writefds);
+       FD_ZERO(&exceptfds);
+       FD_SET(rd, &readfds);
+       if (wr != INVALID_SOCK) {
+           FD_SET(wr, &writefds);
+           FD_SET(wr, &exceptfds);  // failed connects are reported here
+       }
+       timeval tv{timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+       int rc = ::select(0, &readfds, &writefds, &exceptfds, &tv);
+       readable = rc > 0 && FD_ISSET(rd, &readfds);
+       writable = rc > 0 && wr != INVALID_SOCK &&
+                  (FD_ISSET(wr, &writefds) || FD_ISSET(wr, &exceptfds));
+       return rc;
+   }
+   inline bool connect_in_progress(int err) { return err == WSAEWOULDBLOCK; }
+#else
+#  include <arpa/inet.h>
+#  include <cerrno>
+#  include <fcntl.h>
+#  include <net/if.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <sys/ioctl.h>
+#  include <sys/socket.h>
+#  include <sys/types.h>
+#  include <unistd.h>
+#  include <ifaddrs.h>
+#  include <netdb.h>
+#  include <netpacket/packet.h>
+#  include <poll.h>
+#  include <sys/uio.h>
+   using socket_t = int;
+   constexpr socket_t INVALID_SOCK = -1;
+   inline int close_socket(socket_t s) { return ::close(s); }
+   inline int set_socket_nonblocking(socket_t s) {
+       int flags = fcntl(s, F_GETFL, 0);
+       return fcntl(s, F_SETFL, flags | O_NONBLOCK);
+   }
+   inline int get_last_socket_error() { return errno; }
+   inline bool would_block(int err) { return err == EAGAIN || err == EWOULDBLOCK; }
+   /// Block until @p s is readable or @p timeout_ms elapses.
+   /// Returns > 0 when readable, 0 on timeout or signal, < 0 on error.
+   inline int wait_readable(socket_t s, int timeout_ms) {
+       pollfd pfd{s, POLLIN, 0};
+       int rc = ::poll(&pfd, 1, timeout_ms);
+       return (rc < 0 && errno == EINTR) ? 0 : rc;
+   }
+   /// Like wait_readable(), additionally watching @p wr (if valid) for
+   /// completion of a non-blocking connect().
+   inline int wait_read_write(socket_t rd, socket_t wr, int timeout_ms,
+                              bool& readable, bool& writable) {
+       pollfd pfds[2]{{rd, POLLIN, 0}, {wr, POLLOUT, 0}};
+       int rc = ::poll(pfds, wr != INVALID_SOCK ? 2 : 1, timeout_ms);
+       if (rc < 0 && errno == EINTR) rc = 0;
+       readable = rc > 0 && (pfds[0].revents & POLLIN) != 0;
+       writable = rc > 0 && wr != INVALID_SOCK &&
+                  (pfds[1].revents & (POLLOUT | POLLERR | POLLHUP)) != 0;
+       return rc;
+   }
+   inline bool connect_in_progress(int err) { return err == EINPROGRESS; }
+#endif
+
+#ifdef _WIN32
+/// RAII wrapper for Winsock initialization.
+struct WinsockInit {
+    bool ok = false;
+    WinsockInit() {
+        WSADATA wsa;
+        ok = (WSAStartup(MAKEWORD(2, 2), &wsa) == 0);
+    }
+    ~WinsockInit() { if (ok) WSACleanup(); }
+    WinsockInit(const WinsockInit&) = delete;
+    WinsockInit& operator=(const WinsockInit&) = delete;
+};
+#endif
+
+#endif // WAVESHARE_SOCKET_COMPAT_HPP
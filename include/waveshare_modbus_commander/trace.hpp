@@ -0,0 +1,82 @@
+#ifndef WAVESHARE_TRACE_HPP
+#define WAVESHARE_TRACE_HPP
+
+#include <chrono>
+#include <string>
+
+// Instrumentation points are compiled in unless WAVESHARE_NO_TRACE is
+// defined (CMake option WAVESHARE_TRACING=OFF); then the macros below
+// expand to nothing and their arguments are not evaluated.
+#ifndef WAVESHARE_NO_TRACE
+#  define WAVESHARE_HAVE_TRACE 1
+#else
+#  define WAVESHARE_HAVE_TRACE 0
+#endif
+
+namespace waveshare {
+
+namespace detail {
+extern bool tracing_enabled;
+}
+
+/// Whether --trace is recording.
+inline bool tracing_enabled() { return detail::tracing_enabled; }
+
+/// Start recording to @p path (--trace): truncate it and start a trace in
+/// the Chrome trace-event JSON array format, which Perfetto and
+/// chrome://tracing read.  Events are buffered and appended by
+/// flush_trace(), so forked processes can add theirs to the same file.
+/// @return false (with @p error set) if the file cannot be written.
+bool start_trace(const std::string& path, std::string& error);
+
+/// Append the events recorded so far to the trace file.
+void flush_trace();
+
+/// In a process forked while tracing: drop the parent's unflushed events
+/// and label this process @p name in the trace.
+void trace_forked(const std::string& name);
+
+/// Record an instant event, e.g. a packet sent or a device reappearing.
+void trace_instant(const char* name, const std::string& detail = {});
+
+/// Records a span from construction to destruction; spans nest.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, std::string detail = {})
+    {
+        if (tracing_enabled()) {
+            name_ = name;
+            detail_ = std::move(detail);
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_ = nullptr;
+    std::string detail_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace waveshare
+
+#if WAVESHARE_HAVE_TRACE
+#  define WAVESHARE_TRACE_CONCAT_(a, b) a##b
+#  define WAVESHARE_TRACE_CONCAT(a, b) WAVESHARE_TRACE_CONCAT_(a, b)
+/// Trace the rest of the enclosing scope: WAVESHARE_TRACE_SPAN("scan")
+/// or WAVESHARE_TRACE_SPAN("connect", ip).
+#  define WAVESHARE_TRACE_SPAN(...) \
+       ::waveshare::TraceSpan WAVESHARE_TRACE_CONCAT(trace_span_, __LINE__)(__VA_ARGS__)
+/// Trace an instant event; the detail is only built while tracing.
+#  define WAVESHARE_TRACE_INSTANT(...) \
+       do { if (::waveshare::tracing_enabled()) ::waveshare::trace_instant(__VA_ARGS__); } while (0)
+#else
+#  define WAVESHARE_TRACE_SPAN(...) static_cast<void>(0)
+#  define WAVESHARE_TRACE_INSTANT(...) static_cast<void>(0)
+#endif
+
+#endif // WAVESHARE_TRACE_HPP
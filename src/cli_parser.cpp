@@ -2,6 +2,7 @@
 #include "CLI/CLI.hpp"
 
 #include <algorithm>
+#include <cctype>
 #include <cstring>
 #include <format>
 #include <limits>
@@ -9,49 +10,56 @@
 
 namespace waveshare
 {
-    namespace
+    std::string action_to_string(CommandLineAction action)
     {
-        std::string action_to_string(CommandLineAction action)
+        switch (action)
         {
-            switch (action)
-            {
-            case CommandLineAction::NONE:
-                return "NONE";
-            case CommandLineAction::READ_COIL:
-                return "READ_COIL";
-            case CommandLineAction::READ_COILS:
-                return "READ_COILS";
-            case CommandLineAction::WRITE_COIL:
-                return "WRITE_COIL";
-            case CommandLineAction::WRITE_COILS:
-                return "WRITE_COILS";
-            case CommandLineAction::READ_REGISTER:
-                return "READ_REGISTER";
-            case CommandLineAction::READ_REGISTERS:
-                return "READ_REGISTERS";
-            case CommandLineAction::WRITE_REGISTER:
-                return "WRITE_REGISTER";
-            case CommandLineAction::WRITE_REGISTERS:
-                return "WRITE_REGISTERS";
-            case CommandLineAction::ITERATE_RELAY_SWITCHES:
-                return "ITERATE_RELAY_SWITCHES";
-            case CommandLineAction::READ_DIGITAL_INPUTS:
-                return "READ_DIGITAL_INPUTS";
-            case CommandLineAction::SCAN_NETWORK:
-                return "SCAN_NETWORK";
-            case CommandLineAction::SET_STATIC_IP:
-                return "SET_STATIC_IP";
-            case CommandLineAction::SET_DHCP:
-                return "SET_DHCP";
-            case CommandLineAction::SET_MODBUS_TCP:
-                return "SET_MODBUS_TCP";
-            case CommandLineAction::SET_MODBUS_TCP_PORT:
-                return "SET_MODBUS_TCP_PORT";
-            case CommandLineAction::SET_NAME:
-                return "SET_NAME";
-            }
-            return "UNKNOWN";
+        case CommandLineAction::NONE:
+            return "NONE";
+        case CommandLineAction::READ_COIL:
+            return "READ_COIL";
+        case CommandLineAction::READ_COILS:
+            return "READ_COILS";
+        case CommandLineAction::WRITE_COIL:
+            return "WRITE_COIL";
+        case CommandLineAction::WRITE_COILS:
+            return "WRITE_COILS";
+        case CommandLineAction::READ_REGISTER:
+            return "READ_REGISTER";
+        case CommandLineAction::READ_REGISTERS:
+            return "READ_REGISTERS";
+        case CommandLineAction::WRITE_REGISTER:
+            return "WRITE_REGISTER";
+        case CommandLineAction::WRITE_REGISTERS:
+            return "WRITE_REGISTERS";
+        case CommandLineAction::ITERATE_RELAY_SWITCHES:
+            return "ITERATE_RELAY_SWITCHES";
+        case CommandLineAction::READ_DIGITAL_INPUTS:
+            return "READ_DIGITAL_INPUTS";
+        case CommandLineAction::SCAN_NETWORK:
+            return "SCAN_NETWORK";
+        case CommandLineAction::SET_STATIC_IP:
+            return "SET_STATIC_IP";
+        case CommandLineAction::SET_DHCP:
+            return "SET_DHCP";
+        case CommandLineAction::SET_MODBUS_TCP:
+            return "SET_MODBUS_TCP";
+        case CommandLineAction::SET_MODBUS_TCP_PORT:
+            return "SET_MODBUS_TCP_PORT";
+        case CommandLineAction::SET_NAME:
+            return "SET_NAME";
+        case CommandLineAction::PROVISION:
+            return "PROVISION";
+        case CommandLineAction::SET_RELAYS:
+            return "SET_RELAYS";
+        case CommandLineAction::WATCH_DIGITAL_INPUTS:
+            return "WATCH_DIGITAL_INPUTS";
+        case CommandLineAction::INTERLOCK:
+            return "INTERLOCK";
+        case CommandLineAction::SEQUENCE:
+            return "SEQUENCE";
         }
+        return "UNKNOWN";
     }
 
     CommandLineOptions parse_command_line(int argc, char *argv[])
@@ -63,9 +71,9 @@ namespace waveshare
         app.set_help_flag("-h,--help", "Show all available options");
         app.set_version_flag("-V,--version", PROJECT_VERSION, "Show program version");
 
-        app.add_option("-i,--ip", options.ip_address, "IP address of the Modbus device")
-            ->default_val("192.168.1.2")
-            ->each([&options](const std::string&) { options.ip_explicitly_set = true; });
+        app.add_option("-i,--ip", options.target_ips,
+                       "IP address of the Modbus device (default: 192.168.1.2);\n"
+                       "repeat to run the actions on several devices");
         app.add_option("-p,--port", options.port, "Modbus TCP port")
             ->default_val(502);
         app.add_option("-t,--timeout", options.timeout_seconds, "Connection timeout in seconds")
@@ -87,6 +95,10 @@ namespace waveshare
                                       "Write multiple coil address/state pairs (address1 state1 [address2 state2 ...])")
                           ->expected(2, -1);
 
+        auto set_relays_option = app.add_option("--set-relays", options.set_relays_args,
+                                                "Set all 8 relays to a pattern: 0b10110001 (rightmost = relay 1), 0xB1,\n"
+                                                "1,5,6,8, none or all; only changes are written (one FC15)");
+
         // Register operations
         auto read_register_option = app.add_option("--read-register", "Read single holding register (address)")
                                         ->expected(1);
@@ -106,24 +118,81 @@ namespace waveshare
                               { options.actions.push_back(CommandLineAction::READ_DIGITAL_INPUTS); },
                               "Read all 8 digital inputs (DI1-DI8) and display their state");
 
+        app.add_flag_callback("--watch-digital-inputs", [&options]()
+                              { options.actions.push_back(CommandLineAction::WATCH_DIGITAL_INPUTS); },
+                              "Poll the digital inputs at --rate and print every change with a\n"
+                              "timestamp; on Ctrl-C print poll statistics and a latency histogram");
+
+        auto sequence_option = app.add_option("--sequence", options.sequence_file,
+                                              "Play a relay timeline file (lines of '<offset> <relay pattern>', an\n"
+                                              "optional final '<offset> loop' repeats it) on exact deadlines;\n"
+                                              "Ctrl-C turns all relays off")
+                                   ->check(CLI::ExistingFile);
+
+        auto interlock_option = app.add_option("--interlock", options.interlock_args,
+                                               "Poll the digital inputs at --rate and switch relays when a rule's\n"
+                                               "condition becomes true, e.g. \"DI3 -> RELAY5\" \"!DI1 -> ALL_OFF\"\n"
+                                               "(actions: RELAYn, !RELAYn, ALL_ON, ALL_OFF); runs until Ctrl-C")
+                                    ->expected(1, -1);
+
+        app.add_option("--rate", options.watch_rate,
+                       "Poll rate of --watch-digital-inputs and --interlock: 200Hz, 1kHz, or a\n"
+                       "period such as 5ms (default: 100Hz)")
+            ->default_val("100Hz");
+
         app.add_flag_callback("--scan-network", [&options]()
                               { options.actions.push_back(CommandLineAction::SCAN_NETWORK); },
                               "Scan the local network for Waveshare serial server devices via UDP broadcast");
 
         app.add_option("--scan-timeout", options.scan_timeout_ms,
-                       "Timeout in milliseconds for network scan (default: 3000)")
+                       "Milliseconds to wait for responses after the last probe; a paced\n"
+                       "--extra-subnet sweep takes this long on top (default: 3000)")
             ->default_val(3000);
 
         app.add_option("--extra-subnet", options.extra_subnets,
-                       "Additional /24 subnet(s) to sweep with unicast probes\n"
-                       "(e.g. --extra-subnet 192.168.1.0 --extra-subnet 10.0.0.0)")
+                       "Additional subnet(s) to sweep with unicast probes, in CIDR notation\n"
+                       "(/16 to /32; a bare address means its /24)\n"
+                       "(e.g. --extra-subnet 192.168.1.0 --extra-subnet 10.20.0.0/20)")
             ->expected(0, -1);
 
-        app.add_option("--mac", options.target_mac,
-                       "Target device MAC address (e.g. 28:80:ca:ea:41:f3)");
+        app.add_flag("--adaptive-scan", options.adaptive_scan,
+                     "End scans once no new device has answered for a quiet period\n"
+                     "derived from the observed round-trip times (never waits longer than --scan-timeout)");
+
+        app.add_option("--probe-rate", options.probe_rate,
+                       "Maximum sweep probes per second for --extra-subnet (default: 0 = unpaced)")
+            ->default_val(0);
 
-        app.add_option("--name", options.target_name,
-                       "Target device name (e.g. \"Hero 1\") — resolved via network scan");
+        app.add_flag_callback("--no-cache", [&options]()
+                              { options.use_cache = false; },
+                              "Do not use or update the discovery cache; always run a full scan");
+
+        app.add_flag("--daemon", options.daemon,
+                     "Serve commands from --via-daemon clients, keeping Modbus connections open\n"
+                     "between commands (POSIX only)");
+        app.add_flag("--via-daemon", options.via_daemon,
+                     "Have a running --daemon execute this command");
+        app.add_option("--daemon-socket", options.daemon_socket,
+                       "Control socket of --daemon / --via-daemon\n"
+                       "(default: $XDG_RUNTIME_DIR/waveshare-commander.sock)");
+
+        app.add_option("--cache-ttl", options.cache_ttl_seconds,
+                       "Maximum age in seconds of cached device addresses (default: 86400)")
+            ->default_val(86400);
+
+        app.add_option("--mac", options.target_macs,
+                       "Target device MAC address (e.g. 28:80:ca:ea:41:f3); repeatable");
+
+        app.add_option("--name", options.target_names,
+                       "Target device name (e.g. \"Hero 1\") — resolved via network scan; repeatable");
+
+        app.add_flag("--all-discovered", options.all_discovered,
+                     "Run the actions on every device the network scan finds");
+
+        app.add_option("--parallel", options.parallel,
+                       "Devices served at the same time with several targets (default: 32)")
+            ->default_val(32)
+            ->check(CLI::PositiveNumber);
 
         std::vector<std::string> set_ip_args;
         auto set_ip_option = app.add_option("--set-ip", set_ip_args,
@@ -134,10 +203,40 @@ namespace waveshare
                               { options.actions.push_back(CommandLineAction::SET_DHCP); },
                               "Set a device to DHCP mode (use --mac to identify the target device)");
 
+        app.add_option("--coalesce-gap", options.coalesce_gap,
+                       "Merge --read-coil/--read-register addresses into range reads when at most\n"
+                       "this many unrequested addresses lie between them; not with --pipeline\n"
+                       "(default: 8)")
+            ->default_val(8)
+            ->check(CLI::NonNegativeNumber);
+
+        app.add_option("--pipeline", options.pipeline_depth,
+                       "Keep up to N Modbus requests in flight on one connection, so consecutive\n"
+                       "coil/register/input operations cost about one round trip; devices that\n"
+                       "cannot handle this are detected and served serially (default: 0 = off)")
+            ->default_val(0)
+            ->check(CLI::NonNegativeNumber);
+
+        app.add_option("--trace", options.trace_file,
+                       "Record the phases of the command (scans, DNS lookups, connects, actions,\n"
+                       "reboot waits) with packet events to a Chrome trace-event JSON file\n"
+                       "for Perfetto or chrome://tracing");
+
+        app.add_flag("--stats", options.stats,
+                     "At exit, print latency percentiles and error counts per operation\n"
+                     "(connect, each Modbus function code, scan, SET_CONFIG, reboot wait)");
+
         app.add_option("--wait-timeout", options.wait_timeout_ms,
                        "How long to wait (ms) for device to reappear after a configuration change (default: 30000)")
             ->default_val(30000);
 
+        app.add_flag("--wait-modbus", options.wait_modbus,
+                     "After a configuration change, wait until the device also accepts\n"
+                     "Modbus TCP connections, not only VirCom searches");
+
+        app.add_flag("--dry-run", options.dry_run,
+                     "Show the byte-level configuration diff without sending it");
+
         app.add_flag_callback("--set-modbus-tcp", [&options]()
                               { options.actions.push_back(CommandLineAction::SET_MODBUS_TCP); },
                               "Set a device to Modbus TCP protocol (TCP Server, use --mac to identify the target)");
@@ -152,6 +251,10 @@ namespace waveshare
         auto set_name_option = app.add_option("--set-name", options.set_name,
                                               "Set the device name (max 9 ASCII characters, use --mac to identify the target)");
 
+        auto provision_option = app.add_option("--provision", options.provision_manifest,
+                                               "Configure all devices listed in a manifest (.json or .csv) in parallel")
+                                    ->check(CLI::ExistingFile);
+
         try
         {
             app.parse(argc, argv);
@@ -162,6 +265,18 @@ namespace waveshare
             exit(e.get_exit_code());
         }
 
+        // The scanner reports MACs in lower case; match them that way.
+        for (auto& mac : options.target_macs) {
+            std::transform(mac.begin(), mac.end(), mac.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        }
+
+        // The first target also serves the single-device code paths.
+        options.ip_explicitly_set = !options.target_ips.empty();
+        options.ip_address = options.ip_explicitly_set ? options.target_ips.front() : "192.168.1.2";
+        if (!options.target_macs.empty())  options.target_mac  = options.target_macs.front();
+        if (!options.target_names.empty()) options.target_name = options.target_names.front();
+
         // Process coil operations (post-parse value extraction)
         if (read_coil_option->count() > 0)
         {
@@ -257,9 +372,26 @@ namespace waveshare
         if (set_port_option->count() > 0)
             options.actions.push_back(CommandLineAction::SET_MODBUS_TCP_PORT);
 
+        // Process --set-relays
+        if (set_relays_option->count() > 0)
+            options.actions.push_back(CommandLineAction::SET_RELAYS);
+
+        // Process --sequence
+        if (sequence_option->count() > 0)
+            options.actions.push_back(CommandLineAction::SEQUENCE);
+
+        // Process --interlock
+        if (interlock_option->count() > 0)
+            options.actions.push_back(CommandLineAction::INTERLOCK);
+
+        // Process --provision
+        if (provision_option->count() > 0)
+            options.actions.push_back(CommandLineAction::PROVISION);
+
         // ── Sort actions to match command-line order ─────────────────
         // Flag callbacks (--set-modbus-tcp, --set-dhcp, --scan-network,
-        // --iterate-relais-switches, --read-digital-inputs) push their
+        // --iterate-relais-switches, --read-digital-inputs,
+        // --watch-digital-inputs) push their
         // action during app.parse(), while valued options (--set-ip,
         // --set-name, --set-modbus-tcp-port, coil/register ops) push
         // theirs post-parse.  This can cause misordering when chaining
@@ -281,6 +413,11 @@ namespace waveshare
             {CommandLineAction::SET_MODBUS_TCP,         "--set-modbus-tcp"},
             {CommandLineAction::SET_MODBUS_TCP_PORT,    "--set-modbus-tcp-port"},
             {CommandLineAction::SET_NAME,               "--set-name"},
+            {CommandLineAction::PROVISION,              "--provision"},
+            {CommandLineAction::SET_RELAYS,             "--set-relays"},
+            {CommandLineAction::WATCH_DIGITAL_INPUTS,   "--watch-digital-inputs"},
+            {CommandLineAction::INTERLOCK,              "--interlock"},
+            {CommandLineAction::SEQUENCE,               "--sequence"},
         };
 
         auto argv_position = [&](CommandLineAction action) -> int {
@@ -320,6 +457,20 @@ namespace waveshare
             }
         }
 
+        output += std::format("coalesce_gap: {}\n", options.coalesce_gap);
+        output += std::format("pipeline_depth: {}\n", options.pipeline_depth);
+        output += std::format("watch_rate: {}\n", options.watch_rate);
+        output += std::format("probe_rate: {}\n", options.probe_rate);
+        output += std::format("adaptive_scan: {}\n", options.adaptive_scan);
+        output += std::format("wait_modbus: {}\n", options.wait_modbus);
+        output += std::format("dry_run: {}\n", options.dry_run);
+        output += std::format("stats: {}\n", options.stats);
+        output += std::format("trace_file: {}\n", options.trace_file);
+        output += std::format("all_discovered: {}\n", options.all_discovered);
+        output += std::format("parallel: {}\n", options.parallel);
+        output += std::format("daemon: {}\n", options.daemon);
+        output += std::format("via_daemon: {}\n", options.via_daemon);
+
         if (!options.extra_subnets.empty()) {
             output += "extra_subnets:\n";
             for (const auto& s : options.extra_subnets) {
@@ -327,6 +478,16 @@ namespace waveshare
             }
         }
 
+        if (!options.sequence_file.empty())
+            output += std::format("sequence_file: {}\n", options.sequence_file);
+
+        if (!options.interlock_args.empty()) {
+            output += "interlock:\n";
+            for (const auto& rule : options.interlock_args) {
+                output += std::format("  - {}\n", rule);
+            }
+        }
+
         return output;
     }
 
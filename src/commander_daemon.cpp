@@ -0,0 +1,439 @@
+#include "waveshare_modbus_commander/commander_daemon.hpp"
+#include "waveshare_modbus_commander/modbus_connection_pool.hpp"
+#include "waveshare_modbus_commander/portable_print.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#  include <cerrno>
+#  include <csignal>
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <sys/stat.h>
+#  include <sys/un.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+namespace waveshare {
+
+#ifdef _WIN32
+
+std::string default_daemon_socket_path()
+{
+    return {};
+}
+
+int run_daemon(const std::string&, const CommandRunner&, bool)
+{
+    portable::println(stderr, "--daemon is not supported on Windows.");
+    return EXIT_FAILURE;
+}
+
+int run_via_daemon(const std::string&, int, char*[])
+{
+    portable::println(stderr, "--via-daemon is not supported on Windows.");
+    return EXIT_FAILURE;
+}
+
+#else
+
+namespace {
+
+// Wire format, client -> daemon: a uint32_t payload length followed by
+// the payload "cwd\0argv[0]\0argv[1]\0...", with the client's stdout and
+// stderr attached as SCM_RIGHTS.  While the command runs the client may
+// send single bytes, each one a forwarded Ctrl-C.  Daemon -> client: the
+// exit code as int32_t.
+
+constexpr size_t MAX_REQUEST_SIZE = 1 << 20;
+constexpr int FORWARDED_FDS = 2;            ///< stdout, stderr
+constexpr int REOPEN_TIMEOUT_SECONDS = 3;   ///< Commands set their own -t on use
+
+volatile std::sig_atomic_t g_signal = 0;
+
+void record_signal(int signum)
+{
+    g_signal = signum;
+}
+
+/// Install @p handler for SIGINT and SIGTERM without SA_RESTART, so that
+/// blocking calls return EINTR.
+void install_interrupt_handlers(void (*handler)(int))
+{
+    struct sigaction sa{};
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+}
+
+bool make_address(const std::string& path, sockaddr_un& addr)
+{
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool send_all(int fd, const void* data, size_t size)
+{
+    auto p = static_cast<const char*>(data);
+    while (size > 0) {
+        auto n = ::send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool recv_all(int fd, void* data, size_t size)
+{
+    auto p = static_cast<char*>(data);
+    while (size > 0) {
+        auto n = ::recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/// A command received from a client.
+struct Request {
+    std::string cwd;
+    std::vector<std::string> args;
+    int out = -1;
+    int err = -1;
+};
+
+/// Read one request from @p client.  @return false on a malformed request.
+bool receive_request(int client, Request& request)
+{
+    uint32_t length = 0;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * FORWARDED_FDS)]{};
+    iovec iov{&length, sizeof(length)};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    auto n = ::recvmsg(client, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0) return false;
+
+    for (auto* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int fds[FORWARDED_FDS]{-1, -1};
+        std::memcpy(fds, CMSG_DATA(c), sizeof(int) * std::min<size_t>(count, FORWARDED_FDS));
+        request.out = fds[0];
+        request.err = fds[1];
+    }
+    if (request.out < 0 || request.err < 0) return false;
+
+    if (static_cast<size_t>(n) < sizeof(length) &&
+        !recv_all(client, reinterpret_cast<char*>(&length) + n, sizeof(length) - static_cast<size_t>(n)))
+        return false;
+    if (length == 0 || length > MAX_REQUEST_SIZE) return false;
+
+    std::string payload(length, '\0');
+    if (!recv_all(client, payload.data(), payload.size())) return false;
+
+    size_t pos = 0;
+    while (pos < payload.size()) {
+        auto end = payload.find('\0', pos);
+        if (end == std::string::npos) end = payload.size();
+        if (pos == 0) request.cwd = payload.substr(0, end);
+        else request.args.push_back(payload.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return !request.args.empty();
+}
+
+/// Body of the forked child: run the command with the client's output.
+[[noreturn]] void run_child(const Request& request, const CommandRunner& run, int report_fd)
+{
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    dup2(request.out, STDOUT_FILENO);
+    dup2(request.err, STDERR_FILENO);
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    int rc = EXIT_FAILURE;
+    if (chdir(request.cwd.c_str()) != 0) {
+        portable::println(stderr, "Cannot change to directory {}: {}", request.cwd, std::strerror(errno));
+    } else {
+        auto& pool = modbus_connection_pool();
+        auto before = pool.snapshot();
+
+        std::vector<std::string> args = request.args;
+        std::vector<char*> argv;
+        for (auto& a : args) argv.push_back(a.data());
+        argv.push_back(nullptr);
+        try {
+            rc = run(static_cast<int>(args.size()), argv.data());
+        }
+        catch (const std::exception& e) {
+            portable::println(stderr, "Error: {}", e.what());
+        }
+
+        // Tell the daemon which connections to open (or reopen) for the
+        // next command.
+        std::string report;
+        for (const auto& key : pool.changed_since(before)) report += key + '\n';
+        if (!report.empty()) (void)!::write(report_fd, report.data(), report.size());
+    }
+    std::fflush(stdout);
+    std::fflush(stderr);
+    _exit(rc);
+}
+
+/// Execute one request and send its exit code to @p client.
+void serve(int client, const CommandRunner& run, bool debug)
+{
+    Request request;
+    if (!receive_request(client, request)) {
+        if (request.out >= 0) close(request.out);
+        if (request.err >= 0) close(request.err);
+        if (debug) portable::println("Ignoring malformed request");
+        return;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    auto& pool = modbus_connection_pool();
+    pool.prune();
+
+    // The child's end of this pipe closes when it exits; until then it
+    // carries the report of new connections.
+    int report[2];
+    if (pipe(report) != 0) {
+        close(request.out);
+        close(request.err);
+        return;
+    }
+
+    std::fflush(stdout);
+    std::fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(report[0]);
+        close(client);
+        run_child(request, run, report[1]);
+    }
+    close(request.out);
+    close(request.err);
+    close(report[1]);
+    if (pid < 0) {
+        close(report[0]);
+        portable::println(stderr, "fork failed: {}", std::strerror(errno));
+        int32_t rc = EXIT_FAILURE;
+        send_all(client, &rc, sizeof(rc));
+        return;
+    }
+
+    std::string report_text;
+    pollfd fds[2]{{client, POLLIN, 0}, {report[0], POLLIN, 0}};
+    for (;;) {
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                if (g_signal) kill(pid, SIGINT);   // daemon is shutting down
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents) {
+            char c;
+            auto n = ::recv(client, &c, 1, 0);
+            kill(pid, SIGINT);                      // Ctrl-C, or the client went away
+            if (n <= 0) fds[0].fd = -1;
+        }
+        if (fds[1].revents) {
+            char buf[256];
+            auto n = ::read(report[0], buf, sizeof(buf));
+            if (n > 0) { report_text.append(buf, static_cast<size_t>(n)); continue; }
+            if (n < 0 && errno == EINTR) continue;
+            break;                                  // child exited
+        }
+    }
+    close(report[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    int32_t rc = WIFEXITED(status) ? WEXITSTATUS(status)
+               : WIFSIGNALED(status) ? 128 + WTERMSIG(status) : EXIT_FAILURE;
+    send_all(client, &rc, sizeof(rc));
+
+    // Warm up what the command had to connect to itself.
+    size_t pos = 0;
+    while (pos < report_text.size()) {
+        auto end = report_text.find('\n', pos);
+        if (end == std::string::npos) break;
+        auto key = report_text.substr(pos, end - pos);
+        pool.close(key);
+        if (!pool.open(key, REOPEN_TIMEOUT_SECONDS) && debug)
+            portable::println("Could not open connection to {}", key);
+        pos = end + 1;
+    }
+
+    if (debug) {
+        std::string command;
+        for (size_t i = 1; i < request.args.size(); ++i) command += ' ' + request.args[i];
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started);
+        portable::println("[{}]{} -> exit {} ({} ms, {} warm connection(s))",
+                          pid, command, rc, elapsed.count(), pool.size());
+    }
+}
+
+} // anonymous namespace
+
+std::string default_daemon_socket_path()
+{
+    if (const char* runtime = std::getenv("XDG_RUNTIME_DIR"); runtime && *runtime)
+        return std::format("{}/waveshare-commander.sock", runtime);
+    return std::format("/tmp/waveshare-commander-{}.sock", getuid());
+}
+
+int run_daemon(const std::string& socket_path, const CommandRunner& run, bool debug)
+{
+    sockaddr_un addr;
+    if (!make_address(socket_path, addr)) {
+        portable::println(stderr, "Invalid daemon socket path '{}'.", socket_path);
+        return EXIT_FAILURE;
+    }
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        portable::println(stderr, "socket() failed: {}", std::strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // A socket file nobody listens on is left over from a daemon that
+    // did not shut down cleanly.
+    if (::connect(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0) {
+        close(listener);
+        portable::println(stderr, "A daemon is already listening on {}.", socket_path);
+        return EXIT_FAILURE;
+    }
+    close(listener);
+    unlink(socket_path.c_str());
+
+    listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t old_mask = umask(0077);              // owner only
+    int rc = ::bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    umask(old_mask);
+    if (rc != 0 || ::listen(listener, 16) != 0) {
+        portable::println(stderr, "Cannot listen on {}: {}", socket_path, std::strerror(errno));
+        close(listener);
+        return EXIT_FAILURE;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    install_interrupt_handlers(record_signal);
+    portable::println("Daemon listening on {} (Ctrl-C to stop)", socket_path);
+
+    while (!g_signal) {
+        int client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            portable::println(stderr, "accept() failed: {}", std::strerror(errno));
+            break;
+        }
+        serve(client, run, debug);
+        close(client);
+    }
+
+    close(listener);
+    unlink(socket_path.c_str());
+    portable::println("Daemon stopped.");
+    return EXIT_SUCCESS;
+}
+
+int run_via_daemon(const std::string& socket_path, int argc, char* argv[])
+{
+    sockaddr_un addr;
+    if (!make_address(socket_path, addr)) {
+        portable::println(stderr, "Invalid daemon socket path '{}'.", socket_path);
+        return EXIT_FAILURE;
+    }
+    int sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0 || ::connect(sock, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        portable::println(stderr, "Cannot reach the daemon at {}: {}", socket_path, std::strerror(errno));
+        if (sock >= 0) close(sock);
+        return EXIT_FAILURE;
+    }
+
+    std::string payload;
+    if (char* cwd = getcwd(nullptr, 0)) {
+        payload = cwd;
+        std::free(cwd);
+    }
+    for (int i = 0; i < argc; ++i) {
+        payload += '\0';
+        payload += argv[i];
+    }
+    uint32_t length = static_cast<uint32_t>(payload.size());
+
+    // The length travels with the descriptors; the payload follows.
+    int fds[FORWARDED_FDS]{STDOUT_FILENO, STDERR_FILENO};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+    iovec iov{&length, sizeof(length)};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    auto* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    std::fflush(stdout);
+    if (::sendmsg(sock, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(length)) ||
+        !send_all(sock, payload.data(), payload.size())) {
+        portable::println(stderr, "Cannot send the command to the daemon: {}", std::strerror(errno));
+        close(sock);
+        return EXIT_FAILURE;
+    }
+
+    // Wait for the exit code, forwarding Ctrl-C.
+    install_interrupt_handlers(record_signal);
+    int32_t rc = 0;
+    size_t received = 0;
+    while (received < sizeof(rc)) {
+        auto n = ::recv(sock, reinterpret_cast<char*>(&rc) + received, sizeof(rc) - received, 0);
+        if (n > 0) { received += static_cast<size_t>(n); continue; }
+        if (n < 0 && errno == EINTR) {
+            if (g_signal) {
+                g_signal = 0;
+                char interrupt = 'I';
+                send_all(sock, &interrupt, 1);
+            }
+            continue;
+        }
+        portable::println(stderr, "The daemon closed the connection.");
+        close(sock);
+        return EXIT_FAILURE;
+    }
+    close(sock);
+    return rc;
+}
+
+#endif
+
+} // namespace waveshare
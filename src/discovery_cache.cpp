@@ -0,0 +1,223 @@
+#include "waveshare_modbus_commander/discovery_cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <system_error>
+
+namespace waveshare {
+
+namespace {
+
+constexpr const char* CACHE_HEADER = "# waveshare-commander discovery cache v1";
+
+int64_t unix_now()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string to_hex(const std::array<uint8_t, VIRCOM_PACKET_SIZE>& bytes)
+{
+    std::string out;
+    out.reserve(bytes.size() * 2);
+    for (auto b : bytes) {
+        out += std::format("{:02x}", b);
+    }
+    return out;
+}
+
+bool from_hex(const std::string& hex, std::array<uint8_t, VIRCOM_PACKET_SIZE>& bytes)
+{
+    if (hex.size() != bytes.size() * 2) return false;
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        int hi = nibble(hex[2 * i]);
+        int lo = nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        bytes[i] = static_cast<uint8_t>((hi << 4) | lo);
+    }
+    return true;
+}
+
+/// Split @p line on tab characters.
+std::vector<std::string> split_tabs(const std::string& line)
+{
+    std::vector<std::string> fields;
+    std::string field;
+    std::istringstream iss(line);
+    while (std::getline(iss, field, '\t')) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+} // anonymous namespace
+
+std::string DiscoveryCache::default_path()
+{
+    std::filesystem::path dir;
+#ifdef _WIN32
+    if (const char* local = std::getenv("LOCALAPPDATA"); local && *local)
+        dir = local;
+#else
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+        dir = xdg;
+    else if (const char* home = std::getenv("HOME"); home && *home)
+        dir = std::filesystem::path(home) / ".cache";
+#endif
+    if (dir.empty()) return {};
+    return (dir / "waveshare-commander" / "devices.cache").string();
+}
+
+DiscoveryCache::DiscoveryCache(std::string path)
+    : path_(std::move(path))
+{
+}
+
+void DiscoveryCache::load()
+{
+    entries_.clear();
+    if (path_.empty()) return;
+
+    std::ifstream in(path_);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        auto fields = split_tabs(line);
+        if (fields.size() != 6) continue;
+
+        Entry entry;
+        std::array<uint8_t, VIRCOM_PACKET_SIZE> raw{};
+        if (!from_hex(fields[5], raw)) continue;
+        if (!parse_vircom_response(raw.data(), raw.size(), entry.device)) continue;
+
+        try {
+            entry.seen_at = std::stoll(fields[0]);
+        } catch (const std::exception&) {
+            continue;
+        }
+        // The address the device answered from is canonical, as in
+        // scan_network(); the payload may lag behind after a change.
+        entry.device.ip_address = fields[2];
+        if (entry.device.mac_address != fields[1]) continue;
+
+        entries_.push_back(std::move(entry));
+    }
+}
+
+bool DiscoveryCache::save() const
+{
+    if (path_.empty()) return false;
+
+    std::filesystem::path path(path_);
+    std::error_code ec;
+    if (path.has_parent_path())
+        std::filesystem::create_directories(path.parent_path(), ec);
+
+    // A temporary file of its own per writer: fleet members and parallel
+    // invocations may save at the same time, and the last rename wins.
+    std::random_device random;
+    auto tmp = path;
+    tmp += std::format(".{:08x}{:08x}.tmp", random(), random());
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out) return false;
+        out << CACHE_HEADER << '\n';
+        for (const auto& e : entries_) {
+            out << std::format("{}\t{}\t{}\t{}\t{}\t{}\n",
+                               e.seen_at, e.device.mac_address, e.device.ip_address,
+                               e.device.port, e.device.device_name,
+                               to_hex(e.device.raw_response));
+        }
+        if (!out) {
+            out.close();
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::error_code ignored;
+        std::filesystem::remove(tmp, ignored);
+        return false;
+    }
+    return true;
+}
+
+void DiscoveryCache::update(const std::vector<DiscoveredDevice>& devices)
+{
+    auto now = unix_now();
+    for (const auto& d : devices) {
+        auto it = std::find_if(entries_.begin(), entries_.end(),
+                               [&](const Entry& e) { return e.device.mac_address == d.mac_address; });
+        if (it != entries_.end()) {
+            it->device  = d;
+            it->seen_at = now;
+        } else {
+            entries_.push_back({d, now});
+        }
+    }
+}
+
+std::vector<const DiscoveryCache::Entry*> DiscoveryCache::fresh_entries(int ttl_seconds) const
+{
+    auto now = unix_now();
+    std::vector<const Entry*> fresh;
+    for (const auto& e : entries_) {
+        if (now - e.seen_at <= ttl_seconds) fresh.push_back(&e);
+    }
+    return fresh;
+}
+
+std::optional<DiscoveredDevice> DiscoveryCache::find(const std::string& mac,
+                                                     const std::string& name,
+                                                     const std::string& ip,
+                                                     int ttl_seconds) const
+{
+    int id_count = (!mac.empty() ? 1 : 0) +
+                   (!name.empty() ? 1 : 0) +
+                   (!ip.empty() ? 1 : 0);
+    if (id_count != 1) return std::nullopt;
+
+    const Entry* found = nullptr;
+    int matches = 0;
+    for (const auto* e : fresh_entries(ttl_seconds)) {
+        const auto& d = e->device;
+        if ((!mac.empty()  && d.mac_address == mac) ||
+            (!name.empty() && d.device_name == name) ||
+            (!ip.empty()   && d.ip_address  == ip)) {
+            found = e;
+            ++matches;
+        }
+    }
+    if (matches != 1) return std::nullopt;
+    return found->device;
+}
+
+std::vector<std::string> DiscoveryCache::known_ips(int ttl_seconds) const
+{
+    auto fresh = fresh_entries(ttl_seconds);
+    std::sort(fresh.begin(), fresh.end(),
+              [](const Entry* a, const Entry* b) { return a->seen_at > b->seen_at; });
+
+    std::vector<std::string> ips;
+    for (const auto* e : fresh) {
+        if (std::find(ips.begin(), ips.end(), e->device.ip_address) == ips.end())
+            ips.push_back(e->device.ip_address);
+    }
+    return ips;
+}
+
+} // namespace waveshare
@@ -0,0 +1,237 @@
+#include "waveshare_modbus_commander/fleet_runner.hpp"
+#include "waveshare_modbus_commander/portable_print.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <format>
+
+#ifndef _WIN32
+#  include <cerrno>
+#  include <csignal>
+#  include <poll.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+namespace waveshare {
+
+namespace {
+
+int64_t ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+} // anonymous namespace
+
+#ifdef _WIN32
+
+std::vector<FleetResult> run_on_fleet(const std::vector<FleetTarget>& targets,
+                                      int /*parallel*/,
+                                      const std::function<int(const FleetTarget&)>& run)
+{
+    std::vector<FleetResult> results;
+    for (const auto& target : targets) {
+        FleetResult r;
+        r.target = target;
+        if (target.error.empty()) {
+            portable::println("=== {} ===", target.label);
+            auto start = std::chrono::steady_clock::now();
+            try { r.exit_code = run(target); }
+            catch (const std::exception& e) { portable::println(stderr, "Error: {}", e.what()); }
+            r.elapsed_ms = ms_since(start);
+            r.ran = true;
+        }
+        results.push_back(std::move(r));
+    }
+    return results;
+}
+
+#else
+
+namespace {
+
+volatile std::sig_atomic_t g_fleet_interrupted = 0;
+
+void note_interrupt(int)
+{
+    g_fleet_interrupted = 1;
+}
+
+/// A run in progress.
+struct Slot {
+    size_t index = 0;
+    pid_t pid = -1;
+    int fd = -1;                ///< Read end of the child's stdout/stderr
+    std::string partial;        ///< Output after the last newline
+    std::chrono::steady_clock::time_point start;
+};
+
+} // anonymous namespace
+
+std::vector<FleetResult> run_on_fleet(const std::vector<FleetTarget>& targets,
+                                      int parallel,
+                                      const std::function<int(const FleetTarget&)>& run)
+{
+    std::vector<FleetResult> results(targets.size());
+    size_t label_width = 0;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        results[i].target = targets[i];
+        if (targets[i].error.empty()) label_width = std::max(label_width, targets[i].label.size());
+    }
+
+    // Ctrl-C goes to the whole process group: the runs handle it
+    // themselves (e.g. relays off), and this process keeps relaying their
+    // output until they are done.
+    struct sigaction sa{}, old_int{};
+    sa.sa_handler = note_interrupt;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &old_int);
+
+    auto emit = [&](const Slot& slot, const std::string& line) {
+        portable::println("[{:<{}}] {}", targets[slot.index].label, label_width, line);
+    };
+
+    std::vector<Slot> active;
+    size_t next = 0;
+    auto spawn = [&](size_t index) {
+        // A run that cannot start shows its reason in the results table.
+        auto fail = [&](const char* what, int err) {
+            results[index].target.error = std::format("{} failed: {}", what, std::strerror(err));
+            portable::println(stderr, "[{}] {}", targets[index].label, results[index].target.error);
+        };
+        int fds[2];
+        if (pipe(fds) != 0) {
+            fail("pipe", errno);
+            return;
+        }
+        std::fflush(stdout);
+        std::fflush(stderr);
+        Slot slot;
+        slot.index = index;
+        slot.start = std::chrono::steady_clock::now();
+        slot.pid = fork();
+        int fork_errno = errno;
+        if (slot.pid == 0) {
+            sigaction(SIGINT, &old_int, nullptr);
+            close(fds[0]);
+            for (const auto& other : active) close(other.fd);
+            dup2(fds[1], STDOUT_FILENO);
+            dup2(fds[1], STDERR_FILENO);
+            close(fds[1]);
+            setvbuf(stdout, nullptr, _IOLBF, 0);
+            int rc = EXIT_FAILURE;
+            try { rc = run(targets[index]); }
+            catch (const std::exception& e) { portable::println(stderr, "Error: {}", e.what()); }
+            std::fflush(stdout);
+            std::fflush(stderr);
+            _exit(rc);
+        }
+        close(fds[1]);
+        if (slot.pid < 0) {
+            close(fds[0]);
+            fail("fork", fork_errno);
+            return;
+        }
+        slot.fd = fds[0];
+        active.push_back(std::move(slot));
+    };
+
+    auto finish = [&](Slot& slot) {
+        if (!slot.partial.empty()) emit(slot, slot.partial);
+        close(slot.fd);
+        int status = 0;
+        while (waitpid(slot.pid, &status, 0) < 0 && errno == EINTR) {}
+        auto& r = results[slot.index];
+        r.ran = true;
+        r.elapsed_ms = ms_since(slot.start);
+        r.exit_code = WIFEXITED(status) ? WEXITSTATUS(status)
+                    : WIFSIGNALED(status) ? 128 + WTERMSIG(status) : EXIT_FAILURE;
+    };
+
+    size_t limit = static_cast<size_t>(std::max(parallel, 1));
+    while (next < targets.size() || !active.empty()) {
+        while (active.size() < limit && next < targets.size()) {
+            size_t index = next++;
+            if (targets[index].error.empty()) spawn(index);
+        }
+        if (active.empty()) continue;
+
+        std::vector<pollfd> fds;
+        for (const auto& slot : active) fds.push_back({slot.fd, POLLIN, 0});
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (size_t i = active.size(); i-- > 0;) {
+            if (!fds[i].revents) continue;
+            auto& slot = active[i];
+            char buf[4096];
+            auto n = ::read(slot.fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n > 0) {
+                slot.partial.append(buf, static_cast<size_t>(n));
+                size_t pos;
+                while ((pos = slot.partial.find('\n')) != std::string::npos) {
+                    emit(slot, slot.partial.substr(0, pos));
+                    slot.partial.erase(0, pos + 1);
+                }
+                continue;
+            }
+            finish(slot);
+            active.erase(active.begin() + static_cast<std::ptrdiff_t>(i));
+        }
+    }
+
+    sigaction(SIGINT, &old_int, nullptr);
+    return results;
+}
+
+#endif
+
+std::string format_fleet_results(const std::vector<FleetResult>& results)
+{
+    size_t w_label  = 6;   // "Device"
+    size_t w_ip     = 15;  // "IP Address"
+    size_t w_mac    = 17;  // "MAC Address"
+    size_t w_status = 7;   // "exit 12"
+    for (const auto& r : results) {
+        w_label  = std::max(w_label, r.target.label.size());
+        w_ip     = std::max(w_ip, r.target.ip_address.size());
+        w_status = std::max(w_status, r.target.error.size());
+    }
+
+    std::string out;
+    out += std::format("{:<{}}  {:<{}}  {:<{}}  {:<{}}  {:>7}\n",
+                       "Device", w_label, "IP Address", w_ip, "MAC Address", w_mac,
+                       "Status", w_status, "Time ms");
+    out += std::string(w_label, '-') + "  " + std::string(w_ip, '-') + "  " +
+           std::string(w_mac, '-') + "  " + std::string(w_status, '-') + "  " +
+           std::string(7, '-') + "\n";
+
+    size_t ok = 0;
+    int64_t slowest = 0;
+    for (const auto& r : results) {
+        std::string status = !r.ran ? r.target.error
+                           : r.exit_code == 0 ? "ok" : std::format("exit {}", r.exit_code);
+        if (r.ran && r.exit_code == 0) ++ok;
+        if (r.ran) slowest = std::max(slowest, r.elapsed_ms);
+        out += std::format("{:<{}}  {:<{}}  {:<{}}  {:<{}}  {:>7}\n",
+                           r.target.label, w_label,
+                           r.target.ip_address.empty() ? "-" : r.target.ip_address, w_ip,
+                           r.target.mac_address.empty() ? "-" : r.target.mac_address, w_mac,
+                           status, w_status,
+                           r.ran ? std::to_string(r.elapsed_ms) : "-");
+    }
+    out += std::format("\n{} of {} device(s) succeeded; slowest took {} ms.\n",
+                       ok, results.size(), slowest);
+    return out;
+}
+
+} // namespace waveshare
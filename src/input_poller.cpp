@@ -0,0 +1,91 @@
+#include "waveshare_modbus_commander/input_poller.hpp"
+#include "waveshare_modbus_commander/operation_stats.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <format>
+#include <thread>
+
+namespace waveshare {
+
+bool parse_rate(const std::string& text, std::chrono::nanoseconds& period, std::string& error)
+{
+    std::string s;
+    for (unsigned char c : text) {
+        if (!std::isspace(c)) s += static_cast<char>(std::tolower(c));
+    }
+
+    double value = 0;
+    const char* end = s.data() + s.size();
+    auto [ptr, ec] = std::from_chars(s.data(), end, value);
+    std::string unit(ptr, end);
+    if (ec != std::errc{} || value <= 0) {
+        error = std::format("invalid rate '{}' (e.g. 200Hz or 5ms)", text);
+        return false;
+    }
+
+    double ns = 0;
+    if (unit.empty() || unit == "hz")  ns = 1e9 / value;
+    else if (unit == "khz")            ns = 1e6 / value;
+    else if (unit == "s")              ns = value * 1e9;
+    else if (unit == "ms")             ns = value * 1e6;
+    else if (unit == "us")             ns = value * 1e3;
+    else {
+        error = std::format("invalid rate unit in '{}' (use Hz, kHz, s, ms or us)", text);
+        return false;
+    }
+    if (ns < 1e3 || ns > 3600e9) {
+        error = std::format("rate '{}' out of range (1 us to 1 h per poll)", text);
+        return false;
+    }
+    period = std::chrono::nanoseconds(static_cast<int64_t>(ns));
+    return true;
+}
+
+InputPoller::InputPoller(modbus_t* ctx, std::chrono::nanoseconds period, uint16_t count)
+    : ctx_(ctx)
+    , period_(period)
+    , count_(std::min<uint16_t>(count, 32))
+{
+}
+
+bool InputPoller::poll(uint32_t& inputs)
+{
+    if (first_) {
+        first_ = false;
+        started_ = next_ = Clock::now();
+    } else {
+        std::this_thread::sleep_until(next_);
+    }
+
+    uint8_t bits[32]{};
+    auto requested = Clock::now();
+    int rc = timed(StatOp::READ_DISCRETE_INPUTS, [&] { return modbus_read_input_bits(ctx_, 0, count_, bits); });
+    auto replied = Clock::now();
+    latency_.record(replied - requested);
+    ++polls_;
+
+    // Next deadline; skip (and count) those the read overran.
+    next_ += period_;
+    if (replied >= next_) {
+        auto behind = (replied - next_) / period_ + 1;
+        missed_ += static_cast<uint64_t>(behind);
+        next_ += behind * period_;
+    }
+
+    if (rc != count_) {
+        ++failures_;
+        last_error_ = modbus_strerror(errno);
+        return false;
+    }
+    inputs = 0;
+    for (uint16_t i = 0; i < count_; ++i) {
+        if (bits[i]) inputs |= 1u << i;
+    }
+    sampled_at_ = replied;
+    return true;
+}
+
+} // namespace waveshare
@@ -0,0 +1,134 @@
+#include "waveshare_modbus_commander/interlock.hpp"
+#include "waveshare_modbus_commander/relay_state.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <format>
+
+namespace waveshare {
+
+namespace {
+
+/// Parse "<prefix><n>" with 1 <= n <= @p max; @p s is upper case.
+bool parse_numbered(const std::string& s, const std::string& prefix, int max, int& n)
+{
+    if (!s.starts_with(prefix)) return false;
+    const char* begin = s.data() + prefix.size();
+    const char* end = s.data() + s.size();
+    auto [ptr, ec] = std::from_chars(begin, end, n);
+    return begin != end && ec == std::errc{} && ptr == end && n >= 1 && n <= max;
+}
+
+bool parse_rule(const std::string& text, InterlockRule& rule, std::string& error)
+{
+    std::string s;
+    for (unsigned char c : text) {
+        if (!std::isspace(c)) s += static_cast<char>(std::toupper(c));
+    }
+
+    auto arrow = s.find("->");
+    if (arrow == std::string::npos) {
+        error = std::format("invalid interlock rule '{}' (expected e.g. \"DI3 -> RELAY5\")", text);
+        return false;
+    }
+    std::string condition = s.substr(0, arrow);
+    std::string action = s.substr(arrow + 2);
+
+    rule = InterlockRule{};
+    rule.text = text;
+    if (condition.starts_with('!')) {
+        rule.when_on = false;
+        condition.erase(0, 1);
+    }
+    if (!parse_numbered(condition, "DI", INPUT_COUNT, rule.input)) {
+        error = std::format("invalid condition in interlock rule '{}' (expected DI1-DI{} or !DIn)",
+                            text, INPUT_COUNT);
+        return false;
+    }
+
+    int relay = 0;
+    if (action == "ALL_OFF") {
+        rule.clear = 0xFF;
+    } else if (action == "ALL_ON") {
+        rule.set = 0xFF;
+    } else if (action.starts_with('!') && parse_numbered(action.substr(1), "RELAY", RELAY_COUNT, relay)) {
+        rule.clear = static_cast<uint8_t>(1u << (relay - 1));
+    } else if (parse_numbered(action, "RELAY", RELAY_COUNT, relay)) {
+        rule.set = static_cast<uint8_t>(1u << (relay - 1));
+    } else {
+        error = std::format("invalid action in interlock rule '{}' (expected RELAY1-RELAY{}, "
+                            "!RELAYn, ALL_ON or ALL_OFF)", text, RELAY_COUNT);
+        return false;
+    }
+    return true;
+}
+
+bool condition_holds(const InterlockRule& rule, uint32_t inputs)
+{
+    bool on = (inputs >> (rule.input - 1)) & 1u;
+    return on == rule.when_on;
+}
+
+std::string trim(const std::string& s)
+{
+    auto first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) return {};
+    return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+}
+
+} // anonymous namespace
+
+bool parse_interlock_rules(const std::vector<std::string>& args,
+                           std::vector<InterlockRule>& rules,
+                           std::string& error)
+{
+    rules.clear();
+    for (const auto& arg : args) {
+        size_t start = 0;
+        while (start <= arg.size()) {
+            auto end = arg.find_first_of(",;", start);
+            if (end == std::string::npos) end = arg.size();
+            auto text = trim(arg.substr(start, end - start));
+            start = end + 1;
+            if (text.empty()) continue;
+            InterlockRule rule;
+            if (!parse_rule(text, rule, error)) return false;
+            rules.push_back(std::move(rule));
+        }
+    }
+    if (rules.empty()) {
+        error = "--interlock needs at least one rule";
+        return false;
+    }
+    return true;
+}
+
+uint8_t apply_interlock_rules(const std::vector<InterlockRule>& rules,
+                              std::optional<uint32_t> previous,
+                              uint32_t inputs,
+                              uint8_t relays,
+                              std::vector<size_t>& fired)
+{
+    fired.clear();
+    for (size_t i = 0; i < rules.size(); ++i) {
+        const auto& rule = rules[i];
+        if (!condition_holds(rule, inputs)) continue;
+        if (previous && condition_holds(rule, *previous)) continue;
+        relays = static_cast<uint8_t>((relays | rule.set) & ~rule.clear);
+        fired.push_back(i);
+    }
+    return relays;
+}
+
+RelayChange interlock_change(const std::vector<InterlockRule>& rules, const std::vector<size_t>& fired)
+{
+    RelayChange change;
+    for (auto i : fired) {
+        change.on  = static_cast<uint8_t>((change.on | rules[i].set) & ~rules[i].clear);
+        change.off = static_cast<uint8_t>((change.off | rules[i].clear) & ~rules[i].set);
+    }
+    return change;
+}
+
+} // namespace waveshare
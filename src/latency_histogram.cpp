@@ -0,0 +1,98 @@
+#include "waveshare_modbus_commander/latency_histogram.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <format>
+
+namespace waveshare {
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (size_t i = 0; i < BUCKETS; ++i) counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    sum_us_ += other.sum_us_;
+    min_us_ = std::min(min_us_, other.min_us_);
+    max_us_ = std::max(max_us_, other.max_us_);
+}
+
+uint64_t LatencyHistogram::lower_bound_of(size_t bucket)
+{
+    if (bucket < SUB_BUCKETS) return bucket;
+    auto octave = static_cast<int>(bucket / SUB_BUCKETS) - 1 + SUB_BITS;
+    auto sub = bucket % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub) << (octave - SUB_BITS);
+}
+
+std::chrono::microseconds LatencyHistogram::percentile(double percent) const
+{
+    if (count_ == 0) return std::chrono::microseconds(0);
+    auto rank = static_cast<uint64_t>(percent / 100.0 * static_cast<double>(count_) + 0.5);
+    rank = std::clamp<uint64_t>(rank, 1, count_);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            uint64_t upper = i + 1 < BUCKETS ? lower_bound_of(i + 1) - 1 : max_us_;
+            return std::chrono::microseconds(std::min(upper, max_us_));
+        }
+    }
+    return max();
+}
+
+std::string LatencyHistogram::format_summary() const
+{
+    if (count_ == 0) return "no samples";
+    return std::format("n={}  min {}  p50 {}  p90 {}  p99 {}  p99.9 {}  max {}",
+                       count_, format_duration(min()), format_duration(percentile(50)),
+                       format_duration(percentile(90)), format_duration(percentile(99)),
+                       format_duration(percentile(99.9)), format_duration(max()));
+}
+
+std::string LatencyHistogram::format_buckets(int bar_width) const
+{
+    uint64_t peak = *std::max_element(counts_.begin(), counts_.end());
+    if (peak == 0) return {};
+
+    std::string out;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        if (counts_[i] == 0) continue;
+        auto lower = std::chrono::microseconds(lower_bound_of(i));
+        auto upper = std::chrono::microseconds(i + 1 < BUCKETS ? lower_bound_of(i + 1) - 1 : max_us_);
+        auto bar = static_cast<size_t>((counts_[i] * static_cast<uint64_t>(bar_width) + peak - 1) / peak);
+        out += std::format("  {:>9} - {:<9} {:>8}  {}\n",
+                           format_duration(lower), format_duration(upper), counts_[i], std::string(bar, '#'));
+    }
+    if (!out.empty()) out.pop_back();
+    return out;
+}
+
+std::string format_duration(std::chrono::microseconds d)
+{
+    auto us = d.count();
+    if (us < 1000) return std::format("{} us", us);
+    if (us < 1000000) return std::format("{:.2f} ms", static_cast<double>(us) / 1e3);
+    return std::format("{:.3f} s", static_cast<double>(us) / 1e6);
+}
+
+bool parse_duration(const std::string& text, std::chrono::nanoseconds& duration)
+{
+    std::string s = text;
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    double value = 0;
+    const char* end = s.data() + s.size();
+    auto [ptr, ec] = std::from_chars(s.data(), end, value);
+    if (s.empty() || ec != std::errc{} || value < 0) return false;
+
+    std::string unit(ptr, end);
+    double scale = 0;
+    if (unit.empty() || unit == "s") scale = 1e9;
+    else if (unit == "ms")           scale = 1e6;
+    else if (unit == "us")           scale = 1e3;
+    else return false;
+    duration = std::chrono::nanoseconds(static_cast<int64_t>(value * scale + 0.5));
+    return true;
+}
+
+} // namespace waveshare
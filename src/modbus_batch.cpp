@@ -0,0 +1,180 @@
+#include "waveshare_modbus_commander/modbus_batch.hpp"
+#include "waveshare_modbus_commander/operation_stats.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <string>
+#include <unordered_map>
+
+namespace waveshare {
+
+namespace {
+
+/// Read every range with @p read_range, falling back to single-address
+/// reads of the requested addresses when a range fails.  Results are
+/// collected per address and then emitted in request order.
+template <typename Reading, typename ReadFn>
+std::vector<Reading> read_batched(const std::vector<uint16_t>& addresses,
+                                  int max_gap, int max_count,
+                                  int* transactions, ReadFn read_range)
+{
+    std::unordered_map<uint16_t, Reading> by_address;
+    int sent = 0;
+
+    auto read_into = [&](uint16_t start, uint16_t count) -> bool {
+        std::vector<decltype(Reading::value)> values(count);
+        ++sent;
+        if (read_range(start, count, values) != count) return false;
+        for (uint16_t i = 0; i < count; ++i) {
+            auto it = by_address.find(static_cast<uint16_t>(start + i));
+            if (it == by_address.end()) continue;
+            it->second.ok = true;
+            it->second.value = values[i];
+        }
+        return true;
+    };
+
+    for (auto addr : addresses) {
+        Reading r;
+        r.address = addr;
+        by_address.emplace(addr, r);
+    }
+
+    for (const auto& range : coalesce_addresses(addresses, max_gap, max_count)) {
+        if (read_into(range.start, range.count)) continue;
+        std::string range_error = modbus_strerror(errno);
+
+        // The device rejected the range (e.g. an unmapped address in a
+        // gap): read the requested addresses one by one.
+        for (uint32_t a = range.start; a < uint32_t(range.start) + range.count; ++a) {
+            auto it = by_address.find(static_cast<uint16_t>(a));
+            if (it == by_address.end()) continue;
+            if (range.count > 1 && read_into(static_cast<uint16_t>(a), 1)) continue;
+            it->second.error = range.count > 1 ? modbus_strerror(errno) : range_error;
+        }
+    }
+
+    if (transactions) *transactions = sent;
+
+    std::vector<Reading> results;
+    results.reserve(addresses.size());
+    for (auto addr : addresses) {
+        results.push_back(by_address.at(addr));
+    }
+    return results;
+}
+
+} // anonymous namespace
+
+std::vector<AddressRange> coalesce_addresses(std::vector<uint16_t> addresses,
+                                             int max_gap,
+                                             int max_count)
+{
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+    max_gap = std::max(max_gap, 0);
+    max_count = std::max(max_count, 1);
+
+    std::vector<AddressRange> ranges;
+    for (auto addr : addresses) {
+        if (!ranges.empty()) {
+            auto& last = ranges.back();
+            int end = last.start + last.count;          // one past the range
+            int gap = addr - end;                       // unrequested addresses between
+            int merged = addr - last.start + 1;
+            if (gap <= max_gap && merged <= max_count) {
+                last.count = static_cast<uint16_t>(merged);
+                continue;
+            }
+        }
+        ranges.push_back({addr, 1});
+    }
+    return ranges;
+}
+
+std::vector<CoilReading> read_coils_batched(modbus_t* ctx,
+                                            const std::vector<uint16_t>& addresses,
+                                            int max_gap,
+                                            int* transactions)
+{
+    return read_batched<CoilReading>(
+        addresses, max_gap, MODBUS_MAX_READ_BITS, transactions,
+        [ctx](uint16_t start, uint16_t count, std::vector<bool>& out) {
+            // libmodbus returns one byte per coil.
+            std::vector<uint8_t> bits(count);
+            int n = timed(StatOp::READ_COILS, [&] { return modbus_read_bits(ctx, start, count, bits.data()); });
+            for (int i = 0; i < n; ++i) out[i] = bits[i] != 0;
+            return n;
+        });
+}
+
+std::vector<RegisterReading> read_registers_batched(modbus_t* ctx,
+                                                    const std::vector<uint16_t>& addresses,
+                                                    int max_gap,
+                                                    int* transactions)
+{
+    return read_batched<RegisterReading>(
+        addresses, max_gap, MODBUS_MAX_READ_REGISTERS, transactions,
+        [ctx](uint16_t start, uint16_t count, std::vector<uint16_t>& out) {
+            return timed(StatOp::READ_REGISTERS,
+                         [&] { return modbus_read_registers(ctx, start, count, out.data()); });
+        });
+}
+
+std::vector<CoilWriteResult> write_coils_batched(modbus_t* ctx,
+                                                 const std::vector<CoilWrite>& writes,
+                                                 int* transactions)
+{
+    // Final state per coil: the last write wins.
+    std::unordered_map<uint16_t, bool> final_state;
+    std::vector<uint16_t> addresses;
+    for (const auto& w : writes) {
+        if (final_state.insert_or_assign(w.address, w.state).second)
+            addresses.push_back(w.address);
+    }
+
+    int sent = 0;
+    std::unordered_map<uint16_t, std::string> errors;  // address -> error ("" = ok)
+
+    // Write [start, start + count), every address of which was requested.
+    auto write_block = [&](uint16_t start, uint16_t count) {
+        std::vector<uint8_t> bits(count);
+        for (uint16_t i = 0; i < count; ++i) {
+            bits[i] = final_state.at(static_cast<uint16_t>(start + i)) ? 1 : 0;
+        }
+        ++sent;
+        int rc = count == 1
+                     ? timed(StatOp::WRITE_COIL, [&] { return modbus_write_bit(ctx, start, bits[0]); })
+                     : timed(StatOp::WRITE_COILS, [&] { return modbus_write_bits(ctx, start, count, bits.data()); });
+        std::string error = rc < 0 ? modbus_strerror(errno) : "";
+        for (uint16_t i = 0; i < count; ++i) {
+            errors[static_cast<uint16_t>(start + i)] = error;
+        }
+    };
+
+    // Only requested coils are written: bridging the gaps between runs
+    // would need a read before the write, and a coil another client
+    // switches in between would be set back.
+    for (const auto& run : coalesce_addresses(addresses, 0, MODBUS_MAX_WRITE_BITS)) {
+        write_block(run.start, run.count);
+    }
+
+    if (transactions) *transactions = sent;
+
+    std::vector<CoilWriteResult> results;
+    results.reserve(writes.size());
+    for (size_t i = 0; i < writes.size(); ++i) {
+        CoilWriteResult r;
+        r.address = writes[i].address;
+        r.state = writes[i].state;
+        r.superseded = std::any_of(writes.begin() + static_cast<std::ptrdiff_t>(i) + 1, writes.end(),
+                                   [&](const CoilWrite& later) { return later.address == r.address; });
+        r.error = errors[r.address];
+        r.ok = r.error.empty();
+        results.push_back(std::move(r));
+    }
+    return results;
+}
+
+} // namespace waveshare
@@ -0,0 +1,87 @@
+#include "waveshare_modbus_commander/modbus_connection_pool.hpp"
+#include "waveshare_modbus_commander/create_modbus_connection.hpp"
+#include "waveshare_modbus_commander/operation_stats.hpp"
+#include "waveshare_modbus_commander/socket_compat.hpp"
+
+#include <modbus/modbus.h>
+
+#include <exception>
+#include <format>
+
+namespace waveshare {
+
+libmodbus_cpp::ModbusConnection& ModbusConnectionPool::get(const std::string& ip_address, int port,
+                                                           int timeout_seconds)
+{
+    auto key = std::format("{}:{}", ip_address, port);
+    auto it = connections_.find(key);
+    if (it == connections_.end()) {
+        OpTimer timer(StatOp::CONNECT);
+        it = connections_.emplace(key, create_modbus_connection(ip_address, port, timeout_seconds)).first;
+    } else {
+        it->second.set_response_timeout(timeout_seconds, 0);
+    }
+    return it->second;
+}
+
+bool ModbusConnectionPool::open(const std::string& key, int timeout_seconds)
+{
+    if (connections_.count(key)) return true;
+    auto colon = key.rfind(':');
+    if (colon == std::string::npos) return false;
+    try {
+        get(key.substr(0, colon), std::stoi(key.substr(colon + 1)), timeout_seconds);
+        return true;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+void ModbusConnectionPool::prune()
+{
+    for (auto it = connections_.begin(); it != connections_.end();) {
+        int s = modbus_get_socket(it->second.get_context());
+        // An idle connection has nothing to read: readability means EOF,
+        // an error, or a stray reply that would confuse the next request.
+        if (s < 0 || wait_readable(static_cast<socket_t>(s), 0) != 0)
+            it = connections_.erase(it);
+        else
+            ++it;
+    }
+}
+
+std::map<std::string, int> ModbusConnectionPool::snapshot()
+{
+    // The local port rather than the descriptor: a reconnect usually
+    // gets the descriptor number of the socket it replaced.
+    std::map<std::string, int> result;
+    for (auto& [key, conn] : connections_) {
+        int s = modbus_get_socket(conn.get_context());
+        sockaddr_in local{};
+        socklen_t len = sizeof(local);
+        if (s < 0 || getsockname(static_cast<socket_t>(s), reinterpret_cast<sockaddr*>(&local), &len) != 0)
+            result[key] = -1;
+        else
+            result[key] = ntohs(local.sin_port);
+    }
+    return result;
+}
+
+std::vector<std::string> ModbusConnectionPool::changed_since(const std::map<std::string, int>& before)
+{
+    std::vector<std::string> changed;
+    for (const auto& [key, id] : snapshot()) {
+        auto it = before.find(key);
+        if (it == before.end() || it->second != id) changed.push_back(key);
+    }
+    return changed;
+}
+
+ModbusConnectionPool& modbus_connection_pool()
+{
+    static ModbusConnectionPool pool;
+    return pool;
+}
+
+} // namespace waveshare
@@ -0,0 +1,422 @@
+#include "waveshare_modbus_commander/modbus_pipeline.hpp"
+#include "waveshare_modbus_commander/operation_stats.hpp"
+#include "waveshare_modbus_commander/portable_print.hpp"
+#include "waveshare_modbus_commander/socket_compat.hpp"
+
+#include <modbus/modbus.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <format>
+#include <unordered_map>
+
+namespace waveshare {
+
+namespace {
+
+constexpr size_t MBAP_HEADER_SIZE = 7;   ///< TID(2) PID(2) LEN(2) UNIT(1)
+constexpr size_t MAX_PDU_SIZE = 253;
+
+constexpr uint8_t FC_READ_COILS              = 0x01;
+constexpr uint8_t FC_READ_DISCRETE_INPUTS    = 0x02;
+constexpr uint8_t FC_READ_HOLDING_REGISTERS  = 0x03;
+constexpr uint8_t FC_WRITE_SINGLE_COIL       = 0x05;
+constexpr uint8_t FC_WRITE_SINGLE_REGISTER   = 0x06;
+constexpr uint8_t FC_WRITE_MULTIPLE_COILS    = 0x0F;
+constexpr uint8_t FC_WRITE_MULTIPLE_REGISTERS = 0x10;
+
+void put_u16(std::vector<uint8_t>& out, uint16_t v)
+{
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v & 0xFF));
+}
+
+uint16_t get_u16(const uint8_t* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+socket_t to_socket(intptr_t s) { return static_cast<socket_t>(s); }
+
+} // anonymous namespace
+
+PipelinedModbusClient::PipelinedModbusClient(std::string ip, int port, int timeout_ms, int depth,
+                                             uint8_t unit_id)
+    : ip_(std::move(ip))
+    , port_(port)
+    , timeout_ms_(timeout_ms)
+    , depth_(std::max(depth, 1))
+    , unit_id_(unit_id)
+{
+}
+
+PipelinedModbusClient::~PipelinedModbusClient()
+{
+    disconnect();
+}
+
+void PipelinedModbusClient::disconnect()
+{
+    if (sock_ != -1) {
+        close_socket(to_socket(sock_));
+        sock_ = -1;
+    }
+}
+
+bool PipelinedModbusClient::connect(std::string& error)
+{
+    disconnect();
+    OpTimer timer(StatOp::CONNECT);
+    bool ok = connect_socket(error);
+    if (!ok) timer.fail();
+    return ok;
+}
+
+bool PipelinedModbusClient::connect_socket(std::string& error)
+{
+#ifdef _WIN32
+    if (!wsa_init_.ok) {
+        error = "failed to initialize Winsock";
+        return false;
+    }
+#endif
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port_));
+    if (inet_pton(AF_INET, ip_.c_str(), &addr.sin_addr) != 1) {
+        error = std::format("invalid IP address '{}'", ip_);
+        return false;
+    }
+
+    socket_t s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCK) {
+        error = std::format("socket() failed: {}", modbus_strerror(get_last_socket_error()));
+        return false;
+    }
+
+    // Non-blocking connect so the timeout applies; the socket stays
+    // non-blocking and all waiting is done with poll/select.
+    set_socket_nonblocking(s);
+    if (::connect(s, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        int err = get_last_socket_error();
+        if (!connect_in_progress(err)) {
+            close_socket(s);
+            error = std::format("connect to {}:{} failed: {}", ip_, port_, modbus_strerror(err));
+            return false;
+        }
+        bool readable = false, writable = false;
+        int rc = wait_read_write(s, s, timeout_ms_, readable, writable);
+        int so_error = 0;
+        socklen_t len = sizeof(so_error);
+        if (rc <= 0 || !writable ||
+            getsockopt(s, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&so_error), &len) != 0 ||
+            so_error != 0) {
+            close_socket(s);
+            error = std::format("connect to {}:{} failed: {}", ip_, port_,
+                                modbus_strerror(rc <= 0 ? ETIMEDOUT : so_error));
+            return false;
+        }
+    }
+
+    // Requests are small and written back to back; do not let Nagle
+    // hold the later ones until the first is acknowledged.
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+
+    sock_ = static_cast<intptr_t>(s);
+    return true;
+}
+
+bool PipelinedModbusClient::reconnect()
+{
+    std::string error;
+    if (connect(error)) return true;
+    fail_remaining(error);
+    return false;
+}
+
+size_t PipelinedModbusClient::enqueue(uint8_t function, uint16_t address, uint16_t count,
+                                      std::vector<uint8_t> data)
+{
+    Request r;
+    r.function = function;
+    r.address = address;
+    r.count = count;
+    r.pdu.reserve(1 + data.size());
+    r.pdu.push_back(function);
+    r.pdu.insert(r.pdu.end(), data.begin(), data.end());
+    requests_.push_back(std::move(r));
+    return requests_.size() - 1;
+}
+
+size_t PipelinedModbusClient::read_coils(uint16_t address, uint16_t count)
+{
+    std::vector<uint8_t> data;
+    put_u16(data, address);
+    put_u16(data, count);
+    return enqueue(FC_READ_COILS, address, count, std::move(data));
+}
+
+size_t PipelinedModbusClient::read_discrete_inputs(uint16_t address, uint16_t count)
+{
+    std::vector<uint8_t> data;
+    put_u16(data, address);
+    put_u16(data, count);
+    return enqueue(FC_READ_DISCRETE_INPUTS, address, count, std::move(data));
+}
+
+size_t PipelinedModbusClient::read_registers(uint16_t address, uint16_t count)
+{
+    std::vector<uint8_t> data;
+    put_u16(data, address);
+    put_u16(data, count);
+    return enqueue(FC_READ_HOLDING_REGISTERS, address, count, std::move(data));
+}
+
+size_t PipelinedModbusClient::write_coil(uint16_t address, bool state)
+{
+    std::vector<uint8_t> data;
+    put_u16(data, address);
+    put_u16(data, state ? 0xFF00 : 0x0000);
+    return enqueue(FC_WRITE_SINGLE_COIL, address, 1, std::move(data));
+}
+
+size_t PipelinedModbusClient::write_coils(uint16_t address, const std::vector<bool>& states)
+{
+    auto count = static_cast<uint16_t>(states.size());
+    std::vector<uint8_t> data;
+    put_u16(data, address);
+    put_u16(data, count);
+    data.push_back(static_cast<uint8_t>((count + 7) / 8));
+    std::vector<uint8_t> packed((count + 7) / 8);
+    for (size_t i = 0; i < states.size(); ++i) {
+        if (states[i]) packed[i / 8] = static_cast<uint8_t>(packed[i / 8] | (1u << (i % 8)));
+    }
+    data.insert(data.end(), packed.begin(), packed.end());
+    return enqueue(FC_WRITE_MULTIPLE_COILS, address, count, std::move(data));
+}
+
+size_t PipelinedModbusClient::write_register(uint16_t address, uint16_t value)
+{
+    std::vector<uint8_t> data;
+    put_u16(data, address);
+    put_u16(data, value);
+    return enqueue(FC_WRITE_SINGLE_REGISTER, address, 1, std::move(data));
+}
+
+size_t PipelinedModbusClient::write_registers(uint16_t address, const std::vector<uint16_t>& values)
+{
+    auto count = static_cast<uint16_t>(values.size());
+    std::vector<uint8_t> data;
+    put_u16(data, address);
+    put_u16(data, count);
+    data.push_back(static_cast<uint8_t>(count * 2));
+    for (auto v : values) put_u16(data, v);
+    return enqueue(FC_WRITE_MULTIPLE_REGISTERS, address, count, std::move(data));
+}
+
+bool PipelinedModbusClient::send_request(size_t index, uint16_t tid)
+{
+    const auto& pdu = requests_[index].pdu;
+    std::vector<uint8_t> frame;
+    frame.reserve(MBAP_HEADER_SIZE + pdu.size());
+    put_u16(frame, tid);
+    put_u16(frame, 0);                                        // protocol: Modbus
+    put_u16(frame, static_cast<uint16_t>(pdu.size() + 1));    // unit + PDU
+    frame.push_back(unit_id_);
+    frame.insert(frame.end(), pdu.begin(), pdu.end());
+
+    auto s = to_socket(sock_);
+    size_t sent = 0;
+    while (sent < frame.size()) {
+        auto n = ::send(s, reinterpret_cast<const char*>(frame.data() + sent),
+                        static_cast<int>(frame.size() - sent), 0);
+        if (n > 0) { sent += static_cast<size_t>(n); continue; }
+        if (n < 0 && would_block(get_last_socket_error())) {
+            bool readable = false, writable = false;
+            if (wait_read_write(s, s, timeout_ms_, readable, writable) > 0 && writable)
+                continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+void PipelinedModbusClient::complete(Request& request, const uint8_t* pdu, size_t len)
+{
+    request.done = true;
+    auto& reply = request.reply;
+
+    if (len >= 2 && pdu[0] == (request.function | 0x80)) {
+        reply.error = modbus_strerror(MODBUS_ENOBASE + pdu[1]);
+        return;
+    }
+    if (len < 1 || pdu[0] != request.function) {
+        reply.error = modbus_strerror(EMBBADDATA);
+        return;
+    }
+
+    switch (request.function) {
+    case FC_READ_COILS:
+    case FC_READ_DISCRETE_INPUTS: {
+        size_t bytes = (request.count + 7u) / 8u;
+        if (len < 2 + bytes || pdu[1] != bytes) {
+            reply.error = modbus_strerror(EMBBADDATA);
+            return;
+        }
+        reply.bits.resize(request.count);
+        for (uint16_t i = 0; i < request.count; ++i)
+            reply.bits[i] = (pdu[2 + i / 8] >> (i % 8)) & 1u;
+        break;
+    }
+    case FC_READ_HOLDING_REGISTERS: {
+        size_t bytes = request.count * 2u;
+        if (len < 2 + bytes || pdu[1] != bytes) {
+            reply.error = modbus_strerror(EMBBADDATA);
+            return;
+        }
+        reply.registers.resize(request.count);
+        for (uint16_t i = 0; i < request.count; ++i)
+            reply.registers[i] = get_u16(pdu + 2 + 2 * i);
+        break;
+    }
+    default:
+        // Writes echo the address (and value or quantity).
+        if (len < 5 || get_u16(pdu + 1) != request.address) {
+            reply.error = modbus_strerror(EMBBADDATA);
+            return;
+        }
+        break;
+    }
+    reply.ok = true;
+}
+
+void PipelinedModbusClient::fail_remaining(const std::string& error)
+{
+    for (auto& r : requests_) {
+        if (r.done) continue;
+        r.done = true;
+        r.reply.error = error;
+    }
+}
+
+void PipelinedModbusClient::execute()
+{
+    if (sock_ == -1 && !reconnect()) return;
+
+    std::unordered_map<uint16_t, size_t> in_flight;    // TID -> request index
+    std::vector<uint8_t> rx;
+    size_t next = 0;
+
+    // Lowest unanswered request; everything before it is done.
+    auto first_pending = [&]() {
+        size_t i = 0;
+        while (i < requests_.size() && requests_[i].done) ++i;
+        return i;
+    };
+
+    // The device misbehaved.  While pipelining, this is taken as a sign
+    // that it cannot cope with several requests in flight: drop to
+    // serial mode and repeat every request from the first unanswered one
+    // on, answered ones included, so the device sees the writes in their
+    // queued order again and a repeated write cannot undo a later one.
+    // In serial mode the request in flight fails with @p error.
+    auto recover = [&](int err, const char* what) -> bool {
+        if (depth_ > 1) {
+            if (debug_)
+                portable::println("Pipelining to {}:{} failed ({}) — falling back to serial requests",
+                                  ip_, port_, what);
+            depth_ = 1;
+            fell_back_ = true;
+            for (size_t i = first_pending(); i < requests_.size(); ++i) {
+                requests_[i].done = false;
+                requests_[i].reply = {};
+            }
+        } else {
+            for (const auto& [tid, index] : in_flight) {
+                auto& request = requests_[index];
+                request.done = true;
+                request.reply.error = modbus_strerror(err);
+                if (operation_stats_enabled()) {
+                    if (auto op = stat_op_for_function(request.function))
+                        record_operation(*op, std::chrono::steady_clock::now() - request.sent_at, false);
+                }
+            }
+        }
+        in_flight.clear();
+        rx.clear();
+        next = first_pending();
+        return reconnect();
+    };
+
+    next = first_pending();
+    while (next < requests_.size() || !in_flight.empty()) {
+        // Fill the window.
+        bool send_failed = false;
+        while (in_flight.size() < static_cast<size_t>(depth_) && next < requests_.size()) {
+            if (requests_[next].done) { ++next; continue; }
+            uint16_t tid = next_tid_++;
+            if (!send_request(next, tid)) { send_failed = true; break; }
+            if (operation_stats_enabled()) requests_[next].sent_at = std::chrono::steady_clock::now();
+            WAVESHARE_TRACE_INSTANT("request sent", std::format("FC{:02} tid {}", requests_[next].function, tid));
+            in_flight.emplace(tid, next++);
+        }
+        if (send_failed) {
+            if (!recover(get_last_socket_error(), "send failed")) return;
+            continue;
+        }
+        if (in_flight.empty()) break;
+
+        int rc = wait_readable(to_socket(sock_), timeout_ms_);
+        if (rc <= 0) {
+            if (!recover(ETIMEDOUT, "response timeout")) return;
+            continue;
+        }
+
+        uint8_t buf[1024];
+        auto n = ::recv(to_socket(sock_), reinterpret_cast<char*>(buf), sizeof(buf), 0);
+        if (n < 0 && would_block(get_last_socket_error())) continue;
+        if (n <= 0) {
+            if (!recover(ECONNRESET, "connection closed")) return;
+            continue;
+        }
+        rx.insert(rx.end(), buf, buf + n);
+
+        // Consume every complete frame.
+        bool broken = false;
+        size_t pos = 0;
+        while (rx.size() - pos >= MBAP_HEADER_SIZE) {
+            const uint8_t* h = rx.data() + pos;
+            uint16_t tid = get_u16(h);
+            uint16_t len = get_u16(h + 4);
+            if (get_u16(h + 2) != 0 || len < 2 || len > MAX_PDU_SIZE + 1) {
+                broken = true;
+                break;
+            }
+            if (rx.size() - pos < 6u + len) break;
+
+            auto it = in_flight.find(tid);
+            if (it != in_flight.end()) {
+                auto& request = requests_[it->second];
+                complete(request, h + MBAP_HEADER_SIZE, len - 1u);
+                WAVESHARE_TRACE_INSTANT("response received", std::format("FC{:02} tid {}", request.function, tid));
+                if (operation_stats_enabled()) {
+                    if (auto op = stat_op_for_function(request.function))
+                        record_operation(*op, std::chrono::steady_clock::now() - request.sent_at, request.reply.ok);
+                }
+                in_flight.erase(it);
+            } else if (depth_ > 1) {
+                broken = true;      // a reply we cannot attribute
+                break;
+            }
+            // In serial mode an unknown TID is a late reply to a request
+            // that already timed out; skip it.
+            pos += 6u + len;
+        }
+        rx.erase(rx.begin(), rx.begin() + static_cast<std::ptrdiff_t>(pos));
+
+        if (broken && !recover(EMBBADDATA, "unexpected response")) return;
+    }
+}
+
+} // namespace waveshare
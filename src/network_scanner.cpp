@@ -1,57 +1,28 @@
 #include "waveshare_modbus_commander/network_scanner.hpp"
+#include "waveshare_modbus_commander/operation_stats.hpp"
 #include "waveshare_modbus_commander/portable_print.hpp"
+#include "waveshare_modbus_commander/socket_compat.hpp"
+#include "waveshare_modbus_commander/trace.hpp"
 
 #include <algorithm>
 #include <array>
+#include <charconv>
 #include <chrono>
+#include <cmath>
 #include <cstring>
 #include <format>
 #include <fstream>
 #include <set>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 
-// Platform-specific socket headers
-#ifdef _WIN32
-#  ifndef WIN32_LEAN_AND_MEAN
-#    define WIN32_LEAN_AND_MEAN
-#  endif
-#  include <winsock2.h>
-#  include <ws2tcpip.h>
-#  include <iphlpapi.h>
-#  pragma comment(lib, "ws2_32.lib")
-#  pragma comment(lib, "iphlpapi.lib")
-   using socket_t = SOCKET;
-   constexpr socket_t INVALID_SOCK = INVALID_SOCKET;
-   inline int close_socket(socket_t s) { return closesocket(s); }
-   inline int set_socket_nonblocking(socket_t s) {
-       u_long mode = 1;
-       return ioctlsocket(s, FIONBIO, &mode);
-   }
-   inline int get_last_socket_error() { return WSAGetLastError(); }
-   inline bool would_block(int err) { return err == WSAEWOULDBLOCK; }
+// Batched datagram I/O (sendmmsg/recvmmsg) is Linux-only.  Configure with
+// -DWAVESHARE_BATCHED_UDP=OFF to measure the one-syscall-per-datagram path.
+#if defined(__linux__) && !defined(WAVESHARE_NO_MMSG)
+#  define WAVESHARE_HAVE_MMSG 1
 #else
-#  include <arpa/inet.h>
-#  include <cerrno>
-#  include <fcntl.h>
-#  include <net/if.h>
-#  include <netinet/in.h>
-#  include <sys/ioctl.h>
-#  include <sys/socket.h>
-#  include <sys/types.h>
-#  include <unistd.h>
-#  include <ifaddrs.h>
-#  include <netdb.h>
-#  include <netpacket/packet.h>
-   using socket_t = int;
-   constexpr socket_t INVALID_SOCK = -1;
-   inline int close_socket(socket_t s) { return ::close(s); }
-   inline int set_socket_nonblocking(socket_t s) {
-       int flags = fcntl(s, F_GETFL, 0);
-       return fcntl(s, F_SETFL, flags | O_NONBLOCK);
-   }
-   inline int get_last_socket_error() { return errno; }
-   inline bool would_block(int err) { return err == EAGAIN || err == EWOULDBLOCK; }
+#  define WAVESHARE_HAVE_MMSG 0
 #endif
 
 namespace waveshare {
@@ -154,20 +125,6 @@ bool parse_response(const uint8_t* data, size_t len, DiscoveredDevice& dev)
     return true;
 }
 
-#ifdef _WIN32
-/// RAII wrapper for Winsock initialization.
-struct WinsockInit {
-    bool ok = false;
-    WinsockInit() {
-        WSADATA wsa;
-        ok = (WSAStartup(MAKEWORD(2, 2), &wsa) == 0);
-    }
-    ~WinsockInit() { if (ok) WSACleanup(); }
-    WinsockInit(const WinsockInit&) = delete;
-    WinsockInit& operator=(const WinsockInit&) = delete;
-};
-#endif
-
 // ---------------------------------------------------------------------------
 // WSL2 auto-discovery helpers
 // ---------------------------------------------------------------------------
@@ -236,6 +193,7 @@ std::set<uint32_t> get_local_interface_ips()
 /// Returns a list of network-byte-order /24 base addresses (host part = 0).
 std::vector<uint32_t> discover_host_subnets(bool debug)
 {
+    WAVESHARE_TRACE_SPAN("discover_host_subnets");
     std::vector<uint32_t> subnets;
 #ifndef _WIN32
     auto local_ips = get_local_interface_ips();
@@ -258,8 +216,11 @@ std::vector<uint32_t> discover_host_subnets(bool debug)
         hints.ai_socktype = SOCK_DGRAM;
 
         struct addrinfo* res = nullptr;
-        if (::getaddrinfo(name.c_str(), nullptr, &hints, &res) != 0 || !res) {
-            continue;
+        {
+            WAVESHARE_TRACE_SPAN("getaddrinfo", name);
+            if (::getaddrinfo(name.c_str(), nullptr, &hints, &res) != 0 || !res) {
+                continue;
+            }
         }
 
         for (auto* rp = res; rp; rp = rp->ai_next) {
@@ -400,6 +361,11 @@ std::vector<in_addr> get_interface_broadcast_addresses()
 int send_search(socket_t sock, const std::array<uint8_t, VIRCOM_PACKET_SIZE>& request,
                 const sockaddr_in& dest)
 {
+    WAVESHARE_TRACE_INSTANT("packet sent", [&dest] {
+        char ip_str[INET_ADDRSTRLEN]{};
+        inet_ntop(AF_INET, &dest.sin_addr, ip_str, sizeof(ip_str));
+        return std::string(ip_str);
+    }());
     return static_cast<int>(
         ::sendto(sock,
                  reinterpret_cast<const char*>(request.data()),
@@ -409,27 +375,285 @@ int send_search(socket_t sock, const std::array<uint8_t, VIRCOM_PACKET_SIZE>& re
                  sizeof(dest)));
 }
 
-} // anonymous namespace
+// ---------------------------------------------------------------------------
+// Unicast sweep planning and pacing
+// ---------------------------------------------------------------------------
 
-std::vector<DiscoveredDevice> scan_network(int timeout_ms, bool debug,
-                                           const std::string& target_ip,
-                                           const std::vector<std::string>& extra_subnets)
+/// Inclusive range of IPv4 host addresses (host byte order).
+struct HostRange {
+    uint32_t first = 0;
+    uint32_t last  = 0;
+};
+
+/// Shortest prefix accepted for a sweep (a /16 is 65534 probes).
+constexpr int MIN_SWEEP_PREFIX = 16;
+
+/// Parse "a.b.c.d/len" — or a bare address, meaning its /24 — into the
+/// range of host addresses to probe.  Network and broadcast addresses
+/// are excluded for prefixes shorter than /31.
+bool parse_sweep_range(const std::string& text, HostRange& range, std::string& error)
 {
-    std::vector<DiscoveredDevice> devices;
+    auto slash = text.find('/');
+    std::string addr_part = text.substr(0, slash);
+    int prefix = 24;
+    if (slash != std::string::npos) {
+        const char* first = text.data() + slash + 1;
+        const char* last  = text.data() + text.size();
+        auto [ptr, ec] = std::from_chars(first, last, prefix);
+        if (first == last || ec != std::errc{} || ptr != last) {
+            error = "invalid prefix length";
+            return false;
+        }
+    }
+    if (prefix < MIN_SWEEP_PREFIX || prefix > 32) {
+        error = std::format("prefix /{} out of range (/{} to /32)", prefix, MIN_SWEEP_PREFIX);
+        return false;
+    }
 
-#ifdef _WIN32
-    WinsockInit wsa_init;
-    if (!wsa_init.ok) {
-        portable::println(stderr, "Failed to initialize Winsock");
-        return devices;
+    in_addr addr{};
+    if (inet_pton(AF_INET, addr_part.c_str(), &addr) != 1) {
+        error = "invalid IPv4 address";
+        return false;
+    }
+
+    uint32_t mask  = 0xFFFFFFFFu << (32 - prefix);
+    uint32_t net   = ntohl(addr.s_addr) & mask;
+    uint32_t bcast = net | ~mask;
+    range = (prefix >= 31) ? HostRange{net, bcast} : HostRange{net + 1, bcast - 1};
+    return true;
+}
+
+/// Sort @p ranges and merge overlapping or adjacent ones so that every
+/// host is probed exactly once.
+std::vector<HostRange> merge_ranges(std::vector<HostRange> ranges)
+{
+    std::sort(ranges.begin(), ranges.end(),
+              [](const HostRange& a, const HostRange& b) { return a.first < b.first; });
+
+    std::vector<HostRange> merged;
+    for (const auto& r : ranges) {
+        if (!merged.empty() &&
+            static_cast<uint64_t>(r.first) <= static_cast<uint64_t>(merged.back().last) + 1) {
+            merged.back().last = std::max(merged.back().last, r.last);
+        } else {
+            merged.push_back(r);
+        }
+    }
+    return merged;
+}
+
+/// Outcome of a batched send.
+struct BatchSendResult {
+    size_t consumed = 0;  ///< Destinations dealt with (sent or skipped)
+    size_t sent     = 0;  ///< Datagrams handed to the kernel
+};
+
+/// Send the search request to @p count destinations starting at @p dests.
+/// On Linux the datagrams go out in batches through sendmmsg(); elsewhere
+/// this falls back to one sendto() per destination.  Stops early when the
+/// socket send buffer is full; destinations failing with a hard error
+/// (e.g. no route) are skipped.
+BatchSendResult send_search_batch(socket_t sock, const std::array<uint8_t, VIRCOM_PACKET_SIZE>& request,
+                                  const sockaddr_in* dests, size_t count)
+{
+    BatchSendResult result;
+#if WAVESHARE_HAVE_MMSG
+    constexpr size_t BATCH = 64;
+    std::array<iovec, BATCH> iovs{};
+    std::array<mmsghdr, BATCH> msgs{};
+    for (size_t i = 0; i < BATCH; ++i) {
+        iovs[i].iov_base = const_cast<uint8_t*>(request.data());
+        iovs[i].iov_len  = request.size();
+        msgs[i].msg_hdr.msg_iov    = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (result.consumed < count) {
+        auto chunk = std::min(BATCH, count - result.consumed);
+        for (size_t i = 0; i < chunk; ++i) {
+            msgs[i].msg_hdr.msg_name    = const_cast<sockaddr_in*>(&dests[result.consumed + i]);
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+        int n = ::sendmmsg(sock, msgs.data(), static_cast<unsigned int>(chunk), 0);
+        if (n < 0) {
+            int err = get_last_socket_error();
+            if (would_block(err) || err == ENOBUFS) break;
+            ++result.consumed;  // skip the failing destination
+            continue;
+        }
+        if (n == 0) break;
+        result.sent     += static_cast<size_t>(n);
+        result.consumed += static_cast<size_t>(n);
+    }
+#else
+    for (; result.consumed < count; ++result.consumed) {
+        if (send_search(sock, request, dests[result.consumed]) > 0) {
+            ++result.sent;
+        } else if (would_block(get_last_socket_error())) {
+            break;
+        }
+    }
+#endif
+    return result;
+}
+
+/// Releases unicast sweep probes over a set of merged host ranges.
+///
+/// With a rate the probes are paced by a token bucket so that managed
+/// switches and the small device TCP/IP stacks are not flooded.  Without
+/// one they go out in chunks.  Either way the caller drains responses
+/// between calls to send_due(), so replies are never left queued behind
+/// thousands of outgoing probes.
+class ProbeScheduler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /// @param ranges      Merged host ranges to probe.
+    /// @param rate        Probes per second, 0 = unpaced.
+    /// @param skip_hosts  Sorted hosts already probed elsewhere.
+    ProbeScheduler(const std::vector<HostRange>& ranges, int rate,
+                   const std::vector<uint32_t>& skip_hosts)
+        : rate_(rate)
+    {
+        for (const auto& r : ranges) {
+            for (uint64_t ip = r.first; ip <= r.last; ++ip) {
+                if (std::binary_search(skip_hosts.begin(), skip_hosts.end(),
+                                       static_cast<uint32_t>(ip))) continue;
+                sockaddr_in dest{};
+                dest.sin_family = AF_INET;
+                dest.sin_port = htons(VIRCOM_PORT);
+                dest.sin_addr.s_addr = htonl(static_cast<uint32_t>(ip));
+                dests_.push_back(dest);
+            }
+        }
+        // Allow a burst of 20 ms worth of probes so pacing does not
+        // require a wakeup per datagram.
+        burst_  = rate_ > 0 ? std::max(1.0, rate_ / 50.0) : 0.0;
+        tokens_ = burst_;
+    }
+
+    bool   done()  const { return next_ >= dests_.size(); }
+    size_t total() const { return dests_.size(); }
+    size_t sent()  const { return sent_; }
+
+    /// Send the probes that are due at @p now.
+    void send_due(socket_t sock, const std::array<uint8_t, VIRCOM_PACKET_SIZE>& request,
+                  clock::time_point now)
+    {
+        if (done()) return;
+        if (!started_) {
+            started_ = true;
+            started_at_ = now;
+            last_refill_ = now;
+        }
+
+        size_t budget = UNPACED_CHUNK;
+        if (rate_ > 0) {
+            std::chrono::duration<double> dt = now - last_refill_;
+            last_refill_ = now;
+            tokens_ = std::min(burst_, tokens_ + rate_ * dt.count());
+            budget = static_cast<size_t>(tokens_);
+            if (budget == 0) return;
+        }
+
+        auto count = std::min(budget, dests_.size() - next_);
+        auto result = send_search_batch(sock, request, &dests_[next_], count);
+        next_   += result.consumed;
+        sent_   += result.sent;
+        blocked_ = result.consumed < count;
+        if (rate_ > 0) tokens_ -= static_cast<double>(result.consumed);
+        if (done()) finished_at_ = clock::now();
+    }
+
+    /// How long the caller may wait for responses before the next probe
+    /// is due (milliseconds).
+    int ms_until_next() const
+    {
+        if (blocked_) return 1;
+        if (rate_ <= 0) return 0;
+        double missing = 1.0 - tokens_;
+        if (missing <= 0.0) return 0;
+        return std::max(1, static_cast<int>(std::ceil(missing * 1000.0 / rate_)));
+    }
+
+    /// Wall time the sweep took, in microseconds.
+    long long duration_us() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(finished_at_ - started_at_).count();
+    }
+
+private:
+    static constexpr size_t UNPACED_CHUNK = 256;
+
+    std::vector<sockaddr_in> dests_;
+    size_t next_ = 0;
+    size_t sent_ = 0;
+    int    rate_ = 0;
+    double burst_  = 0.0;
+    double tokens_ = 0.0;
+    bool   blocked_ = false;
+    bool   started_ = false;
+    clock::time_point started_at_{};
+    clock::time_point finished_at_{};
+    clock::time_point last_refill_{};
+};
+
+/// Receive buffers for draining several datagrams per call.
+struct ReceiveBatch {
+    static constexpr size_t CAPACITY = 16;
+    std::array<std::array<uint8_t, 512>, CAPACITY> buffers{};
+    std::array<sockaddr_in, CAPACITY> senders{};
+    std::array<size_t, CAPACITY> lengths{};
+};
+
+/// Read queued datagrams into @p batch without blocking.
+/// On Linux up to ReceiveBatch::CAPACITY datagrams are fetched with one
+/// recvmmsg(); elsewhere a single recvfrom() is made.
+/// @return Number of datagrams received, 0 when the queue is empty, or -1
+///         on error (inspect get_last_socket_error()).
+int receive_batch(socket_t sock, ReceiveBatch& batch)
+{
+#if WAVESHARE_HAVE_MMSG
+    std::array<iovec, ReceiveBatch::CAPACITY> iovs{};
+    std::array<mmsghdr, ReceiveBatch::CAPACITY> msgs{};
+    for (size_t i = 0; i < ReceiveBatch::CAPACITY; ++i) {
+        iovs[i].iov_base = batch.buffers[i].data();
+        iovs[i].iov_len  = batch.buffers[i].size();
+        msgs[i].msg_hdr.msg_iov     = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen  = 1;
+        msgs[i].msg_hdr.msg_name    = &batch.senders[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+    int n = ::recvmmsg(sock, msgs.data(), ReceiveBatch::CAPACITY, MSG_DONTWAIT, nullptr);
+    if (n < 0) return would_block(get_last_socket_error()) ? 0 : -1;
+    for (int i = 0; i < n; ++i) {
+        batch.lengths[i] = msgs[i].msg_len;
     }
+    return n;
+#else
+    socklen_t sender_len = sizeof(sockaddr_in);
+    auto n = ::recvfrom(sock,
+                        reinterpret_cast<char*>(batch.buffers[0].data()),
+                        static_cast<int>(batch.buffers[0].size()),
+                        0,
+                        reinterpret_cast<sockaddr*>(&batch.senders[0]),
+                        &sender_len);
+    if (n < 0) return would_block(get_last_socket_error()) ? 0 : -1;
+    batch.lengths[0] = static_cast<size_t>(n);
+    return 1;
 #endif
+}
 
+/// Create the UDP socket used for VirCom searches: broadcast enabled and
+/// bound to an ephemeral port.  Errors are reported on stderr.
+/// @return The socket, or INVALID_SOCK on failure.
+socket_t open_vircom_socket()
+{
     // Create UDP socket
     socket_t sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (sock == INVALID_SOCK) {
         portable::println(stderr, "Failed to create UDP socket: error {}", get_last_socket_error());
-        return devices;
+        return INVALID_SOCK;
     }
 
     // Enable broadcast
@@ -439,7 +663,7 @@ std::vector<DiscoveredDevice> scan_network(int timeout_ms, bool debug,
                      sizeof(broadcast_enable)) < 0) {
         portable::println(stderr, "Failed to enable broadcast: error {}", get_last_socket_error());
         close_socket(sock);
-        return devices;
+        return INVALID_SOCK;
     }
 
     // Allow address reuse
@@ -455,6 +679,50 @@ std::vector<DiscoveredDevice> scan_network(int timeout_ms, bool debug,
     if (::bind(sock, reinterpret_cast<sockaddr*>(&bind_addr), sizeof(bind_addr)) < 0) {
         portable::println(stderr, "Failed to bind UDP socket: error {}", get_last_socket_error());
         close_socket(sock);
+        return INVALID_SOCK;
+    }
+
+    return sock;
+}
+
+} // anonymous namespace
+
+std::vector<DiscoveredDevice> scan_network(int timeout_ms, bool debug,
+                                           const std::string& target_ip,
+                                           const std::vector<std::string>& extra_subnets,
+                                           const std::function<bool(const DiscoveredDevice&)>& stop_when)
+{
+    ScanOptions options;
+    options.timeout_ms    = timeout_ms;
+    options.debug         = debug;
+    options.target_ip     = target_ip;
+    options.extra_subnets = extra_subnets;
+    options.stop_when     = stop_when;
+    return scan_network(options);
+}
+
+std::vector<DiscoveredDevice> scan_network(const ScanOptions& options)
+{
+    const int   timeout_ms = options.timeout_ms;
+    const bool  debug      = options.debug;
+    const auto& target_ip  = options.target_ip;
+    const auto& stop_when  = options.stop_when;
+
+    OpTimer timer(StatOp::SCAN);
+    std::vector<DiscoveredDevice> devices;
+
+#ifdef _WIN32
+    WinsockInit wsa_init;
+    if (!wsa_init.ok) {
+        portable::println(stderr, "Failed to initialize Winsock");
+        timer.fail();
+        return devices;
+    }
+#endif
+
+    socket_t sock = open_vircom_socket();
+    if (sock == INVALID_SOCK) {
+        timer.fail();
         return devices;
     }
 
@@ -465,8 +733,29 @@ std::vector<DiscoveredDevice> scan_network(int timeout_ms, bool debug,
     // the chance of reaching devices, even across NAT / virtual interfaces.
     // -----------------------------------------------------------------------
 
+    // Hosts that get a dedicated unicast probe; the sweep skips them.
+    std::vector<uint32_t> probed_hosts;
+
+    // 0. Last-known addresses first (e.g. from the discovery cache), so a
+    //    device that has not moved answers before the broadcast storm.
+    for (const auto& ip : options.priority_ips) {
+        sockaddr_in dest{};
+        dest.sin_family = AF_INET;
+        dest.sin_port = htons(VIRCOM_PORT);
+        if (ip == target_ip || inet_pton(AF_INET, ip.c_str(), &dest.sin_addr) != 1) continue;
+
+        int sent = send_search(sock, request, dest);
+        probed_hosts.push_back(ntohl(dest.sin_addr.s_addr));
+        if (debug) {
+            if (sent > 0)
+                portable::println("Sent VirCom search ({} bytes) -> {}:{} (last known)", sent, ip, VIRCOM_PORT);
+            else
+                portable::println("Failed to send to {}: error {}", ip, get_last_socket_error());
+        }
+    }
+
     // 1. Limited broadcast (255.255.255.255) — works on the local L2 segment
-    {
+    if (!options.unicast_only) {
         sockaddr_in dest{};
         dest.sin_family = AF_INET;
         dest.sin_addr.s_addr = INADDR_BROADCAST;
@@ -482,7 +771,7 @@ std::vector<DiscoveredDevice> scan_network(int timeout_ms, bool debug,
     }
 
     // 2. Per-interface directed broadcasts (e.g. 192.168.178.255)
-    {
+    if (!options.unicast_only) {
         auto bcast_addrs = get_interface_broadcast_addresses();
         for (const auto& baddr : bcast_addrs) {
             sockaddr_in dest{};
@@ -523,30 +812,14 @@ std::vector<DiscoveredDevice> scan_network(int timeout_ms, bool debug,
 
     // 4. Explicit extra subnets (--extra-subnet): always sweep these with
     //    unicast probes regardless of platform.
-    {
-        std::vector<uint32_t> extra_nets;
-        for (const auto& cidr : extra_subnets) {
-            in_addr addr{};
-            if (inet_pton(AF_INET, cidr.c_str(), &addr) == 1) {
-                extra_nets.push_back(ntohl(addr.s_addr) & 0xFFFFFF00u);
-            } else if (debug) {
-                portable::println("Invalid extra subnet: {}", cidr);
-            }
-        }
-        for (uint32_t subnet : extra_nets) {
-            for (int host = 1; host <= 254; ++host) {
-                uint32_t ip_host = subnet | static_cast<uint32_t>(host);
-                sockaddr_in dest{};
-                dest.sin_family = AF_INET;
-                dest.sin_port = htons(VIRCOM_PORT);
-                dest.sin_addr.s_addr = htonl(ip_host);
-                send_search(sock, request, dest);
-            }
-            if (debug) {
-                portable::println("Sent 254 unicast probes to {}.{}.{}.1-254:{} (extra subnet)",
-                                  (subnet >> 24) & 0xFF, (subnet >> 16) & 0xFF,
-                                  (subnet >> 8) & 0xFF, VIRCOM_PORT);
-            }
+    std::vector<HostRange> sweep_ranges;
+    for (const auto& cidr : options.extra_subnets) {
+        HostRange range;
+        std::string error;
+        if (parse_sweep_range(cidr, range, error)) {
+            sweep_ranges.push_back(range);
+        } else if (debug) {
+            portable::println("Invalid extra subnet {}: {}", cidr, error);
         }
     }
 
@@ -554,7 +827,7 @@ std::vector<DiscoveredDevice> scan_network(int timeout_ms, bool debug,
     //    via hostname + DNS search domain, then unicast-sweep each /24 subnet.
     //    This is needed because WSL2's NAT prevents UDP broadcasts from
     //    reaching the physical LAN.  Unicast packets are NATed through.
-    if (is_wsl2()) {
+    if (!options.unicast_only && is_wsl2()) {
         auto host_subnets = discover_host_subnets(debug);
         if (!host_subnets.empty()) {
             if (debug) {
@@ -562,127 +835,249 @@ std::vector<DiscoveredDevice> scan_network(int timeout_ms, bool debug,
                                   host_subnets.size());
             }
             for (uint32_t subnet : host_subnets) {
-                // Send to .1 through .254 in each /24
-                for (int host = 1; host <= 254; ++host) {
-                    uint32_t ip_host = subnet | static_cast<uint32_t>(host);
-                    sockaddr_in dest{};
-                    dest.sin_family = AF_INET;
-                    dest.sin_port = htons(VIRCOM_PORT);
-                    dest.sin_addr.s_addr = htonl(ip_host);
-                    send_search(sock, request, dest);
-                }
-                if (debug) {
-                    portable::println("Sent 254 unicast probes to {}.{}.{}.1-254:{}",
-                                      (subnet >> 24) & 0xFF, (subnet >> 16) & 0xFF,
-                                      (subnet >> 8) & 0xFF, VIRCOM_PORT);
-                }
+                sweep_ranges.push_back({subnet | 1u, subnet | 254u});
             }
         } else if (debug) {
             portable::println("WSL2 detected but no additional subnets discovered via hostname resolution");
         }
     }
 
+    // Overlapping ranges are merged and hosts that already received a
+    // unicast probe are skipped, so no host is probed twice.  The sweep
+    // itself runs inside the receive loop below, interleaved with
+    // draining responses.
+    {
+        in_addr addr{};
+        if (!target_ip.empty() && inet_pton(AF_INET, target_ip.c_str(), &addr) == 1)
+            probed_hosts.push_back(ntohl(addr.s_addr));
+    }
+    std::sort(probed_hosts.begin(), probed_hosts.end());
+    auto merged_ranges = merge_ranges(std::move(sweep_ranges));
+    ProbeScheduler sweep(merged_ranges, options.probe_rate, probed_hosts);
+
     if (debug) {
+        for (const auto& r : merged_ranges) {
+            portable::println("Sweeping {}.{}.{}.{} - {}.{}.{}.{}:{}",
+                              (r.first >> 24) & 0xFF, (r.first >> 16) & 0xFF,
+                              (r.first >> 8) & 0xFF, r.first & 0xFF,
+                              (r.last >> 24) & 0xFF, (r.last >> 16) & 0xFF,
+                              (r.last >> 8) & 0xFF, r.last & 0xFF, VIRCOM_PORT);
+        }
+        if (sweep.total() > 0) {
+            portable::println("{} unicast probe(s) queued{}", sweep.total(),
+                              options.probe_rate > 0
+                                  ? std::format(", paced at {} probes/s", options.probe_rate)
+                                  : std::string{});
+        }
         portable::println("Waiting {} ms for responses ...", timeout_ms);
     }
 
-    // Set socket to non-blocking for the receive loop
+    // Set socket to non-blocking: sweep probes and responses share the loop
     set_socket_nonblocking(sock);
 
-    // Collect responses until timeout
+    // Collect responses until timeout.  The loop sleeps in the kernel until
+    // a datagram is queued, the next sweep probe is due or the deadline
+    // passes, then drains everything that has arrived before waiting again.
+    // The timeout runs from the last sweep probe, as if the sweep had been
+    // sent up front.
     auto start = std::chrono::steady_clock::now();
-    std::array<uint8_t, 512> recv_buf{};
+    auto listen_from = start;
+    auto last_probe_at = start;
+    ReceiveBatch batch;
+    size_t wakeups = 0;
+    size_t datagrams = 0;
+    bool done = false;
+
+    // Adaptive termination: once no new device has answered for a quiet
+    // window of QUIET_RTT_FACTOR times the slowest observed round trip
+    // (but at least MIN_QUIET_MS), further replies are unlikely.
+    constexpr long long QUIET_RTT_FACTOR = 4;
+    constexpr long long MIN_QUIET_MS = 200;
+    std::chrono::steady_clock::duration max_rtt{};
+    std::optional<std::chrono::steady_clock::time_point> last_new_device;
+
+    // Handle one received datagram.  Returns true when the scan is complete.
+    auto handle_datagram = [&](const uint8_t* data, size_t n, const sockaddr_in& sender_addr) {
+        if (n < VIRCOM_PACKET_SIZE) {
+            if (debug) {
+                portable::println("Ignoring short packet ({} bytes) from {}",
+                                  n, inet_ntoa(sender_addr.sin_addr));
+            }
+            return false;
+        }
 
-    while (true) {
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - start);
-        if (elapsed.count() >= timeout_ms) break;
+        DiscoveredDevice dev;
+        if (!parse_response(data, n, dev)) {
+            if (debug) {
+                portable::println("Failed to parse response from {}", inet_ntoa(sender_addr.sin_addr));
+            }
+            return false;
+        }
 
-        sockaddr_in sender_addr{};
-        socklen_t sender_len = sizeof(sender_addr);
+        // Use the sender's IP from the socket layer as canonical IP
+        // (in case the payload IP differs due to NAT or misconfiguration)
+        char sender_ip[INET_ADDRSTRLEN]{};
+        inet_ntop(AF_INET, &sender_addr.sin_addr, sender_ip, sizeof(sender_ip));
 
-        auto n = ::recvfrom(sock,
-                            reinterpret_cast<char*>(recv_buf.data()),
-                            static_cast<int>(recv_buf.size()),
-                            0,
-                            reinterpret_cast<sockaddr*>(&sender_addr),
-                            &sender_len);
+        if (is_duplicate_device(devices, dev)) return false;
 
-        if (n < 0) {
-            int err = get_last_socket_error();
-            if (would_block(err)) {
-                // No data yet — brief sleep to avoid busy-waiting
-                #ifdef _WIN32
-                    Sleep(10);
-                #else
-                    usleep(10000);
-                #endif
-                continue;
-            }
-            // When sweeping many hosts, ICMP "destination unreachable" causes
-            // ECONNREFUSED on Linux (or WSAECONNRESET on Windows).  These are
-            // transient and must not abort the receive loop.
-            #ifdef _WIN32
-            if (err == WSAECONNRESET || err == WSAECONNREFUSED) { continue; }
-            #else
-            if (err == ECONNREFUSED || err == ENETUNREACH || err == EHOSTUNREACH) { continue; }
-            #endif
-            // Genuine error
-            if (debug) {
-                portable::println("recvfrom error: {}", err);
-            }
-            break;
+        if (debug) {
+            portable::println("Received response from {} (payload IP: {})",
+                              sender_ip, dev.ip_address);
+            portable::println("  Device name: {}", dev.device_name);
+            portable::println("  Module ID:   {}", dev.module_id);
+            portable::println("  MAC:         {}", dev.mac_address);
+            portable::println("  Subnet:      {}", dev.subnet_mask);
+            portable::println("  Gateway:     {}", dev.gateway);
+            portable::println("  DNS:         {}", dev.dns_server);
+            portable::println("  IP mode:     {} ({})", dev.ip_mode,
+                              dev.ip_mode == 1 ? "DHCP" : "Static");
+            portable::println("  Parameters:  {}", dev.parameters);
         }
+        WAVESHARE_TRACE_INSTANT("response received", std::format("{} {}", dev.mac_address, sender_ip));
+        devices.push_back(std::move(dev));
 
-        if (n < static_cast<decltype(n)>(VIRCOM_PACKET_SIZE)) {
+        auto arrival = std::chrono::steady_clock::now();
+        max_rtt = std::max(max_rtt, arrival - last_probe_at);
+        last_new_device = arrival;
+
+        // Targeted discovery: the wanted device has answered, no
+        // need to sit out the rest of the timeout.
+        if (stop_when && stop_when(devices.back())) {
             if (debug) {
-                portable::println("Ignoring short packet ({} bytes) from {}",
-                                  n, inet_ntoa(sender_addr.sin_addr));
+                auto took = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start);
+                portable::println("Target {} answered after {} ms — ending scan early",
+                                  devices.back().mac_address, took.count());
+            }
+            return true;
+        }
+        return false;
+    };
+
+    while (!done) {
+        auto now = std::chrono::steady_clock::now();
+        if (!sweep.done()) {
+            auto sent_before = sweep.sent();
+            sweep.send_due(sock, request, now);
+            if (sweep.sent() != sent_before) {
+                last_probe_at = now;
+                WAVESHARE_TRACE_INSTANT("sweep probes sent", std::format("{} probe(s)", sweep.sent() - sent_before));
+            }
+            if (sweep.done()) {
+                listen_from = now;
+                if (debug) {
+                    auto us = sweep.duration_us();
+                    portable::println("Sent {}/{} unicast probes in {:.2f} ms ({:.0f} probes/s, {})",
+                                      sweep.sent(), sweep.total(), us / 1000.0,
+                                      us > 0 ? sweep.sent() * 1e6 / static_cast<double>(us) : 0.0,
+                                      WAVESHARE_HAVE_MMSG ? "sendmmsg" : "sendto");
+                }
             }
-            continue;
         }
 
-        DiscoveredDevice dev;
-        if (parse_response(recv_buf.data(), static_cast<size_t>(n), dev)) {
-            // Use the sender's IP from the socket layer as canonical IP
-            // (in case the payload IP differs due to NAT or misconfiguration)
-            char sender_ip[INET_ADDRSTRLEN]{};
-            inet_ntop(AF_INET, &sender_addr.sin_addr, sender_ip, sizeof(sender_ip));
-
-            // Avoid duplicates (same IP)
-            bool duplicate = false;
-            for (const auto& existing : devices) {
-                if (existing.ip_address == dev.ip_address) {
-                    duplicate = true;
+        int wait_ms = 0;
+        if (sweep.done()) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - listen_from);
+            if (elapsed.count() >= timeout_ms) break;
+            wait_ms = timeout_ms - static_cast<int>(elapsed.count());
+
+            if (options.adaptive && last_new_device) {
+                auto rtt_ms = std::chrono::duration_cast<std::chrono::milliseconds>(max_rtt).count();
+                auto quiet_ms = std::clamp<long long>(rtt_ms * QUIET_RTT_FACTOR, MIN_QUIET_MS, timeout_ms);
+                auto silent_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    now - *last_new_device).count();
+                if (silent_ms >= quiet_ms) {
+                    if (debug) {
+                        portable::println("Adaptive cut-off: no new device for {} ms (max RTT {} ms) "
+                                          "— ending scan after {} ms instead of {} ms",
+                                          quiet_ms, rtt_ms, elapsed.count(), timeout_ms);
+                    }
                     break;
                 }
+                wait_ms = std::min(wait_ms, static_cast<int>(quiet_ms - silent_ms));
             }
+        } else {
+            wait_ms = sweep.ms_until_next();
+        }
 
-            if (!duplicate) {
+        int ready = wait_readable(sock, wait_ms);
+        if (ready < 0) {
+            if (debug) {
+                portable::println("Waiting for responses failed: error {}", get_last_socket_error());
+            }
+            break;
+        }
+        if (ready == 0) continue;  // deadline reached or interrupted; re-check
+        ++wakeups;
+
+        while (!done) {
+            int received = receive_batch(sock, batch);
+            if (received == 0) break;  // queue drained
+            if (received < 0) {
+                int err = get_last_socket_error();
+                // When sweeping many hosts, ICMP "destination unreachable" causes
+                // ECONNREFUSED on Linux (or WSAECONNRESET on Windows).  These are
+                // transient and must not abort the receive loop.
+                #ifdef _WIN32
+                if (err == WSAECONNRESET || err == WSAECONNREFUSED) { continue; }
+                #else
+                if (err == ECONNREFUSED || err == ENETUNREACH || err == EHOSTUNREACH) { continue; }
+                #endif
+                // Genuine error
                 if (debug) {
-                    portable::println("Received response from {} (payload IP: {})",
-                                      sender_ip, dev.ip_address);
-                    portable::println("  Device name: {}", dev.device_name);
-                    portable::println("  Module ID:   {}", dev.module_id);
-                    portable::println("  MAC:         {}", dev.mac_address);
-                    portable::println("  Subnet:      {}", dev.subnet_mask);
-                    portable::println("  Gateway:     {}", dev.gateway);
-                    portable::println("  DNS:         {}", dev.dns_server);
-                    portable::println("  IP mode:     {} ({})", dev.ip_mode,
-                                      dev.ip_mode == 1 ? "DHCP" : "Static");
-                    portable::println("  Parameters:  {}", dev.parameters);
+                    portable::println("recvfrom error: {}", err);
                 }
-                devices.push_back(std::move(dev));
+                done = true;
+                break;
+            }
+
+            datagrams += static_cast<size_t>(received);
+            for (int i = 0; i < received && !done; ++i) {
+                done = handle_datagram(batch.buffers[i].data(), batch.lengths[i], batch.senders[i]);
             }
-        } else if (debug) {
-            portable::println("Failed to parse response from {}", inet_ntoa(sender_addr.sin_addr));
         }
     }
 
+    if (debug) {
+        portable::println("Receive loop: {} wakeup(s), {} datagram(s) received", wakeups, datagrams);
+    }
+
     close_socket(sock);
     return devices;
 }
 
+std::optional<DiscoveredDevice> probe_device(const std::string& ip,
+                                             const std::string& mac,
+                                             int timeout_ms,
+                                             bool debug)
+{
+    ScanOptions options;
+    options.timeout_ms   = timeout_ms;
+    options.debug        = debug;
+    options.target_ip    = ip;
+    options.unicast_only = true;
+    options.stop_when    = [&mac](const DiscoveredDevice& d) { return d.mac_address == mac; };
+
+    for (auto& d : scan_network(options)) {
+        if (d.mac_address == mac) return std::move(d);
+    }
+    return std::nullopt;
+}
+
+bool parse_vircom_response(const uint8_t* data, size_t len, DiscoveredDevice& dev)
+{
+    return parse_response(data, len, dev);
+}
+
+bool is_duplicate_device(const std::vector<DiscoveredDevice>& devices, const DiscoveredDevice& device)
+{
+    for (const auto& existing : devices) {
+        if (existing.ip_address == device.ip_address) return true;
+    }
+    return false;
+}
+
 std::string format_device_table(const std::vector<DiscoveredDevice>& devices)
 {
     if (devices.empty()) {
@@ -751,6 +1146,24 @@ std::string format_device_table(const std::vector<DiscoveredDevice>& devices)
     return out;
 }
 
+std::function<bool(const DiscoveredDevice&)> make_target_matcher(
+    const std::string& mac,
+    const std::string& name,
+    const std::string& ip)
+{
+    int id_count = (!mac.empty() ? 1 : 0) +
+                   (!name.empty() ? 1 : 0) +
+                   (!ip.empty() ? 1 : 0);
+    if (id_count != 1) return {};
+
+    if (!mac.empty())
+        return [mac](const DiscoveredDevice& d) { return d.mac_address == mac; };
+    // Names need not be unique: only the full scan shows whether another
+    // device carries the same one.
+    if (!name.empty()) return {};
+    return [ip](const DiscoveredDevice& d) { return d.ip_address == ip; };
+}
+
 const DiscoveredDevice* resolve_target_device(
     const std::vector<DiscoveredDevice>& devices,
     const std::string& mac,
@@ -844,136 +1257,511 @@ bool parse_ip_to_bytes(const std::string& ip_str, uint8_t* out)
     return true;
 }
 
-/// Send a 170-byte VirCom config packet via UDP broadcast AND unicast
-/// to the device's current IP (twice each, mirroring VirCom behaviour).
-/// The unicast path is essential on WSL2 where broadcasts don't cross
-/// the NAT boundary to the physical LAN.
-/// Returns true if at least one send succeeded.
-bool send_config_packet(const std::array<uint8_t, VIRCOM_PACKET_SIZE>& packet,
-                        const std::string& device_ip,
-                        bool debug)
-{
-#ifdef _WIN32
-    WinsockInit wsa_init;
-    if (!wsa_init.ok) {
-        portable::println(stderr, "Failed to initialize Winsock");
-        return false;
+/// Unanswered probes (or probe rounds) in a row that show a device went
+/// down to reboot; one lost datagram must not pass for a reboot.
+constexpr int SILENT_PROBES = 3;
+
+/// Acknowledged SET_CONFIG delivery to one device.
+///
+/// Sends the config packet, then probes the device with VirCom searches.
+/// The change counts as delivered when the device either answers with
+/// the new configuration, or stops answering (it reboots to apply it).
+/// If it keeps answering with the old configuration, the packet was lost
+/// and is sent again with a doubled confirmation window.  The first
+/// attempt goes to the device's address and the limited broadcast (for
+/// devices outside the host's subnet); retries add the directed
+/// broadcasts.
+///
+/// The sender owns no socket: the caller drives it from an event loop
+/// with service() and on_reply(), so many devices can share one socket.
+class ConfigSender {
+public:
+    using clock = std::chrono::steady_clock;
+
+    ConfigSender(const DiscoveredDevice& device,
+                 const std::array<uint8_t, VIRCOM_PACKET_SIZE>& packet,
+                 const ConfigDeliveryOptions& options)
+        : device_(device), packet_(packet), options_(options)
+    {
+        unicast_.sin_family = AF_INET;
+        unicast_.sin_port   = htons(VIRCOM_PORT);
+        has_unicast_ = inet_pton(AF_INET, device.ip_address.c_str(), &unicast_.sin_addr) == 1;
     }
-#endif
 
-    socket_t sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sock == INVALID_SOCK) {
-        portable::println(stderr, "Failed to create UDP socket: error {}",
-                          get_last_socket_error());
-        return false;
-    }
+    /// Send whatever is due at @p now (config packet or probe) and
+    /// update the confirmation state.
+    void service(socket_t sock, clock::time_point now)
+    {
+        if (finished_) return;
+        if (attempts_ == 0) started_at_ = now;
 
-    int broadcast_enable = 1;
-    ::setsockopt(sock, SOL_SOCKET, SO_BROADCAST,
-                 reinterpret_cast<const char*>(&broadcast_enable),
-                 sizeof(broadcast_enable));
+        if (attempts_ == 0 || now >= attempt_deadline_) {
+            if (attempts_ >= options_.max_attempts) {
+                finish(now, false);
+                return;
+            }
+            send_config(sock, now);
+        }
 
-    // Build the list of destinations: broadcast + unicast to device IP
-    std::vector<sockaddr_in> destinations;
+        if (now >= next_probe_at_) {
+            // Consecutive unanswered probes mean the device is rebooting.
+            if (probe_outstanding_ && ++unanswered_ >= SILENT_PROBES) {
+                went_silent_ = true;
+                finish(now, true);
+                return;
+            }
+            send_probe(sock);
+            next_probe_at_ = now + probe_interval_;
+        }
+    }
 
-    // 1. Limited broadcast
+    /// Feed a VirCom answer from this device.
+    void on_reply(const DiscoveredDevice& reply, clock::time_point now)
     {
-        sockaddr_in dest{};
-        dest.sin_family      = AF_INET;
-        dest.sin_addr.s_addr = INADDR_BROADCAST;
-        dest.sin_port        = htons(VIRCOM_PORT);
-        destinations.push_back(dest);
+        if (finished_ || attempts_ == 0) return;
+        probe_outstanding_ = false;
+        unanswered_ = 0;
+        if (diff_config_packet(reply, packet_).empty()) finish(now, true);
     }
 
-    // 2. Per-interface directed broadcasts
+    /// The device answered with its old configuration after the
+    /// confirmation: the SET_CONFIG was lost, or the silence was only
+    /// lost probes.  Resume sending; service() gives up once
+    /// max_attempts are used.
+    void resume(clock::time_point now)
     {
-        auto bcast_addrs = get_interface_broadcast_addresses();
-        for (const auto& baddr : bcast_addrs) {
-            sockaddr_in dest{};
-            dest.sin_family = AF_INET;
-            dest.sin_addr   = baddr;
-            dest.sin_port   = htons(VIRCOM_PORT);
-            destinations.push_back(dest);
-        }
+        finished_ = false;
+        went_silent_ = false;
+        result_.acknowledged = false;
+        result_.went_silent = false;
+        attempt_deadline_ = now;
+        next_probe_at_ = now;
+        probe_outstanding_ = false;
+        unanswered_ = 0;
     }
 
-    // 3. Unicast to the device's current IP (crucial for WSL2)
-    if (!device_ip.empty()) {
-        sockaddr_in dest{};
-        dest.sin_family = AF_INET;
-        dest.sin_port   = htons(VIRCOM_PORT);
-        if (inet_pton(AF_INET, device_ip.c_str(), &dest.sin_addr) == 1) {
-            destinations.push_back(dest);
-        }
+    bool finished() const { return finished_; }
+    const std::string& mac_address() const { return device_.mac_address; }
+
+    /// When service() next has something to do.
+    clock::time_point next_wake() const
+    {
+        return attempts_ == 0 ? clock::time_point{} : std::min(attempt_deadline_, next_probe_at_);
     }
 
-    bool ok = false;
-    // Send twice to each destination (VirCom sends the config packet
-    // twice for reliability)
-    for (int attempt = 0; attempt < 2; ++attempt) {
-        for (const auto& dest : destinations) {
+    ConfigDeliveryResult result() const { return result_; }
+
+private:
+    void send_to(socket_t sock, const std::array<uint8_t, VIRCOM_PACKET_SIZE>& data,
+                 const sockaddr_in& dest, const char* what)
+    {
+        ++result_.packets_sent;
+        auto sent = send_search(sock, data, dest);
+        if (options_.debug) {
             char ip_str[INET_ADDRSTRLEN]{};
             inet_ntop(AF_INET, &dest.sin_addr, ip_str, sizeof(ip_str));
-
-            auto sent = ::sendto(sock,
-                                 reinterpret_cast<const char*>(packet.data()),
-                                 static_cast<int>(packet.size()),
-                                 0,
-                                 reinterpret_cast<const sockaddr*>(&dest),
-                                 sizeof(dest));
-            if (sent > 0) {
-                ok = true;
-                if (debug) {
-                    portable::println("Sent SET_CONFIG packet ({} bytes) -> {}:{} [attempt {}]",
-                                      sent, ip_str, VIRCOM_PORT, attempt + 1);
-                }
-            } else if (debug) {
-                portable::println("Failed to send SET_CONFIG to {}: error {}",
-                                  ip_str, get_last_socket_error());
-            }
+            if (sent > 0)
+                portable::println("Sent {} ({} bytes) -> {}:{}", what, sent, ip_str, VIRCOM_PORT);
+            else
+                portable::println("Failed to send {} to {}: error {}", what, ip_str, get_last_socket_error());
         }
     }
 
-    close_socket(sock);
-    return ok;
-}
+    void send_config(socket_t sock, clock::time_point now)
+    {
+        ++attempts_;
+        result_.attempts = attempts_;
+        WAVESHARE_TRACE_INSTANT("SET_CONFIG attempt", std::format("{} attempt {}", device_.mac_address, attempts_));
+
+        std::vector<sockaddr_in> destinations;
+        if (has_unicast_) destinations.push_back(unicast_);
+        sockaddr_in bcast = unicast_;
+        bcast.sin_addr.s_addr = INADDR_BROADCAST;
+        destinations.push_back(bcast);
+        if (attempts_ > 1) {
+            for (const auto& baddr : get_interface_broadcast_addresses()) {
+                sockaddr_in dest = unicast_;
+                dest.sin_addr = baddr;
+                destinations.push_back(dest);
+            }
+        }
+        if (options_.debug && attempts_ > 1) {
+            portable::println("SET_CONFIG to {} not confirmed, retry {}/{}",
+                              device_.mac_address, attempts_ - 1, options_.max_attempts - 1);
+        }
+        for (const auto& dest : destinations) {
+            send_to(sock, packet_, dest, "SET_CONFIG");
+        }
+
+        int window_ms = options_.initial_timeout_ms << std::min(attempts_ - 1, 16);
+        window_ms = std::min(window_ms, options_.max_timeout_ms);
+        attempt_deadline_ = now + std::chrono::milliseconds(window_ms);
+        // Leave room for SILENT_PROBES + 1 probes inside the window.
+        probe_interval_ = std::chrono::milliseconds(std::max(50, window_ms / (SILENT_PROBES + 2)));
+        next_probe_at_ = now + probe_interval_;
+        probe_outstanding_ = false;
+        unanswered_ = 0;
+    }
+
+    void send_probe(socket_t sock)
+    {
+        static const auto request = build_search_request();
+        if (has_unicast_) {
+            send_to(sock, request, unicast_, "confirmation probe");
+        } else {
+            sockaddr_in bcast = unicast_;
+            bcast.sin_addr.s_addr = INADDR_BROADCAST;
+            send_to(sock, request, bcast, "confirmation probe");
+        }
+        probe_outstanding_ = true;
+    }
+
+    void finish(clock::time_point now, bool acknowledged)
+    {
+        WAVESHARE_TRACE_INSTANT(!acknowledged ? "SET_CONFIG not confirmed"
+                                : went_silent_ ? "SET_CONFIG confirmed (device silent)"
+                                               : "SET_CONFIG confirmed (read back)",
+                                device_.mac_address);
+        finished_ = true;
+        result_.acknowledged = acknowledged;
+        result_.went_silent  = went_silent_;
+        result_.elapsed_ms = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - started_at_).count());
+    }
+
+    DiscoveredDevice device_;
+    std::array<uint8_t, VIRCOM_PACKET_SIZE> packet_;
+    ConfigDeliveryOptions options_;
+    sockaddr_in unicast_{};
+    bool has_unicast_ = false;
+
+    int attempts_ = 0;
+    clock::time_point started_at_{};
+    clock::time_point attempt_deadline_{};
+    clock::time_point next_probe_at_{};
+    std::chrono::milliseconds probe_interval_{100};
+    bool probe_outstanding_ = false;
+    int unanswered_ = 0;
+    bool went_silent_ = false;
+    bool finished_ = false;
+    ConfigDeliveryResult result_;
+};
+
+/// Non-blocking TCP connect, used to find out when a rebooted device's
+/// Modbus TCP server accepts connections again.
+class ConnectProbe {
+public:
+    ConnectProbe() = default;
+    ConnectProbe(const ConnectProbe&) = delete;
+    ConnectProbe& operator=(const ConnectProbe&) = delete;
+    ~ConnectProbe() { reset(); }
+
+    /// Begin connecting to @p ip:@p port.  The attempt is pending until
+    /// the socket becomes writable; then call finish().
+    void start(const std::string& ip, uint16_t port, std::chrono::steady_clock::time_point now)
+    {
+        reset();
+        sockaddr_in dest{};
+        dest.sin_family = AF_INET;
+        dest.sin_port = htons(port);
+        if (inet_pton(AF_INET, ip.c_str(), &dest.sin_addr) != 1) return;
+
+        sock_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock_ == INVALID_SOCK) return;
+        set_socket_nonblocking(sock_);
+        started_at_ = now;
+        if (::connect(sock_, reinterpret_cast<const sockaddr*>(&dest), sizeof(dest)) == 0) return;
+        if (!connect_in_progress(get_last_socket_error())) reset();
+    }
+
+    /// Complete a pending attempt.  @return true if the connection was
+    /// established.  The socket is closed either way.
+    bool finish()
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        bool ok = sock_ != INVALID_SOCK &&
+                  ::getsockopt(sock_, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len) == 0 &&
+                  err == 0;
+        reset();
+        return ok;
+    }
+
+    void reset()
+    {
+        if (sock_ != INVALID_SOCK) close_socket(sock_);
+        sock_ = INVALID_SOCK;
+    }
+
+    bool pending() const { return sock_ != INVALID_SOCK; }
+    socket_t socket() const { return sock_; }
+    std::chrono::steady_clock::time_point started_at() const { return started_at_; }
+
+private:
+    socket_t sock_ = INVALID_SOCK;
+    std::chrono::steady_clock::time_point started_at_{};
+};
 
 } // anonymous namespace
 
-bool set_device_ip(const DiscoveredDevice& device,
-                   const std::string& new_ip,
-                   const std::string& new_mask,
-                   const std::string& new_gateway,
-                   const std::string& new_dns,
-                   bool debug)
+bool DeviceConfigChange::empty() const
+{
+    return !ip && !mask && !gateway && !dns && !dhcp && !modbus_tcp && !port && !name;
+}
+
+void DeviceConfigChange::merge(const DeviceConfigChange& later)
+{
+    // Switching to DHCP supersedes an earlier static address.
+    if (later.dhcp.value_or(false)) {
+        ip.reset();
+        mask.reset();
+        gateway.reset();
+        dns.reset();
+    }
+    if (later.ip)      ip      = later.ip;
+    if (later.mask)    mask    = later.mask;
+    if (later.gateway) gateway = later.gateway;
+    if (later.dns)     dns     = later.dns;
+    if (later.dhcp)    dhcp    = later.dhcp;
+    if (later.port)    port    = later.port;
+    if (later.name)    name    = later.name;
+    modbus_tcp = modbus_tcp || later.modbus_tcp;
+}
+
+std::string DeviceConfigChange::expected_ip() const
+{
+    if (dhcp.value_or(false)) return {};
+    return ip.value_or("");
+}
+
+std::string format_config_change(const DeviceConfigChange& change)
 {
+    std::vector<std::string> parts;
+    if (change.dhcp.value_or(false)) {
+        parts.push_back("DHCP");
+    } else if (change.ip) {
+        parts.push_back(std::format("static IP {}/{} gw {} dns {}",
+                                    *change.ip, change.mask.value_or("?"),
+                                    change.gateway.value_or("?"), change.dns.value_or("?")));
+    } else if (change.dhcp) {
+        parts.push_back("static IP");
+    }
+    if (change.modbus_tcp) parts.push_back("Modbus TCP server");
+    if (change.port)       parts.push_back(std::format("port {}", *change.port));
+    if (change.name)       parts.push_back(std::format("name '{}'", *change.name));
+
+    if (parts.empty()) return "no changes";
+    std::string out = parts[0];
+    for (size_t i = 1; i < parts.size(); ++i) {
+        out += ", ";
+        out += parts[i];
+    }
+    return out;
+}
+
+bool build_config_packet(const DiscoveredDevice& device,
+                         const DeviceConfigChange& change,
+                         std::array<uint8_t, VIRCOM_PACKET_SIZE>& packet)
+{
+    constexpr size_t MAX_NAME_LEN = 9;
+
     // Start from the device's raw VirCom response as template
-    auto packet = device.raw_response;
+    packet = device.raw_response;
 
     // Change command to SET_CONFIG
     packet[2] = VIRCOM_CMD_SET_CONFIG;
 
-    // Write new network settings
-    if (!parse_ip_to_bytes(new_ip,      &packet[0x03]) ||
-        !parse_ip_to_bytes(new_mask,    &packet[0x07]) ||
-        !parse_ip_to_bytes(new_gateway, &packet[0x0B]) ||
-        !parse_ip_to_bytes(new_dns,     &packet[0x0F])) {
-        portable::println(stderr, "Invalid IP address format");
-        return false;
+    // Network settings (IP 0x03, mask 0x07, gateway 0x0B, DNS 0x0F)
+    if (change.ip) {
+        if (!change.mask || !change.gateway || !change.dns) {
+            portable::println(stderr, "Static IP requires mask, gateway and DNS");
+            return false;
+        }
+        if (!parse_ip_to_bytes(*change.ip,      &packet[0x03]) ||
+            !parse_ip_to_bytes(*change.mask,    &packet[0x07]) ||
+            !parse_ip_to_bytes(*change.gateway, &packet[0x0B]) ||
+            !parse_ip_to_bytes(*change.dns,     &packet[0x0F])) {
+            portable::println(stderr, "Invalid IP address format");
+            return false;
+        }
     }
 
-    // Set Static mode
-    packet[0x3B] = 0x00;
+    // IP mode: 0 = Static, 1 = DHCP
+    if (change.dhcp) {
+        packet[0x3B] = *change.dhcp ? 0x01 : 0x00;
+    }
 
-    if (debug) {
-        portable::println("SET_CONFIG (Static IP) for device MAC {}:", device.mac_address);
-        portable::println("  IP:      {}", new_ip);
-        portable::println("  Mask:    {}", new_mask);
-        portable::println("  Gateway: {}", new_gateway);
-        portable::println("  DNS:     {}", new_dns);
+    if (change.modbus_tcp) {
+        // Transfer Protocol = Modbus TCP
+        packet[0x3A] = 0x03;
+        packet[0x3F] = 0x01;
+        packet[0x74] = 0x06;
+
+        // Work Mode = TCP Server
+        packet[0x17] = 0x00;
+    }
+
+    // Port (uint16 big-endian) at offset 0x13-0x14
+    if (change.port) {
+        packet[0x13] = static_cast<uint8_t>((*change.port >> 8) & 0xFF);
+        packet[0x14] = static_cast<uint8_t>(*change.port & 0xFF);
+    }
+
+    // Device name at offset 0x29 (9 bytes, null-padded)
+    if (change.name) {
+        const auto& name = *change.name;
+        if (name.empty()) {
+            portable::println(stderr, "Device name must not be empty");
+            return false;
+        }
+        if (name.size() > MAX_NAME_LEN) {
+            portable::println(stderr, "Device name '{}' is too long ({} chars, max {})",
+                              name, name.size(), MAX_NAME_LEN);
+            return false;
+        }
+        std::memset(&packet[0x29], 0, MAX_NAME_LEN);
+        std::memcpy(&packet[0x29], name.data(), name.size());
+    }
+
+    return true;
+}
+
+std::vector<ConfigByteDiff> diff_config_packet(const DiscoveredDevice& device,
+                                               const std::array<uint8_t, VIRCOM_PACKET_SIZE>& packet)
+{
+    std::vector<ConfigByteDiff> diff;
+    for (size_t i = 0; i < packet.size(); ++i) {
+        if (i == 2) continue;  // command byte: response vs. SET_CONFIG
+        if (packet[i] != device.raw_response[i])
+            diff.push_back({i, device.raw_response[i], packet[i]});
     }
+    return diff;
+}
+
+std::string format_config_diff(const std::vector<ConfigByteDiff>& diff)
+{
+    auto field_name = [](size_t offset) -> const char* {
+        if (offset >= 0x03 && offset <= 0x06) return "ip";
+        if (offset >= 0x07 && offset <= 0x0A) return "mask";
+        if (offset >= 0x0B && offset <= 0x0E) return "gateway";
+        if (offset >= 0x0F && offset <= 0x12) return "dns";
+        if (offset == 0x13 || offset == 0x14) return "port";
+        if (offset == 0x17) return "work mode";
+        if (offset >= 0x29 && offset <= 0x31) return "name";
+        if (offset == 0x3A || offset == 0x3F || offset == 0x74) return "protocol";
+        if (offset == 0x3B) return "ip mode";
+        return "";
+    };
 
-    return send_config_packet(packet, device.ip_address, debug);
+    std::string out;
+    for (const auto& d : diff) {
+        if (!out.empty()) out += '\n';
+        out += std::format("  0x{:02X} {:<10} 0x{:02X} -> 0x{:02X}",
+                           d.offset, field_name(d.offset), d.before, d.after);
+    }
+    return out;
+}
+
+ConfigDeliveryResult deliver_device_config(const DiscoveredDevice& device,
+                                           const DeviceConfigChange& change,
+                                           const ConfigDeliveryOptions& options)
+{
+    using clock = std::chrono::steady_clock;
+
+    OpTimer timer(StatOp::SET_CONFIG);
+    ConfigDeliveryResult result;
+    std::array<uint8_t, VIRCOM_PACKET_SIZE> packet{};
+    if (!build_config_packet(device, change, packet)) {
+        timer.fail();
+        return result;
+    }
+
+    if (options.debug) {
+        portable::println("SET_CONFIG for device MAC {}: {}",
+                          device.mac_address, format_config_change(change));
+    }
+
+#ifdef _WIN32
+    WinsockInit wsa_init;
+    if (!wsa_init.ok) {
+        portable::println(stderr, "Failed to initialize Winsock");
+        timer.fail();
+        return result;
+    }
+#endif
+
+    socket_t sock = open_vircom_socket();
+    if (sock == INVALID_SOCK) {
+        timer.fail();
+        return result;
+    }
+    set_socket_nonblocking(sock);
+
+    ConfigSender sender(device, packet, options);
+    ReceiveBatch batch;
+    while (true) {
+        auto now = clock::now();
+        sender.service(sock, now);
+        if (sender.finished()) break;
+
+        int wait_ms = static_cast<int>(std::max<long long>(
+            1, std::chrono::duration_cast<std::chrono::milliseconds>(sender.next_wake() - now).count()));
+        int ready = wait_readable(sock, wait_ms);
+        if (ready < 0) break;
+        if (ready == 0) continue;
+
+        now = clock::now();
+        int received;
+        while ((received = receive_batch(sock, batch)) > 0) {
+            for (int i = 0; i < received; ++i) {
+                DiscoveredDevice reply;
+                if (!parse_response(batch.buffers[i].data(), batch.lengths[i], reply)) continue;
+                if (reply.mac_address == device.mac_address) sender.on_reply(reply, now);
+            }
+        }
+    }
+    close_socket(sock);
+
+    result = sender.result();
+    if (options.debug) {
+        portable::println("SET_CONFIG to {}: {} after {} attempt(s), {} packet(s), {} ms",
+                          device.mac_address,
+                          !result.acknowledged ? "not confirmed"
+                          : result.went_silent ? "confirmed (device rebooting)"
+                                               : "confirmed (read back)",
+                          result.attempts, result.packets_sent, result.elapsed_ms);
+    }
+    if (!result.acknowledged) {
+        timer.fail();
+        portable::println(stderr, "Device {} did not confirm the configuration after {} attempt(s).",
+                          device.mac_address, result.attempts);
+    }
+    return result;
+}
+
+bool apply_device_config(const DiscoveredDevice& device,
+                         const DeviceConfigChange& change,
+                         bool debug)
+{
+    ConfigDeliveryOptions options;
+    options.debug = debug;
+    return deliver_device_config(device, change, options).acknowledged;
+}
+
+bool set_device_ip(const DiscoveredDevice& device,
+                   const std::string& new_ip,
+                   const std::string& new_mask,
+                   const std::string& new_gateway,
+                   const std::string& new_dns,
+                   bool debug)
+{
+    DeviceConfigChange change;
+    change.ip      = new_ip;
+    change.mask    = new_mask;
+    change.gateway = new_gateway;
+    change.dns     = new_dns;
+    change.dhcp    = false;
+    return apply_device_config(device, change, debug);
 }
 
 std::optional<DiscoveredDevice> wait_for_device_reboot(
@@ -981,72 +1769,545 @@ std::optional<DiscoveredDevice> wait_for_device_reboot(
     int wait_timeout_ms,
     bool debug)
 {
+    RebootWatchOptions options;
+    options.wait_timeout_ms = wait_timeout_ms;
+    options.debug = debug;
+    return wait_for_device_reboot(mac_address, options);
+}
+
+std::optional<DiscoveredDevice> wait_for_device_reboot(
+    const std::string& mac_address,
+    const RebootWatchOptions& options)
+{
+    using clock = std::chrono::steady_clock;
+    using std::chrono::milliseconds;
+
+    const bool debug = options.debug;
+    const int wait_timeout_ms = options.wait_timeout_ms;
+    OpTimer timer(StatOp::REBOOT_WAIT);
+
     portable::println("Waiting for device {} to reappear (timeout {}s) ...",
                       mac_address, wait_timeout_ms / 1000);
 
-    auto start = std::chrono::steady_clock::now();
-    constexpr int SCAN_INTERVAL_MS = 3000;
+#ifdef _WIN32
+    WinsockInit wsa_init;
+    if (!wsa_init.ok) {
+        portable::println(stderr, "Failed to initialize Winsock");
+        timer.fail();
+        return std::nullopt;
+    }
+#endif
+
+    // Probe timing: fast until the device has been seen silent, so a quick
+    // reboot is noticed within a second, then back off to spare the network.
+    constexpr auto FIRST_PROBE_INTERVAL = milliseconds(250);
+    constexpr auto MAX_PROBE_INTERVAL   = milliseconds(2000);
+    // A reply only proves a reboot once the device has been seen silent.
+    // If it came back between two probes, accept replies after this long.
+    constexpr auto SETTLE_TIME          = milliseconds(3000);
+    // Give up on a hanging connect() and retry after this long.
+    constexpr auto CONNECT_TIMEOUT      = milliseconds(1000);
+    constexpr auto CONNECT_RETRY        = milliseconds(250);
+
+    socket_t sock = open_vircom_socket();
+    if (sock == INVALID_SOCK) {
+        timer.fail();
+        return std::nullopt;
+    }
+    set_socket_nonblocking(sock);
+
+    // Unicast targets: the address from the SET_CONFIG payload and the
+    // address before the change, plus all broadcasts.
+    std::vector<sockaddr_in> targets;
+    auto add_target = [&targets](const std::string& ip) {
+        sockaddr_in dest{};
+        dest.sin_family = AF_INET;
+        dest.sin_port = htons(VIRCOM_PORT);
+        if (ip.empty() || inet_pton(AF_INET, ip.c_str(), &dest.sin_addr) != 1) return;
+        for (const auto& t : targets) {
+            if (t.sin_addr.s_addr == dest.sin_addr.s_addr) return;
+        }
+        targets.push_back(dest);
+    };
+    add_target(options.expected_ip);
+    add_target(options.previous_ip);
+    add_target("255.255.255.255");
+    for (const auto& baddr : get_interface_broadcast_addresses()) {
+        char ip_str[INET_ADDRSTRLEN]{};
+        inet_ntop(AF_INET, &baddr, ip_str, sizeof(ip_str));
+        add_target(ip_str);
+    }
+
+    const auto request = build_search_request();
+    const bool want_modbus = options.modbus_port != 0;
+
+    auto start = clock::now();
+    auto deadline = start + milliseconds(wait_timeout_ms);
+    auto next_probe_at = start;
+    auto probe_interval = FIRST_PROBE_INTERVAL;
+    auto since_start = [&start](clock::time_point t) {
+        return std::chrono::duration_cast<milliseconds>(t - start).count();
+    };
+
+    size_t rounds = 0;
+    int unanswered_rounds = 0;
+    bool round_answered = false;
+    bool seen_silent = options.already_silent;
+    std::optional<DiscoveredDevice> found;
+
+    ConnectProbe modbus_probe;
+    bool modbus_ready = false;
+    auto next_connect_at = start;
+
+    ReceiveBatch batch;
 
     while (true) {
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - start);
-        if (elapsed.count() >= wait_timeout_ms) break;
+        auto now = clock::now();
+        if (now >= deadline) break;
+
+        // Probe round.  SILENT_PROBES unanswered rounds in a row mean the
+        // device is down.
+        if (!found && now >= next_probe_at) {
+            unanswered_rounds = rounds > 0 && !round_answered ? unanswered_rounds + 1 : 0;
+            if (unanswered_rounds >= SILENT_PROBES && !seen_silent) {
+                seen_silent = true;
+                WAVESHARE_TRACE_INSTANT("device silent", mac_address);
+                if (debug) {
+                    portable::println("Device {} went silent after {} ms", mac_address, since_start(now));
+                }
+            }
+            for (const auto& dest : targets) {
+                send_search(sock, request, dest);
+            }
+            ++rounds;
+            round_answered = false;
+            next_probe_at = now + probe_interval;
+            if (seen_silent) probe_interval = std::min(probe_interval * 2, MAX_PROBE_INTERVAL);
+        }
 
-        // Brief pause before scanning to let the device reboot
-        #ifdef _WIN32
-            Sleep(SCAN_INTERVAL_MS);
-        #else
-            usleep(static_cast<useconds_t>(SCAN_INTERVAL_MS) * 1000);
-        #endif
+        const bool rebooted = seen_silent || now - start >= SETTLE_TIME;
 
-        if (debug) {
-            portable::println("Scanning for device {} ({:.0f}s / {:.0f}s) ...",
-                              mac_address,
-                              elapsed.count() / 1000.0,
-                              wait_timeout_ms / 1000.0);
+        // Race a Modbus TCP connect against the VirCom answer.
+        if (want_modbus && !modbus_ready) {
+            if (modbus_probe.pending() && now - modbus_probe.started_at() >= CONNECT_TIMEOUT) {
+                modbus_probe.reset();
+                next_connect_at = now;
+            }
+            std::string modbus_ip = !options.expected_ip.empty() ? options.expected_ip
+                                  : found ? found->ip_address : options.previous_ip;
+            if (rebooted && !modbus_probe.pending() && now >= next_connect_at && !modbus_ip.empty()) {
+                modbus_probe.start(modbus_ip, options.modbus_port, now);
+                next_connect_at = now + CONNECT_RETRY;
+            }
         }
 
-        auto found = scan_network(SCAN_INTERVAL_MS, debug);
+        auto wake_at = deadline;
+        if (!found) wake_at = std::min(wake_at, next_probe_at);
+        if (want_modbus && !modbus_ready) {
+            if (modbus_probe.pending())
+                wake_at = std::min(wake_at, modbus_probe.started_at() + CONNECT_TIMEOUT);
+            else if (!rebooted)
+                wake_at = std::min(wake_at, start + SETTLE_TIME);
+            else if (next_connect_at > now)
+                wake_at = std::min(wake_at, next_connect_at);
+        }
+        int wait_ms = static_cast<int>(std::max<long long>(
+            1, std::chrono::duration_cast<milliseconds>(wake_at - now).count()));
 
-        for (const auto& d : found) {
-            if (d.mac_address == mac_address) {
-                portable::println("Device {} reappeared at {} ({})",
-                                  d.mac_address, d.ip_address,
-                                  d.ip_mode == 1 ? "DHCP" : "Static");
-                return d;
+        bool readable = false;
+        bool writable = false;
+        if (wait_read_write(sock, modbus_probe.socket(), wait_ms, readable, writable) < 0) {
+            if (debug) {
+                portable::println("Waiting for device failed: error {}", get_last_socket_error());
+            }
+            break;
+        }
+        now = clock::now();
+
+        if (writable) {
+            if (modbus_probe.finish()) {
+                modbus_ready = true;
+                WAVESHARE_TRACE_INSTANT("Modbus TCP accepting", mac_address);
+                portable::println("Modbus TCP port {} of device {} is accepting connections ({} ms)",
+                                  options.modbus_port, mac_address, since_start(now));
+            } else {
+                next_connect_at = now + CONNECT_RETRY;
             }
         }
+
+        while (readable) {
+            int received = receive_batch(sock, batch);
+            if (received <= 0) break;  // drained (transient ICMP errors included)
+            for (int i = 0; i < received; ++i) {
+                DiscoveredDevice dev;
+                if (!parse_response(batch.buffers[i].data(), batch.lengths[i], dev)) continue;
+                if (dev.mac_address != mac_address) continue;
+                round_answered = true;
+
+                // Before the device has visibly rebooted, only a reply that
+                // already carries the new address proves the change.
+                bool moved = !options.expected_ip.empty() &&
+                             options.expected_ip != options.previous_ip &&
+                             dev.ip_address == options.expected_ip;
+                if (!found && (seen_silent || now - start >= SETTLE_TIME || moved)) {
+                    if (debug) {
+                        portable::println("VirCom answer from {} after {} ms", dev.ip_address, since_start(now));
+                    }
+                    WAVESHARE_TRACE_INSTANT("VirCom answer", std::format("{} {}", dev.mac_address, dev.ip_address));
+                    found = std::move(dev);
+                }
+            }
+        }
+
+        if (found && (!want_modbus || modbus_ready)) {
+            WAVESHARE_TRACE_INSTANT("device reappeared", std::format("{} {}", found->mac_address, found->ip_address));
+            close_socket(sock);
+            portable::println("Device {} reappeared at {} ({})",
+                              found->mac_address, found->ip_address,
+                              found->ip_mode == 1 ? "DHCP" : "Static");
+            if (debug) {
+                portable::println("Reboot detected after {} ms ({} probe round(s))",
+                                  since_start(now), rounds);
+            }
+            return found;
+        }
     }
 
-    portable::println(stderr, "Timeout: device {} did not reappear within {}s.",
-                      mac_address, wait_timeout_ms / 1000);
+    close_socket(sock);
+    if (found) {
+        portable::println(stderr, "Timeout: device {} answers VirCom at {} but Modbus TCP port {} "
+                                  "did not accept connections within {}s.",
+                          mac_address, found->ip_address, options.modbus_port, wait_timeout_ms / 1000);
+    } else {
+        portable::println(stderr, "Timeout: device {} did not reappear within {}s.",
+                          mac_address, wait_timeout_ms / 1000);
+    }
+    timer.fail();
     return std::nullopt;
 }
 
-std::vector<DiscoveredDevice> set_device_dhcp(
-    const DiscoveredDevice& device,
-    int wait_timeout_ms,
-    bool debug)
+std::vector<ProvisionOutcome> provision_devices(const std::vector<ProvisionTarget>& targets,
+                                                const ConfigDeliveryOptions& delivery,
+                                                int wait_timeout_ms)
 {
-    // Start from the device's raw VirCom response as template
-    auto packet = device.raw_response;
+    using clock = std::chrono::steady_clock;
+    using std::chrono::milliseconds;
+
+    // Same reboot detection as wait_for_device_reboot(), per device.
+    constexpr auto FIRST_PROBE_INTERVAL = milliseconds(250);
+    constexpr auto MAX_PROBE_INTERVAL   = milliseconds(2000);
+    constexpr auto SETTLE_TIME          = milliseconds(3000);
+
+    const bool debug = delivery.debug;
+    std::vector<ProvisionOutcome> outcomes(targets.size());
+
+    struct Slot {
+        std::optional<ConfigSender> sender;   ///< SET_CONFIG delivery (kept to resume it)
+        std::array<uint8_t, VIRCOM_PACKET_SIZE> packet{};  ///< The SET_CONFIG sent
+        bool watching = false;                ///< Confirmed, waiting for the reboot
+        bool done = false;
+        std::string expected_ip;
+        std::vector<sockaddr_in> unicast;     ///< Expected and previous address
+        clock::time_point confirmed_at{};
+        clock::time_point next_probe_at{};
+        milliseconds probe_interval{};
+        size_t rounds = 0;
+        int unanswered_rounds = 0;
+        bool round_answered = false;
+        bool seen_silent = false;
+    };
+    std::vector<Slot> slots(targets.size());
+    std::unordered_map<std::string, size_t> by_mac;
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+        const auto& t = targets[i];
+        outcomes[i].mac_address = t.device.mac_address;
+        outcomes[i].device = t.device;
+        by_mac[t.device.mac_address] = i;
+
+        std::array<uint8_t, VIRCOM_PACKET_SIZE> packet{};
+        if (!build_config_packet(t.device, t.change, packet)) {
+            outcomes[i].status = ProvisionStatus::INVALID;
+            slots[i].done = true;
+            continue;
+        }
+        slots[i].sender.emplace(t.device, packet, delivery);
+        slots[i].packet = packet;
+        slots[i].expected_ip = t.change.expected_ip();
+        for (const auto& ip : {slots[i].expected_ip, t.device.ip_address}) {
+            sockaddr_in dest{};
+            dest.sin_family = AF_INET;
+            dest.sin_port = htons(VIRCOM_PORT);
+            if (ip.empty() || inet_pton(AF_INET, ip.c_str(), &dest.sin_addr) != 1) continue;
+            if (!slots[i].unicast.empty() && slots[i].unicast[0].sin_addr.s_addr == dest.sin_addr.s_addr) continue;
+            slots[i].unicast.push_back(dest);
+        }
+    }
 
-    // Change command to SET_CONFIG
-    packet[2] = VIRCOM_CMD_SET_CONFIG;
+#ifdef _WIN32
+    WinsockInit wsa_init;
+    if (!wsa_init.ok) {
+        portable::println(stderr, "Failed to initialize Winsock");
+        return outcomes;
+    }
+#endif
+
+    socket_t sock = open_vircom_socket();
+    if (sock == INVALID_SOCK) return outcomes;
+    set_socket_nonblocking(sock);
+
+    // Broadcast rounds find devices that come back at an unknown address
+    // (DHCP); they back off independently of the per-device probes.
+    std::vector<sockaddr_in> broadcasts;
+    {
+        sockaddr_in dest{};
+        dest.sin_family = AF_INET;
+        dest.sin_port = htons(VIRCOM_PORT);
+        dest.sin_addr.s_addr = INADDR_BROADCAST;
+        broadcasts.push_back(dest);
+        for (const auto& baddr : get_interface_broadcast_addresses()) {
+            dest.sin_addr = baddr;
+            broadcasts.push_back(dest);
+        }
+    }
+    auto next_broadcast_at = clock::time_point::max();
+    auto broadcast_interval = FIRST_PROBE_INTERVAL;
+
+    const auto request = build_search_request();
+    const auto start = clock::now();
+    size_t finished = 0;
+    auto ms_between = [](clock::time_point a, clock::time_point b) {
+        return static_cast<int>(std::chrono::duration_cast<milliseconds>(b - a).count());
+    };
+    auto complete = [&](size_t i, ProvisionStatus status) {
+        slots[i].done = true;
+        slots[i].watching = false;
+        outcomes[i].status = status;
+        ++finished;
+    };
+
+    ReceiveBatch batch;
+    while (true) {
+        auto now = clock::now();
+        auto wake_at = clock::time_point::max();
+        size_t active = 0;
+
+        for (size_t i = 0; i < slots.size(); ++i) {
+            auto& slot = slots[i];
+            if (slot.done) continue;
+            ++active;
+
+            if (!slot.watching) {
+                slot.sender->service(sock, now);
+                if (!slot.sender->finished()) {
+                    wake_at = std::min(wake_at, slot.sender->next_wake());
+                    continue;
+                }
+                outcomes[i].delivery = slot.sender->result();
+                if (!outcomes[i].delivery.acknowledged) {
+                    complete(i, ProvisionStatus::CONFIG_FAILED);
+                    --active;
+                    continue;
+                }
+                slot.watching = true;
+                slot.seen_silent = outcomes[i].delivery.went_silent;
+                slot.confirmed_at = now;
+                slot.next_probe_at = now;
+                slot.probe_interval = FIRST_PROBE_INTERVAL;
+                next_broadcast_at = now;
+                broadcast_interval = FIRST_PROBE_INTERVAL;
+                if (debug) {
+                    portable::println("{}: configuration confirmed after {} ms, waiting for reboot",
+                                      outcomes[i].mac_address, outcomes[i].delivery.elapsed_ms);
+                }
+            }
 
-    // Set DHCP mode
-    packet[0x3B] = 0x01;
+            if (now - slot.confirmed_at >= milliseconds(wait_timeout_ms)) {
+                complete(i, ProvisionStatus::REBOOT_TIMEOUT);
+                --active;
+                continue;
+            }
+            if (now >= slot.next_probe_at) {
+                slot.unanswered_rounds = slot.rounds > 0 && !slot.round_answered ? slot.unanswered_rounds + 1 : 0;
+                if (slot.unanswered_rounds >= SILENT_PROBES) slot.seen_silent = true;
+                for (const auto& dest : slot.unicast) {
+                    send_search(sock, request, dest);
+                }
+                ++slot.rounds;
+                slot.round_answered = false;
+                slot.next_probe_at = now + slot.probe_interval;
+                if (slot.seen_silent)
+                    slot.probe_interval = std::min(slot.probe_interval * 2, MAX_PROBE_INTERVAL);
+            }
+            wake_at = std::min({wake_at, slot.next_probe_at,
+                                slot.confirmed_at + milliseconds(wait_timeout_ms)});
+        }
+        if (active == 0) break;
 
+        if (now >= next_broadcast_at) {
+            for (const auto& dest : broadcasts) {
+                send_search(sock, request, dest);
+            }
+            next_broadcast_at = now + broadcast_interval;
+            broadcast_interval = std::min(broadcast_interval * 2, MAX_PROBE_INTERVAL);
+        }
+        wake_at = std::min(wake_at, next_broadcast_at);
+
+        int wait_ms = static_cast<int>(std::max<long long>(
+            1, std::chrono::duration_cast<milliseconds>(wake_at - now).count()));
+        int ready = wait_readable(sock, wait_ms);
+        if (ready < 0) {
+            if (debug) {
+                portable::println("Provisioning wait failed: error {}", get_last_socket_error());
+            }
+            break;
+        }
+        if (ready == 0) continue;
+
+        now = clock::now();
+        int received;
+        while ((received = receive_batch(sock, batch)) > 0) {
+            for (int r = 0; r < received; ++r) {
+                DiscoveredDevice reply;
+                if (!parse_response(batch.buffers[r].data(), batch.lengths[r], reply)) continue;
+                auto it = by_mac.find(reply.mac_address);
+                if (it == by_mac.end()) continue;
+                size_t i = it->second;
+                auto& slot = slots[i];
+                if (slot.done) continue;
+                if (!slot.watching) {
+                    slot.sender->on_reply(reply, now);
+                    continue;
+                }
+                slot.round_answered = true;
+
+                // Before the reboot shows, only a reply that already carries
+                // the new address proves the change; anything else may come
+                // from the pre-reboot firmware and is ignored.
+                bool rebooted = slot.seen_silent || now - slot.confirmed_at >= SETTLE_TIME;
+                bool moved = !slot.expected_ip.empty() &&
+                             slot.expected_ip != targets[i].device.ip_address &&
+                             reply.ip_address == slot.expected_ip;
+                if (diff_config_packet(reply, slot.packet).empty()) {
+                    if (!rebooted && !moved) continue;
+                    outcomes[i].reboot_ms = ms_between(slot.confirmed_at, now);
+                    outcomes[i].device = std::move(reply);
+                    complete(i, ProvisionStatus::CONFIGURED);
+                    portable::println("[{}/{}] {} is back at {} ({} ms after confirmation)",
+                                      finished, targets.size(), outcomes[i].mac_address,
+                                      outcomes[i].device.ip_address, outcomes[i].reboot_ms);
+                    continue;
+                }
+                if (!rebooted) continue;
+
+                // Back with its old configuration: the change never took,
+                // so send it again while attempts are left (the sender
+                // fails the device once they are used up).
+                if (diff_config_packet(reply, targets[i].device.raw_response).empty()) {
+                    if (debug) {
+                        portable::println("{}: still has its old configuration, resending",
+                                          outcomes[i].mac_address);
+                    }
+                    slot.watching = false;
+                    slot.rounds = 0;
+                    slot.unanswered_rounds = 0;
+                    slot.seen_silent = false;
+                    slot.sender->resume(now);
+                    continue;
+                }
+
+                // Neither the old nor the requested configuration.
+                outcomes[i].device = std::move(reply);
+                complete(i, ProvisionStatus::CONFIG_FAILED);
+                portable::println("[{}/{}] {} came back with a configuration other than the one sent",
+                                  finished, targets.size(), outcomes[i].mac_address);
+            }
+        }
+    }
+    close_socket(sock);
+
+    // Anything still pending (socket failure) counts as not confirmed.
+    for (size_t i = 0; i < slots.size(); ++i) {
+        if (slots[i].done) continue;
+        outcomes[i].delivery = slots[i].sender->result();
+        outcomes[i].status = slots[i].watching ? ProvisionStatus::REBOOT_TIMEOUT
+                                               : ProvisionStatus::CONFIG_FAILED;
+    }
     if (debug) {
-        portable::println("SET_CONFIG (DHCP) for device MAC {}:", device.mac_address);
+        portable::println("Provisioned {} device(s) in {} ms", targets.size(), ms_between(start, clock::now()));
     }
+    return outcomes;
+}
+
+std::string format_provision_table(const std::vector<ProvisionOutcome>& outcomes)
+{
+    auto status_text = [](ProvisionStatus status) -> const char* {
+        switch (status) {
+        case ProvisionStatus::CONFIGURED:         return "configured";
+        case ProvisionStatus::ALREADY_CONFIGURED: return "already configured";
+        case ProvisionStatus::NOT_FOUND:          return "not found";
+        case ProvisionStatus::INVALID:            return "invalid";
+        case ProvisionStatus::CONFIG_FAILED:      return "config failed";
+        case ProvisionStatus::REBOOT_TIMEOUT:     return "reboot timeout";
+        }
+        return "unknown";
+    };
+
+    size_t w_mac    = 17;  // "MAC Address"
+    size_t w_name   = 11;  // "Device Name"
+    size_t w_ip     = 15;  // "IP Address"
+    size_t w_status = 18;  // "already configured"
+    for (const auto& o : outcomes) {
+        w_name = std::max(w_name, o.device.device_name.size());
+        w_ip   = std::max(w_ip,   o.device.ip_address.size());
+    }
+
+    std::string out;
+    out += std::format("{:<{}}  {:<{}}  {:<{}}  {:<{}}  {:>8}  {:>9}  {:>9}\n",
+                       "MAC Address", w_mac, "Device Name", w_name, "IP Address", w_ip,
+                       "Status", w_status, "Attempts", "Config ms", "Reboot ms");
+    out += std::string(w_mac, '-') + "  " + std::string(w_name, '-') + "  " +
+           std::string(w_ip, '-') + "  " + std::string(w_status, '-') + "  " +
+           std::string(8, '-') + "  " + std::string(9, '-') + "  " + std::string(9, '-') + "\n";
+
+    size_t ok = 0;
+    for (const auto& o : outcomes) {
+        bool sent = o.delivery.attempts > 0;
+        bool rebooted = o.status == ProvisionStatus::CONFIGURED;
+        if (rebooted || o.status == ProvisionStatus::ALREADY_CONFIGURED) ++ok;
+        out += std::format("{:<{}}  {:<{}}  {:<{}}  {:<{}}  {:>8}  {:>9}  {:>9}\n",
+                           o.mac_address, w_mac, o.device.device_name, w_name,
+                           o.device.ip_address, w_ip, status_text(o.status), w_status,
+                           sent ? std::to_string(o.delivery.attempts) : "-",
+                           sent ? std::to_string(o.delivery.elapsed_ms) : "-",
+                           rebooted ? std::to_string(o.reboot_ms) : "-");
+    }
+    out += std::format("\n{} of {} device(s) provisioned.\n", ok, outcomes.size());
+    return out;
+}
 
-    if (!send_config_packet(packet, device.ip_address, debug)) {
+std::vector<DiscoveredDevice> set_device_dhcp(
+    const DiscoveredDevice& device,
+    int wait_timeout_ms,
+    bool debug)
+{
+    if (device.ip_mode == 0x01) {
+        portable::println("Device {} is already in DHCP mode.", device.mac_address);
+        return {device};
+    }
+
+    DeviceConfigChange change;
+    change.dhcp = true;
+    if (!apply_device_config(device, change, debug)) {
         portable::println(stderr, "Failed to send SET_CONFIG packet");
         return {};
     }
 
-    auto result = wait_for_device_reboot(device.mac_address, wait_timeout_ms, debug);
+    RebootWatchOptions watch;
+    watch.wait_timeout_ms = wait_timeout_ms;
+    watch.debug = debug;
+    watch.previous_ip = device.ip_address;
+    auto result = wait_for_device_reboot(device.mac_address, watch);
     if (result) {
         return {*result};
     }
@@ -1057,88 +2318,28 @@ bool set_device_modbus_tcp(const DiscoveredDevice& device,
                            uint16_t port,
                            bool debug)
 {
-    // Start from the device's raw VirCom response as template
-    auto packet = device.raw_response;
-
-    // Change command to SET_CONFIG
-    packet[2] = VIRCOM_CMD_SET_CONFIG;
-
-    // Transfer Protocol = Modbus TCP
-    packet[0x3A] = 0x03;
-    packet[0x3F] = 0x01;
-    packet[0x74] = 0x06;
-
-    // Work Mode = TCP Server
-    packet[0x17] = 0x00;
-
-    // Port (uint16 big-endian)
-    packet[0x13] = static_cast<uint8_t>((port >> 8) & 0xFF);
-    packet[0x14] = static_cast<uint8_t>(port & 0xFF);
-
-    if (debug) {
-        portable::println("SET_CONFIG (Modbus TCP) for device MAC {}:", device.mac_address);
-        portable::println("  Transfer Protocol: Modbus TCP");
-        portable::println("  Work Mode:         TCP Server");
-        portable::println("  Port:              {}", port);
-    }
-
-    return send_config_packet(packet, device.ip_address, debug);
+    DeviceConfigChange change;
+    change.modbus_tcp = true;
+    change.port = port;
+    return apply_device_config(device, change, debug);
 }
 
 bool set_device_port(const DiscoveredDevice& device,
                      uint16_t port,
                      bool debug)
 {
-    // Start from the device's raw VirCom response as template
-    auto packet = device.raw_response;
-
-    // Change command to SET_CONFIG
-    packet[2] = VIRCOM_CMD_SET_CONFIG;
-
-    // Port (uint16 big-endian) at offset 0x13-0x14
-    packet[0x13] = static_cast<uint8_t>((port >> 8) & 0xFF);
-    packet[0x14] = static_cast<uint8_t>(port & 0xFF);
-
-    if (debug) {
-        portable::println("SET_CONFIG (Port) for device MAC {}:", device.mac_address);
-        portable::println("  Port: {}", port);
-    }
-
-    return send_config_packet(packet, device.ip_address, debug);
+    DeviceConfigChange change;
+    change.port = port;
+    return apply_device_config(device, change, debug);
 }
 
 bool set_device_name(const DiscoveredDevice& device,
                      const std::string& name,
                      bool debug)
 {
-    constexpr size_t MAX_NAME_LEN = 9;
-
-    if (name.empty()) {
-        portable::println(stderr, "Device name must not be empty");
-        return false;
-    }
-    if (name.size() > MAX_NAME_LEN) {
-        portable::println(stderr, "Device name '{}' is too long ({} chars, max {})",
-                          name, name.size(), MAX_NAME_LEN);
-        return false;
-    }
-
-    // Start from the device's raw VirCom response as template
-    auto packet = device.raw_response;
-
-    // Change command to SET_CONFIG
-    packet[2] = VIRCOM_CMD_SET_CONFIG;
-
-    // Write device name at offset 0x29 (9 bytes, null-padded)
-    std::memset(&packet[0x29], 0, MAX_NAME_LEN);
-    std::memcpy(&packet[0x29], name.data(), name.size());
-
-    if (debug) {
-        portable::println("SET_CONFIG (Name) for device MAC {}:", device.mac_address);
-        portable::println("  New name: '{}'", name);
-    }
-
-    return send_config_packet(packet, device.ip_address, debug);
+    DeviceConfigChange change;
+    change.name = name;
+    return apply_device_config(device, change, debug);
 }
 
 } // namespace waveshare
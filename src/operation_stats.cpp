@@ -0,0 +1,101 @@
+#include "waveshare_modbus_commander/operation_stats.hpp"
+#include "waveshare_modbus_commander/latency_histogram.hpp"
+
+#include <array>
+#include <format>
+#include <mutex>
+
+namespace waveshare {
+
+namespace detail {
+bool operation_stats_enabled = false;
+}
+
+namespace {
+
+struct OperationStats {
+    LatencyHistogram latency;
+    uint64_t errors = 0;
+};
+
+std::mutex g_mutex;
+std::array<OperationStats, static_cast<size_t>(StatOp::COUNT)> g_stats;
+
+} // anonymous namespace
+
+const char* stat_op_name(StatOp op)
+{
+    switch (op) {
+    case StatOp::CONNECT:              return "connect";
+    case StatOp::READ_COILS:           return "FC01 read coils";
+    case StatOp::READ_DISCRETE_INPUTS: return "FC02 read inputs";
+    case StatOp::READ_REGISTERS:       return "FC03 read registers";
+    case StatOp::WRITE_COIL:           return "FC05 write coil";
+    case StatOp::WRITE_REGISTER:       return "FC06 write register";
+    case StatOp::WRITE_COILS:          return "FC15 write coils";
+    case StatOp::WRITE_REGISTERS:      return "FC16 write registers";
+    case StatOp::SCAN:                 return "scan";
+    case StatOp::SET_CONFIG:           return "SET_CONFIG";
+    case StatOp::REBOOT_WAIT:          return "reboot wait";
+    case StatOp::COUNT:                break;
+    }
+    return "?";
+}
+
+std::optional<StatOp> stat_op_for_function(uint8_t function)
+{
+    switch (function) {
+    case 0x01: return StatOp::READ_COILS;
+    case 0x02: return StatOp::READ_DISCRETE_INPUTS;
+    case 0x03: return StatOp::READ_REGISTERS;
+    case 0x05: return StatOp::WRITE_COIL;
+    case 0x06: return StatOp::WRITE_REGISTER;
+    case 0x0F: return StatOp::WRITE_COILS;
+    case 0x10: return StatOp::WRITE_REGISTERS;
+    default:   return std::nullopt;
+    }
+}
+
+void enable_operation_stats()
+{
+    detail::operation_stats_enabled = true;
+}
+
+void reset_operation_stats()
+{
+    std::lock_guard lock(g_mutex);
+    g_stats = {};
+}
+
+void record_operation(StatOp op, std::chrono::nanoseconds elapsed, bool ok)
+{
+    std::lock_guard lock(g_mutex);
+    auto& stats = g_stats[static_cast<size_t>(op)];
+    stats.latency.record(elapsed);
+    if (!ok) ++stats.errors;
+}
+
+std::string format_operation_stats()
+{
+    std::lock_guard lock(g_mutex);
+    std::string out = std::format("{:<21}  {:>6}  {:>6}  {:>9}  {:>9}  {:>9}  {:>9}\n",
+                                  "Operation", "Count", "Errors", "p50", "p90", "p99", "max");
+    out += std::format("{:-<21}  {:->6}  {:->6}  {:->9}  {:->9}  {:->9}  {:->9}\n", "", "", "", "", "", "", "");
+    bool any = false;
+    for (size_t i = 0; i < g_stats.size(); ++i) {
+        const auto& s = g_stats[i];
+        if (s.latency.count() == 0) continue;
+        any = true;
+        out += std::format("{:<21}  {:>6}  {:>6}  {:>9}  {:>9}  {:>9}  {:>9}\n",
+                           stat_op_name(static_cast<StatOp>(i)), s.latency.count(), s.errors,
+                           format_duration(s.latency.percentile(50)),
+                           format_duration(s.latency.percentile(90)),
+                           format_duration(s.latency.percentile(99)),
+                           format_duration(s.latency.max()));
+    }
+    if (!any) out += "(no operations recorded)\n";
+    out.pop_back();
+    return out;
+}
+
+} // namespace waveshare
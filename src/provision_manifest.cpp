@@ -0,0 +1,434 @@
+#include "waveshare_modbus_commander/provision_manifest.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+namespace waveshare {
+
+namespace {
+
+/// One manifest record as key/value strings, in file order.
+using Record = std::vector<std::pair<std::string, std::string>>;
+
+std::string to_lower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+std::string trim(const std::string& s)
+{
+    auto first = s.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) return {};
+    auto last = s.find_last_not_of(" \t\r\n");
+    return s.substr(first, last - first + 1);
+}
+
+/// Normalise "28-80-CA-EC-41-F9" / "28:80:ca:ec:41:f9" to the form
+/// reported by scan_network().  Returns empty if @p text is not a MAC.
+std::string normalize_mac(const std::string& text)
+{
+    std::string mac = to_lower(trim(text));
+    std::replace(mac.begin(), mac.end(), '-', ':');
+    if (mac.size() != 17) return {};
+    for (size_t i = 0; i < mac.size(); ++i) {
+        bool colon = i % 3 == 2;
+        if (colon ? mac[i] != ':' : !std::isxdigit(static_cast<unsigned char>(mac[i]))) return {};
+    }
+    return mac;
+}
+
+/// Turn a record into a ProvisionEntry.  @p where names the record in
+/// error messages (e.g. "line 4").
+bool make_entry(const Record& record, const std::string& where,
+                ProvisionEntry& entry, std::string& error)
+{
+    entry = {};
+    for (const auto& [raw_key, raw_value] : record) {
+        auto key = to_lower(trim(raw_key));
+        auto value = trim(raw_value);
+        if (value.empty() || value == "null") continue;
+
+        if (key == "mac") {
+            entry.mac_address = normalize_mac(value);
+            if (entry.mac_address.empty()) {
+                error = std::format("{}: invalid MAC address '{}'", where, value);
+                return false;
+            }
+        } else if (key == "ip") {
+            if (to_lower(value) == "dhcp") entry.change.dhcp = true;
+            else { entry.change.ip = value; entry.change.dhcp = false; }
+        } else if (key == "mask") {
+            entry.change.mask = value;
+        } else if (key == "gateway") {
+            entry.change.gateway = value;
+        } else if (key == "dns") {
+            entry.change.dns = value;
+        } else if (key == "name") {
+            entry.change.name = value;
+        } else if (key == "port") {
+            unsigned port = 0;
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), port);
+            if (ec != std::errc{} || ptr != value.data() + value.size() || port == 0 || port > 65535) {
+                error = std::format("{}: invalid port '{}'", where, value);
+                return false;
+            }
+            entry.change.port = static_cast<uint16_t>(port);
+        } else if (key == "protocol") {
+            auto proto = to_lower(value);
+            if (proto != "modbus_tcp" && proto != "modbus-tcp") {
+                error = std::format("{}: unsupported protocol '{}' (expected modbus_tcp)", where, value);
+                return false;
+            }
+            entry.change.modbus_tcp = true;
+        } else if (key == "dhcp") {
+            auto flag = to_lower(value);
+            if (flag == "true" || flag == "1" || flag == "yes") entry.change.dhcp = true;
+            else if (flag != "false" && flag != "0" && flag != "no") {
+                error = std::format("{}: invalid dhcp value '{}'", where, value);
+                return false;
+            }
+        } else {
+            error = std::format("{}: unknown key '{}'", where, raw_key);
+            return false;
+        }
+    }
+
+    if (entry.mac_address.empty()) {
+        error = std::format("{}: missing 'mac'", where);
+        return false;
+    }
+    if (entry.change.dhcp.value_or(false) && entry.change.ip) {
+        error = std::format("{}: both a static IP and DHCP requested", where);
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// CSV
+// ---------------------------------------------------------------------------
+
+/// Split one CSV line; double-quoted fields may contain commas and "".
+std::vector<std::string> split_csv(const std::string& line)
+{
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') { fields.back() += '"'; ++i; }
+            else if (c == '"') quoted = false;
+            else fields.back() += c;
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.emplace_back();
+        } else {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+bool parse_csv(std::istream& in, std::vector<Record>& records,
+               std::vector<std::string>& locations, std::string& error)
+{
+    std::vector<std::string> header;
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        auto content = trim(line);
+        if (content.empty() || content[0] == '#') continue;
+
+        auto fields = split_csv(content);
+        if (header.empty()) {
+            header = std::move(fields);
+            continue;
+        }
+        if (fields.size() > header.size()) {
+            error = std::format("line {}: {} fields, header has {}", line_no, fields.size(), header.size());
+            return false;
+        }
+        Record record;
+        for (size_t i = 0; i < fields.size(); ++i) {
+            record.emplace_back(header[i], fields[i]);
+        }
+        records.push_back(std::move(record));
+        locations.push_back(std::format("line {}", line_no));
+    }
+    if (header.empty()) {
+        error = "missing header row";
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// JSON (the subset a manifest needs: objects with scalar values in an array)
+// ---------------------------------------------------------------------------
+
+class JsonReader {
+public:
+    explicit JsonReader(std::string text) : text_(std::move(text)) {}
+
+    bool parse(std::vector<Record>& records, std::vector<std::string>& locations, std::string& error)
+    {
+        skip_ws();
+        if (peek() == '{') {
+            // { "devices": [ ... ] }
+            ++pos_;
+            bool found = false;
+            while (true) {
+                skip_ws();
+                if (peek() == '}') { ++pos_; break; }
+                std::string key;
+                if (!read_string(key) || !expect(':')) return fail(error);
+                skip_ws();
+                if (key == "devices") {
+                    if (!read_array(records, locations)) return fail(error);
+                    found = true;
+                } else if (!skip_value()) {
+                    return fail(error);
+                }
+                skip_ws();
+                if (peek() == ',') { ++pos_; continue; }
+                if (!expect('}')) return fail(error);
+                break;
+            }
+            if (!found) {
+                error = "JSON object has no 'devices' array";
+                return false;
+            }
+        } else if (!read_array(records, locations)) {
+            return fail(error);
+        }
+        skip_ws();
+        if (pos_ != text_.size()) {
+            message_ = "trailing characters";
+            return fail(error);
+        }
+        return true;
+    }
+
+private:
+    char peek() const { return pos_ < text_.size() ? text_[pos_] : '\0'; }
+
+    void skip_ws()
+    {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) ++pos_;
+    }
+
+    int line_at(size_t pos) const
+    {
+        return 1 + static_cast<int>(std::count(text_.begin(), text_.begin() + static_cast<std::ptrdiff_t>(pos), '\n'));
+    }
+
+    bool fail(std::string& error) const
+    {
+        error = std::format("line {}: {}", line_at(pos_),
+                            message_.empty() ? "malformed JSON" : message_);
+        return false;
+    }
+
+    bool expect(char c)
+    {
+        skip_ws();
+        if (peek() != c) {
+            message_ = std::format("expected '{}'", c);
+            return false;
+        }
+        ++pos_;
+        return true;
+    }
+
+    bool read_string(std::string& out)
+    {
+        skip_ws();
+        if (peek() != '"') {
+            message_ = "expected a string";
+            return false;
+        }
+        ++pos_;
+        out.clear();
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            char c = text_[pos_++];
+            if (c != '\\') { out += c; continue; }
+            if (pos_ >= text_.size()) break;
+            char e = text_[pos_++];
+            switch (e) {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u': {
+                unsigned code = 0;
+                if (pos_ + 4 > text_.size() ||
+                    std::from_chars(text_.data() + pos_, text_.data() + pos_ + 4, code, 16).ptr !=
+                        text_.data() + pos_ + 4) {
+                    message_ = "invalid \\u escape";
+                    return false;
+                }
+                pos_ += 4;
+                out += code < 0x80 ? static_cast<char>(code) : '?';
+                break;
+            }
+            default: out += e; break;
+            }
+        }
+        if (peek() != '"') {
+            message_ = "unterminated string";
+            return false;
+        }
+        ++pos_;
+        return true;
+    }
+
+    /// Read a scalar (string, number, true/false/null) as text.
+    bool read_scalar(std::string& out)
+    {
+        skip_ws();
+        if (peek() == '"') return read_string(out);
+        size_t start = pos_;
+        while (pos_ < text_.size() &&
+               (std::isalnum(static_cast<unsigned char>(text_[pos_])) ||
+                text_[pos_] == '-' || text_[pos_] == '+' || text_[pos_] == '.')) {
+            ++pos_;
+        }
+        if (pos_ == start) {
+            message_ = "expected a value";
+            return false;
+        }
+        out = text_.substr(start, pos_ - start);
+        return true;
+    }
+
+    bool skip_value()
+    {
+        skip_ws();
+        char open = peek();
+        if (open != '{' && open != '[') {
+            std::string ignored;
+            return read_scalar(ignored);
+        }
+        // Skip a nested structure, honouring strings.
+        int depth = 0;
+        while (pos_ < text_.size()) {
+            char c = text_[pos_];
+            if (c == '"') {
+                std::string ignored;
+                if (!read_string(ignored)) return false;
+                continue;
+            }
+            ++pos_;
+            if (c == '{' || c == '[') ++depth;
+            else if ((c == '}' || c == ']') && --depth == 0) return true;
+        }
+        message_ = "unterminated structure";
+        return false;
+    }
+
+    bool read_object(Record& record)
+    {
+        if (!expect('{')) return false;
+        skip_ws();
+        if (peek() == '}') { ++pos_; return true; }
+        while (true) {
+            std::string key, value;
+            if (!read_string(key) || !expect(':')) return false;
+            skip_ws();
+            if (peek() == '{' || peek() == '[') {
+                message_ = std::format("value of '{}' must be a string, number or boolean", key);
+                return false;
+            }
+            if (!read_scalar(value)) return false;
+            record.emplace_back(std::move(key), std::move(value));
+            skip_ws();
+            if (peek() == ',') { ++pos_; continue; }
+            return expect('}');
+        }
+    }
+
+    bool read_array(std::vector<Record>& records, std::vector<std::string>& locations)
+    {
+        if (!expect('[')) return false;
+        skip_ws();
+        if (peek() == ']') { ++pos_; return true; }
+        while (true) {
+            skip_ws();
+            locations.push_back(std::format("line {}", line_at(pos_)));
+            Record record;
+            if (!read_object(record)) return false;
+            records.push_back(std::move(record));
+            skip_ws();
+            if (peek() == ',') { ++pos_; continue; }
+            return expect(']');
+        }
+    }
+
+    std::string text_;
+    size_t pos_ = 0;
+    std::string message_;
+};
+
+} // anonymous namespace
+
+bool load_provision_manifest(const std::string& path,
+                             std::vector<ProvisionEntry>& entries,
+                             std::string& error)
+{
+    std::ifstream in(path);
+    if (!in) {
+        error = std::format("cannot open manifest '{}'", path);
+        return false;
+    }
+
+    std::vector<Record> records;
+    std::vector<std::string> locations;
+    auto ext = to_lower(std::filesystem::path(path).extension().string());
+    bool ok = false;
+    if (ext == ".json") {
+        std::ostringstream text;
+        text << in.rdbuf();
+        ok = JsonReader(text.str()).parse(records, locations, error);
+    } else if (ext == ".csv") {
+        ok = parse_csv(in, records, locations, error);
+    } else {
+        error = std::format("unknown manifest format '{}' (expected .json or .csv)", ext);
+        return false;
+    }
+    if (!ok) {
+        error = std::format("{}: {}", path, error);
+        return false;
+    }
+
+    entries.clear();
+    for (size_t i = 0; i < records.size(); ++i) {
+        ProvisionEntry entry;
+        if (!make_entry(records[i], std::format("{}: {}", path, locations[i]), entry, error))
+            return false;
+        auto dup = std::find_if(entries.begin(), entries.end(),
+                                [&](const ProvisionEntry& e) { return e.mac_address == entry.mac_address; });
+        if (dup != entries.end()) {
+            error = std::format("{}: {}: device {} listed twice", path, locations[i], entry.mac_address);
+            return false;
+        }
+        entries.push_back(std::move(entry));
+    }
+    if (entries.empty()) {
+        error = std::format("{}: no devices listed", path);
+        return false;
+    }
+    return true;
+}
+
+} // namespace waveshare
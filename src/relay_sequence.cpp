@@ -0,0 +1,96 @@
+#include "waveshare_modbus_commander/relay_sequence.hpp"
+#include "waveshare_modbus_commander/latency_histogram.hpp"
+#include "waveshare_modbus_commander/relay_state.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <sstream>
+
+namespace waveshare {
+
+bool parse_relay_sequence(const std::string& text, RelaySequence& sequence, std::string& error)
+{
+    sequence = {};
+    std::istringstream in(text);
+    std::string line;
+    int line_no = 0;
+    std::chrono::nanoseconds last{};
+    while (std::getline(in, line)) {
+        ++line_no;
+        if (auto hash = line.find('#'); hash != std::string::npos) line.erase(hash);
+
+        std::istringstream fields(line);
+        std::string time_text, pattern, extra;
+        if (!(fields >> time_text)) continue;
+        if (!(fields >> pattern) || (fields >> extra)) {
+            error = std::format("line {}: expected '<offset> <relay pattern>'", line_no);
+            return false;
+        }
+        if (sequence.cycle) {
+            error = std::format("line {}: step after the 'loop' line", line_no);
+            return false;
+        }
+
+        bool relative = time_text.starts_with('+');
+        std::chrono::nanoseconds offset{};
+        if (!parse_duration(relative ? time_text.substr(1) : time_text, offset)) {
+            error = std::format("line {}: invalid time offset '{}' (e.g. 1.5, 1.5s, 500ms)", line_no, time_text);
+            return false;
+        }
+        if (relative) offset += last;
+        if (!sequence.steps.empty() && offset < last) {
+            error = std::format("line {}: offset {} lies before the previous step", line_no, time_text);
+            return false;
+        }
+        last = offset;
+
+        std::string lower = pattern;
+        std::transform(lower.begin(), lower.end(), lower.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (lower == "loop") {
+            if (sequence.steps.empty() || offset <= sequence.steps.front().offset) {
+                error = std::format("line {}: the 'loop' offset must come after the first step", line_no);
+                return false;
+            }
+            sequence.cycle = offset;
+            continue;
+        }
+
+        SequenceStep step;
+        step.offset = offset;
+        step.line = line_no;
+        std::string pattern_error;
+        if (!parse_relay_mask(pattern, step.mask, pattern_error)) {
+            error = std::format("line {}: {}", line_no, pattern_error);
+            return false;
+        }
+        sequence.steps.push_back(step);
+    }
+
+    if (sequence.steps.empty()) {
+        error = "the sequence has no steps";
+        return false;
+    }
+    return true;
+}
+
+bool load_relay_sequence(const std::string& path, RelaySequence& sequence, std::string& error)
+{
+    std::ifstream in(path);
+    if (!in) {
+        error = std::format("cannot open '{}'", path);
+        return false;
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    if (!parse_relay_sequence(text.str(), sequence, error)) {
+        error = std::format("{}: {}", path, error);
+        return false;
+    }
+    return true;
+}
+
+} // namespace waveshare
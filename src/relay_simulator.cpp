@@ -0,0 +1,826 @@
+#include "waveshare_modbus_commander/relay_simulator.hpp"
+#include "waveshare_modbus_commander/portable_print.hpp"
+#include "waveshare_modbus_commander/socket_compat.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+namespace waveshare {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// VirCom protocol constants, as used by the scanner.
+constexpr uint16_t VIRCOM_PORT = 1092;
+constexpr uint8_t  VIRCOM_MAGIC_0 = 0x5A;
+constexpr uint8_t  VIRCOM_MAGIC_1 = 0x4C;
+constexpr uint8_t  VIRCOM_CMD_SEARCH     = 0x00;
+constexpr uint8_t  VIRCOM_CMD_RESPONSE   = 0x01;
+constexpr uint8_t  VIRCOM_CMD_SET_CONFIG = 0x02;
+
+// Offsets in the VirCom packet.
+constexpr size_t VIRCOM_IP        = 0x03;
+constexpr size_t VIRCOM_MASK      = 0x07;
+constexpr size_t VIRCOM_PORT_HI   = 0x13;
+constexpr size_t VIRCOM_MODULE_ID = 0x18;
+constexpr size_t VIRCOM_MAC       = 0x22;
+constexpr size_t VIRCOM_NAME      = 0x29;
+constexpr size_t MAX_NAME_LEN     = 9;
+
+constexpr size_t MBAP_HEADER_SIZE = 7;   ///< TID(2) PID(2) LEN(2) UNIT(1)
+constexpr size_t MAX_PDU_SIZE = 253;
+
+constexpr uint8_t FC_READ_COILS              = 0x01;
+constexpr uint8_t FC_READ_DISCRETE_INPUTS    = 0x02;
+constexpr uint8_t FC_READ_HOLDING_REGISTERS  = 0x03;
+constexpr uint8_t FC_WRITE_SINGLE_COIL       = 0x05;
+constexpr uint8_t FC_WRITE_SINGLE_REGISTER   = 0x06;
+constexpr uint8_t FC_WRITE_MULTIPLE_COILS    = 0x0F;
+constexpr uint8_t FC_WRITE_MULTIPLE_REGISTERS = 0x10;
+
+constexpr uint8_t EX_ILLEGAL_FUNCTION = 0x01;
+constexpr uint8_t EX_ILLEGAL_ADDRESS  = 0x02;
+constexpr uint8_t EX_ILLEGAL_VALUE    = 0x03;
+
+void put_u16(std::vector<uint8_t>& out, uint16_t v)
+{
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v & 0xFF));
+}
+
+uint16_t get_u16(const uint8_t* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+std::vector<uint8_t> exception_response(uint8_t function, uint8_t code)
+{
+    return {static_cast<uint8_t>(function | 0x80), code};
+}
+
+std::string format_endpoint(const sockaddr_in& addr)
+{
+    char ip[INET_ADDRSTRLEN]{};
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return std::format("{}:{}", ip, ntohs(addr.sin_port));
+}
+
+} // anonymous namespace
+
+// ── SimulatedBoard ──────────────────────────────────────────────────────
+
+SimulatedBoard::SimulatedBoard(const SimulatorOptions& options)
+{
+    config_[0] = VIRCOM_MAGIC_0;
+    config_[1] = VIRCOM_MAGIC_1;
+    config_[2] = VIRCOM_CMD_RESPONSE;
+
+    in_addr ip{};
+    if (inet_pton(AF_INET, options.ip_address.c_str(), &ip) != 1)
+        throw std::invalid_argument(std::format("invalid IP address '{}'", options.ip_address));
+    std::memcpy(&config_[VIRCOM_IP], &ip.s_addr, 4);            // network order = packet order
+    const uint8_t mask[4] = {255, 0, 0, 0};
+    std::memcpy(&config_[VIRCOM_MASK], mask, 4);                 // gateway and DNS stay 0.0.0.0
+
+    config_[VIRCOM_PORT_HI]     = static_cast<uint8_t>(options.modbus_port >> 8);
+    config_[VIRCOM_PORT_HI + 1] = static_cast<uint8_t>(options.modbus_port & 0xFF);
+    config_[0x16] = 0x07;            // baud rate index (unused over TCP)
+    config_[0x17] = 0x00;            // work mode: TCP server
+    std::memcpy(&config_[VIRCOM_MODULE_ID], "SIMRELAY08", 10);
+
+    unsigned mac[6]{};
+    char trailing = 0;
+    if (std::sscanf(options.mac_address.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x%c",
+                    &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5], &trailing) != 6)
+        throw std::invalid_argument(std::format("invalid MAC address '{}'", options.mac_address));
+    for (size_t i = 0; i < 6; ++i) config_[VIRCOM_MAC + i] = static_cast<uint8_t>(mac[i]);
+
+    if (options.device_name.empty() || options.device_name.size() > MAX_NAME_LEN)
+        throw std::invalid_argument(std::format("device name '{}' must have 1-{} characters",
+                                                options.device_name, MAX_NAME_LEN));
+    std::memcpy(&config_[VIRCOM_NAME], options.device_name.data(), options.device_name.size());
+
+    // Transfer protocol: Modbus TCP
+    config_[0x3A] = 0x03;
+    config_[0x3B] = 0x00;            // static IP
+    config_[0x3F] = 0x01;
+    config_[0x74] = 0x06;
+
+    inputs_ = options.inputs;
+}
+
+std::vector<uint8_t> SimulatedBoard::handle_modbus(const uint8_t* pdu, size_t len)
+{
+    if (len < 1) return exception_response(0, EX_ILLEGAL_FUNCTION);
+    uint8_t function = pdu[0];
+
+    switch (function) {
+    case FC_READ_COILS:
+    case FC_READ_DISCRETE_INPUTS: {
+        if (len < 5) return exception_response(function, EX_ILLEGAL_VALUE);
+        uint16_t address = get_u16(pdu + 1);
+        uint16_t count = get_u16(pdu + 3);
+        if (count < 1 || count > 2000) return exception_response(function, EX_ILLEGAL_VALUE);
+        uint16_t limit = function == FC_READ_COILS ? RELAY_COUNT : INPUT_COUNT;
+        if (address + count > limit) return exception_response(function, EX_ILLEGAL_ADDRESS);
+        uint8_t bits = static_cast<uint8_t>((function == FC_READ_COILS ? relays_ : inputs_) >> address);
+        if (count < 8) bits = static_cast<uint8_t>(bits & ((1u << count) - 1));
+        return {function, 1, bits};
+    }
+    case FC_READ_HOLDING_REGISTERS: {
+        if (len < 5) return exception_response(function, EX_ILLEGAL_VALUE);
+        uint16_t address = get_u16(pdu + 1);
+        uint16_t count = get_u16(pdu + 3);
+        if (count < 1 || count > 125) return exception_response(function, EX_ILLEGAL_VALUE);
+        if (address + count > REGISTER_COUNT) return exception_response(function, EX_ILLEGAL_ADDRESS);
+        std::vector<uint8_t> response{function, static_cast<uint8_t>(count * 2)};
+        for (uint16_t i = 0; i < count; ++i) put_u16(response, registers_[address + i]);
+        return response;
+    }
+    case FC_WRITE_SINGLE_COIL: {
+        if (len < 5) return exception_response(function, EX_ILLEGAL_VALUE);
+        uint16_t address = get_u16(pdu + 1);
+        uint16_t value = get_u16(pdu + 3);
+        if (value != 0xFF00 && value != 0x0000) return exception_response(function, EX_ILLEGAL_VALUE);
+        if (address == ALL_RELAYS) {
+            relays_ = value ? 0xFF : 0x00;
+        } else if (address < RELAY_COUNT) {
+            relays_ = value ? static_cast<uint8_t>(relays_ | (1u << address))
+                            : static_cast<uint8_t>(relays_ & ~(1u << address));
+        } else {
+            return exception_response(function, EX_ILLEGAL_ADDRESS);
+        }
+        return {pdu, pdu + 5};
+    }
+    case FC_WRITE_SINGLE_REGISTER: {
+        if (len < 5) return exception_response(function, EX_ILLEGAL_VALUE);
+        uint16_t address = get_u16(pdu + 1);
+        if (address >= REGISTER_COUNT) return exception_response(function, EX_ILLEGAL_ADDRESS);
+        registers_[address] = get_u16(pdu + 3);
+        return {pdu, pdu + 5};
+    }
+    case FC_WRITE_MULTIPLE_COILS: {
+        if (len < 6) return exception_response(function, EX_ILLEGAL_VALUE);
+        uint16_t address = get_u16(pdu + 1);
+        uint16_t count = get_u16(pdu + 3);
+        size_t bytes = pdu[5];
+        if (count < 1 || count > 0x7B0 || bytes != (count + 7u) / 8u || len < 6 + bytes)
+            return exception_response(function, EX_ILLEGAL_VALUE);
+        if (address + count > RELAY_COUNT) return exception_response(function, EX_ILLEGAL_ADDRESS);
+        for (uint16_t i = 0; i < count; ++i) {
+            uint8_t bit = static_cast<uint8_t>(1u << (address + i));
+            bool on = (pdu[6 + i / 8] >> (i % 8)) & 1u;
+            relays_ = on ? static_cast<uint8_t>(relays_ | bit) : static_cast<uint8_t>(relays_ & ~bit);
+        }
+        return {pdu, pdu + 5};
+    }
+    case FC_WRITE_MULTIPLE_REGISTERS: {
+        if (len < 6) return exception_response(function, EX_ILLEGAL_VALUE);
+        uint16_t address = get_u16(pdu + 1);
+        uint16_t count = get_u16(pdu + 3);
+        size_t bytes = pdu[5];
+        if (count < 1 || count > 123 || bytes != count * 2u || len < 6 + bytes)
+            return exception_response(function, EX_ILLEGAL_VALUE);
+        if (address + count > REGISTER_COUNT) return exception_response(function, EX_ILLEGAL_ADDRESS);
+        for (uint16_t i = 0; i < count; ++i) registers_[address + i] = get_u16(pdu + 6 + 2 * i);
+        return {pdu, pdu + 5};
+    }
+    default:
+        return exception_response(function, EX_ILLEGAL_FUNCTION);
+    }
+}
+
+bool SimulatedBoard::apply_config(const uint8_t* packet, size_t len)
+{
+    if (len < VIRCOM_PACKET_SIZE) return false;
+    if (packet[0] != VIRCOM_MAGIC_0 || packet[1] != VIRCOM_MAGIC_1 || packet[2] != VIRCOM_CMD_SET_CONFIG)
+        return false;
+    if (std::memcmp(packet + VIRCOM_MAC, &config_[VIRCOM_MAC], 6) != 0) return false;
+    std::memcpy(config_.data(), packet, VIRCOM_PACKET_SIZE);
+    config_[2] = VIRCOM_CMD_RESPONSE;
+    return true;
+}
+
+std::string SimulatedBoard::ip_address() const
+{
+    return std::format("{}.{}.{}.{}", config_[VIRCOM_IP], config_[VIRCOM_IP + 1],
+                       config_[VIRCOM_IP + 2], config_[VIRCOM_IP + 3]);
+}
+
+uint16_t SimulatedBoard::modbus_port() const
+{
+    return get_u16(&config_[VIRCOM_PORT_HI]);
+}
+
+std::string SimulatedBoard::mac_address() const
+{
+    const uint8_t* m = &config_[VIRCOM_MAC];
+    return std::format("{:02x}:{:02x}:{:02x}:{:02x}:{:02x}:{:02x}", m[0], m[1], m[2], m[3], m[4], m[5]);
+}
+
+std::string SimulatedBoard::device_name() const
+{
+    std::string name;
+    for (size_t i = 0; i < MAX_NAME_LEN; ++i) {
+        uint8_t c = config_[VIRCOM_NAME + i];
+        if (c < 0x20 || c >= 0x7F) break;
+        name += static_cast<char>(c);
+    }
+    return name;
+}
+
+// ── RelaySimulator ──────────────────────────────────────────────────────
+
+/// An accepted Modbus TCP client.
+struct RelaySimulator::Connection {
+    int fd = -1;
+    uint64_t id = 0;
+    std::vector<uint8_t> rx;            ///< Received bytes not yet framed
+    Clock::time_point last_due{};       ///< Replies leave in request order
+};
+
+/// A request waiting for its reply time.
+struct RelaySimulator::Pending {
+    Clock::time_point due;
+    uint64_t sequence = 0;              ///< Arrival order, for equal due times
+    uint64_t connection = 0;            ///< 0 = VirCom datagram
+    std::vector<uint8_t> request;       ///< Modbus ADU or VirCom packet
+    sockaddr_in from{};                 ///< Sender of a VirCom datagram
+};
+
+namespace {
+
+/// Heap order of RelaySimulator::pending_: the earliest due time on top,
+/// and requests due at the same time in arrival order.
+constexpr auto due_later = [](const auto& a, const auto& b) {
+    return a.due != b.due ? a.due > b.due : a.sequence > b.sequence;
+};
+
+} // anonymous namespace
+
+RelaySimulator::RelaySimulator(const SimulatorOptions& options)
+    : options_(options)
+    , board_(options)
+    , random_(options.seed ? options.seed : std::random_device{}())
+{
+}
+
+RelaySimulator::~RelaySimulator()
+{
+    close_modbus();
+    if (udp_ != -1) ::close(udp_);
+}
+
+bool RelaySimulator::start(std::string& error)
+{
+    started_at_ = Clock::now();
+    if (options_.vircom) {
+        udp_ = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (udp_ < 0) {
+            error = std::format("cannot create UDP socket: {}", std::strerror(errno));
+            return false;
+        }
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(VIRCOM_PORT);
+        if (::bind(udp_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+            error = std::format("cannot bind VirCom port {}: {}{}", VIRCOM_PORT, std::strerror(errno),
+                                errno == EADDRINUSE ? " (is another simulator running?)" : "");
+            return false;
+        }
+        set_socket_nonblocking(udp_);
+    }
+    return listen_modbus(error);
+}
+
+bool RelaySimulator::listen_modbus(std::string& error)
+{
+    auto ip = board_.ip_address();
+    auto port = board_.modbus_port();
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+
+    listener_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener_ < 0) {
+        error = std::format("cannot create TCP socket: {}", std::strerror(errno));
+        return false;
+    }
+    int one = 1;
+    ::setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (::bind(listener_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listener_, 64) != 0) {
+        error = std::format("cannot listen on {}:{}: {}", ip, port, std::strerror(errno));
+        ::close(listener_);
+        listener_ = -1;
+        return false;
+    }
+    set_socket_nonblocking(listener_);
+    listen_port_ = port;
+    return true;
+}
+
+void RelaySimulator::close_modbus()
+{
+    for (auto& conn : connections_) ::close(conn.fd);
+    connections_.clear();
+    if (listener_ != -1) ::close(listener_);
+    listener_ = -1;
+    listen_port_ = 0;
+}
+
+SimulatorCounters RelaySimulator::counters() const
+{
+    SimulatorCounters c;
+    c.modbus_requests = modbus_requests_.load();
+    c.modbus_dropped  = modbus_dropped_.load();
+    c.connections     = connections_accepted_.load();
+    c.vircom_requests = vircom_requests_.load();
+    c.vircom_dropped  = vircom_dropped_.load();
+    c.reboots         = reboots_.load();
+    return c;
+}
+
+std::chrono::nanoseconds RelaySimulator::reply_delay()
+{
+    std::chrono::nanoseconds delay = options_.latency;
+    if (options_.jitter.count() > 0) {
+        std::uniform_int_distribution<int64_t> extra(0, std::chrono::nanoseconds(options_.jitter).count());
+        delay += std::chrono::nanoseconds(extra(random_));
+    }
+    return delay;
+}
+
+bool RelaySimulator::lose()
+{
+    if (options_.loss <= 0.0) return false;
+    return std::uniform_real_distribution<double>(0.0, 1.0)(random_) < options_.loss;
+}
+
+uint8_t RelaySimulator::current_inputs() const
+{
+    if (options_.input_period.count() <= 0) return options_.inputs;
+    auto steps = (Clock::now() - started_at_) / options_.input_period;
+    return static_cast<uint8_t>(options_.inputs + steps);
+}
+
+void RelaySimulator::read_vircom()
+{
+    uint8_t buf[512];
+    while (true) {
+        sockaddr_in from{};
+        socklen_t from_len = sizeof(from);
+        auto n = ::recvfrom(udp_, buf, sizeof(buf), 0, reinterpret_cast<sockaddr*>(&from), &from_len);
+        if (n < 0) return;      // drained (or a transient error)
+        if (rebooting_) continue;
+        if (n < 3 || buf[0] != VIRCOM_MAGIC_0 || buf[1] != VIRCOM_MAGIC_1) continue;
+        if (buf[2] != VIRCOM_CMD_SEARCH && buf[2] != VIRCOM_CMD_SET_CONFIG) continue;
+
+        ++vircom_requests_;
+        if (lose()) {
+            ++vircom_dropped_;
+            if (options_.debug)
+                portable::println("VirCom {} from {} dropped",
+                                  buf[2] == VIRCOM_CMD_SEARCH ? "search" : "SET_CONFIG", format_endpoint(from));
+            continue;
+        }
+        Pending pending;
+        pending.due = Clock::now() + reply_delay();
+        pending.sequence = next_sequence_++;
+        pending.request.assign(buf, buf + n);
+        pending.from = from;
+        pending_.push_back(std::move(pending));
+        std::push_heap(pending_.begin(), pending_.end(), due_later);
+    }
+}
+
+void RelaySimulator::accept_connections()
+{
+    while (true) {
+        int fd = ::accept(listener_, nullptr, nullptr);
+        if (fd < 0) return;
+        set_socket_nonblocking(fd);
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Connection conn;
+        conn.fd = fd;
+        conn.id = next_connection_id_++;
+        connections_.push_back(std::move(conn));
+        ++connections_accepted_;
+        if (options_.debug) portable::println("Modbus TCP connection #{} accepted", connections_.back().id);
+    }
+}
+
+bool RelaySimulator::read_connection(Connection& conn)
+{
+    uint8_t buf[4096];
+    while (true) {
+        auto n = ::recv(conn.fd, buf, sizeof(buf), 0);
+        if (n == 0) return false;
+        if (n < 0) {
+            if (would_block(errno)) break;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        conn.rx.insert(conn.rx.end(), buf, buf + n);
+    }
+
+    auto now = Clock::now();
+    size_t pos = 0;
+    while (conn.rx.size() - pos >= MBAP_HEADER_SIZE) {
+        const uint8_t* h = conn.rx.data() + pos;
+        uint16_t len = get_u16(h + 4);
+        if (get_u16(h + 2) != 0 || len < 2 || len > MAX_PDU_SIZE + 1) return false;   // not Modbus TCP
+        if (conn.rx.size() - pos < 6u + len) break;
+
+        ++modbus_requests_;
+        if (lose()) {
+            ++modbus_dropped_;
+            if (options_.debug)
+                portable::println("#{} FC{:02} tid {} dropped", conn.id, h[MBAP_HEADER_SIZE], get_u16(h));
+        } else {
+            Pending pending;
+            pending.due = std::max(conn.last_due, now + reply_delay());
+            pending.sequence = next_sequence_++;
+            pending.connection = conn.id;
+            pending.request.assign(h, h + 6 + len);
+            conn.last_due = pending.due;
+            pending_.push_back(std::move(pending));
+            std::push_heap(pending_.begin(), pending_.end(), due_later);
+        }
+        pos += 6u + len;
+    }
+    conn.rx.erase(conn.rx.begin(), conn.rx.begin() + static_cast<std::ptrdiff_t>(pos));
+    return true;
+}
+
+void RelaySimulator::deliver(const Pending& pending)
+{
+    if (rebooting_) return;
+    const auto& req = pending.request;
+
+    if (pending.connection == 0) {
+        if (req[2] == VIRCOM_CMD_SEARCH) {
+            const auto& answer = board_.vircom_response();
+            ::sendto(udp_, answer.data(), answer.size(), 0,
+                     reinterpret_cast<const sockaddr*>(&pending.from), sizeof(pending.from));
+            if (options_.debug) portable::println("VirCom search from {} answered", format_endpoint(pending.from));
+            return;
+        }
+        if (!board_.apply_config(req.data(), req.size())) return;
+        ++reboots_;
+        if (options_.debug)
+            portable::println("SET_CONFIG from {}: now {} at {}:{}, rebooting for {} ms",
+                              format_endpoint(pending.from), board_.device_name(),
+                              board_.ip_address(), board_.modbus_port(), options_.reboot_time.count());
+        close_modbus();
+        rebooting_ = true;
+        back_at_ = Clock::now() + options_.reboot_time;
+        return;
+    }
+
+    auto it = std::find_if(connections_.begin(), connections_.end(),
+                           [&](const Connection& c) { return c.id == pending.connection; });
+    if (it == connections_.end()) return;     // closed meanwhile
+
+    board_.set_inputs(current_inputs());
+    auto pdu = board_.handle_modbus(req.data() + MBAP_HEADER_SIZE, req.size() - MBAP_HEADER_SIZE);
+    std::vector<uint8_t> frame(req.begin(), req.begin() + 4);       // TID, protocol
+    put_u16(frame, static_cast<uint16_t>(pdu.size() + 1));
+    frame.push_back(req[6]);                                         // unit
+    frame.insert(frame.end(), pdu.begin(), pdu.end());
+    if (options_.debug)
+        portable::println("#{} FC{:02} tid {} -> {}", it->id, req[MBAP_HEADER_SIZE], get_u16(req.data()),
+                          pdu[0] & 0x80 ? std::format("exception {}", pdu[1]) : std::string("ok"));
+
+    // Replies are a few bytes; a client that lets its receive buffer
+    // fill up is disconnected rather than buffered for.
+    if (::send(it->fd, frame.data(), frame.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(frame.size())) {
+        ::close(it->fd);
+        connections_.erase(it);
+    }
+}
+
+void RelaySimulator::run(const std::atomic<bool>& stop)
+{
+    std::vector<pollfd> fds;
+    while (!stop.load()) {
+        auto now = Clock::now();
+        if (rebooting_ && now >= back_at_) {
+            rebooting_ = false;
+            board_.reboot();
+            std::string error;
+            if (!listen_modbus(error))
+                portable::println(stderr, "Error: {}", error);
+            else if (options_.debug)
+                portable::println("Back up as {} at {}:{}", board_.device_name(), board_.ip_address(),
+                                  board_.modbus_port());
+        }
+
+        while (!pending_.empty() && pending_.front().due <= now) {
+            std::pop_heap(pending_.begin(), pending_.end(), due_later);
+            auto pending = std::move(pending_.back());
+            pending_.pop_back();
+            deliver(pending);
+        }
+
+        auto wake = now + std::chrono::milliseconds(100);
+        if (!pending_.empty()) wake = std::min(wake, pending_.front().due);
+        if (rebooting_) wake = std::min(wake, back_at_);
+
+        fds.clear();
+        fds.push_back({udp_, POLLIN, 0});         // -1 while disabled: ignored by poll
+        fds.push_back({listener_, POLLIN, 0});
+        for (const auto& conn : connections_) fds.push_back({conn.fd, POLLIN, 0});
+
+        auto wait = std::max(wake - Clock::now(), Clock::duration::zero());
+#ifdef __linux__
+        // Sub-millisecond latencies need a finer timeout than poll()'s.
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+        timespec timeout{static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+        int rc = ::ppoll(fds.data(), fds.size(), &timeout, nullptr);
+#else
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(wait).count();
+        int rc = ::poll(fds.data(), fds.size(), static_cast<int>(ms));
+#endif
+        if (rc < 0 && errno != EINTR) {
+            portable::println(stderr, "Error: poll failed: {}", std::strerror(errno));
+            return;
+        }
+        if (rc <= 0) continue;
+
+        if (fds[0].revents) read_vircom();
+        for (size_t i = connections_.size(); i-- > 0;) {
+            if (!fds[2 + i].revents) continue;
+            if (!read_connection(connections_[i])) {
+                if (options_.debug) portable::println("Modbus TCP connection #{} closed", connections_[i].id);
+                ::close(connections_[i].fd);
+                connections_.erase(connections_.begin() + static_cast<std::ptrdiff_t>(i));
+            }
+        }
+        if (fds[1].revents && listener_ != -1) accept_connections();
+    }
+}
+
+
+// ── VirComFleet ─────────────────────────────────────────────────────────
+
+/// One device of the fleet: its search response and fixed behaviour.
+struct VirComFleet::Device {
+    std::array<uint8_t, VIRCOM_PACKET_SIZE> response{};
+    std::chrono::nanoseconds delay{};
+    double loss = 0.0;
+};
+
+/// A search response waiting for its device's delay.
+struct VirComFleet::Reply {
+    Clock::time_point due;
+    uint64_t sequence = 0;              ///< Arrival order, for equal due times
+    uint32_t device = 0;
+    sockaddr_in to{};
+};
+
+VirComFleet::VirComFleet(const FleetOptions& options)
+    : options_(options)
+    , random_(options.seed ? options.seed : std::random_device{}())
+{
+    if (options.count == 0 || options.count > MAX_DEVICES)
+        throw std::invalid_argument(std::format("fleet size {} out of range (1-{})", options.count, MAX_DEVICES));
+    in_addr first{};
+    if (inet_pton(AF_INET, options.first_ip.c_str(), &first) != 1)
+        throw std::invalid_argument(std::format("invalid IP address '{}'", options.first_ip));
+    first_ip_ = ntohl(first.s_addr);
+    if (first_ip_ > UINT32_MAX - options.count)
+        throw std::invalid_argument(std::format("{} devices from {} run past 255.255.255.255",
+                                                options.count, options.first_ip));
+
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    devices_.resize(options.count);
+    for (uint32_t i = 0; i < options.count; ++i) {
+        SimulatorOptions board;
+        board.ip_address = ip_address(i);
+        board.mac_address = mac_address(i);
+        board.device_name = device_name(i);
+        board.modbus_port = 502;
+        devices_[i].response = SimulatedBoard(board).vircom_response();
+        devices_[i].delay = options.latency + std::chrono::nanoseconds(static_cast<int64_t>(
+            unit(random_) * static_cast<double>(std::chrono::nanoseconds(options.delay_spread).count())));
+        devices_[i].loss = std::min(1.0, options.loss + unit(random_) * options.loss_spread);
+    }
+}
+
+VirComFleet::~VirComFleet()
+{
+    if (udp_ != -1) ::close(udp_);
+}
+
+std::string VirComFleet::ip_address(uint32_t index) const
+{
+    in_addr addr{};
+    addr.s_addr = htonl(first_ip_ + index);
+    char ip[INET_ADDRSTRLEN]{};
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+    return ip;
+}
+
+std::string VirComFleet::mac_address(uint32_t index) const
+{
+    auto n = index + 1;
+    return std::format("02:00:01:00:{:02x}:{:02x}", (n >> 8) & 0xFF, n & 0xFF);
+}
+
+std::string VirComFleet::device_name(uint32_t index) const
+{
+    return std::format("FLEET{:04}", index + 1);
+}
+
+std::string VirComFleet::subnet() const
+{
+    uint32_t first = first_ip_;
+    uint32_t last = first_ip_ + size() - 1;
+    int prefix = 32;
+    if (first != last) {
+        // Widen until both ends are hosts of one network, which excludes
+        // its network and broadcast addresses.
+        for (prefix = 30; prefix > 0; --prefix) {
+            uint32_t mask = 0xFFFFFFFFu << (32 - prefix);
+            uint32_t net = first & mask;
+            if ((last & mask) == net && first != net && last != (net | ~mask)) break;
+        }
+    }
+    in_addr addr{};
+    addr.s_addr = htonl(prefix > 0 ? first & (0xFFFFFFFFu << (32 - prefix)) : 0);
+    char ip[INET_ADDRSTRLEN]{};
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+    return std::format("{}/{}", ip, prefix);
+}
+
+bool VirComFleet::start(std::string& error)
+{
+#ifndef IP_PKTINFO
+    error = "the VirCom fleet needs IP_PKTINFO, which this platform lacks";
+    return false;
+#else
+    udp_ = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udp_ < 0) {
+        error = std::format("cannot create UDP socket: {}", std::strerror(errno));
+        return false;
+    }
+    // Learn which address each search was sent to, to answer as that
+    // device.  A sweep arrives in bursts, so ask for a large buffer (the
+    // kernel caps it at net.core.rmem_max).
+    int one = 1;
+    ::setsockopt(udp_, IPPROTO_IP, IP_PKTINFO, &one, sizeof(one));
+    int buffer = 4 << 20;
+    ::setsockopt(udp_, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+    ::setsockopt(udp_, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(VIRCOM_PORT);
+    if (::bind(udp_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        error = std::format("cannot bind VirCom port {}: {}{}", VIRCOM_PORT, std::strerror(errno),
+                            errno == EADDRINUSE ? " (is a simulator running?)" : "");
+        return false;
+    }
+    set_socket_nonblocking(udp_);
+    return true;
+#endif
+}
+
+FleetCounters VirComFleet::counters() const
+{
+    FleetCounters c;
+    c.searches    = searches_.load();
+    c.replies     = replies_.load();
+    c.dropped     = dropped_.load();
+    c.send_errors = send_errors_.load();
+    return c;
+}
+
+void VirComFleet::read_searches()
+{
+#ifdef IP_PKTINFO
+    uint8_t buf[512];
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(in_pktinfo))];
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    while (true) {
+        sockaddr_in from{};
+        iovec iov{buf, sizeof(buf)};
+        msghdr msg{};
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        auto n = ::recvmsg(udp_, &msg, 0);
+        if (n < 0) return;      // drained (or a transient error)
+        if (n < 3 || buf[0] != VIRCOM_MAGIC_0 || buf[1] != VIRCOM_MAGIC_1 || buf[2] != VIRCOM_CMD_SEARCH)
+            continue;
+
+        uint32_t to = 0;
+        for (auto* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_PKTINFO) {
+                in_pktinfo info{};
+                std::memcpy(&info, CMSG_DATA(c), sizeof(info));
+                to = ntohl(info.ipi_addr.s_addr);
+            }
+        }
+
+        // Unicast to one device, or a broadcast every device hears.
+        uint32_t begin = 0, end = 0;
+        if (to >= first_ip_ && to - first_ip_ < size()) {
+            begin = to - first_ip_;
+            end = begin + 1;
+        } else if (to == INADDR_BROADCAST || ((to & 0xFF) == 0xFF && (to >> 24) != 127)) {
+            end = size();
+        }
+        if (options_.debug && begin != end)
+            portable::println("VirCom search from {} to {} device(s)", format_endpoint(from), end - begin);
+
+        auto now = Clock::now();
+        for (uint32_t i = begin; i < end; ++i) {
+            ++searches_;
+            if (devices_[i].loss > 0.0 && unit(random_) < devices_[i].loss) {
+                ++dropped_;
+                continue;
+            }
+            pending_.push_back({now + devices_[i].delay, next_sequence_++, i, from});
+            std::push_heap(pending_.begin(), pending_.end(), due_later);
+        }
+    }
+#endif
+}
+
+void VirComFleet::send_reply(const Reply& reply)
+{
+#ifdef IP_PKTINFO
+    // Answer from the device's own address.
+    const auto& response = devices_[reply.device].response;
+    iovec iov{const_cast<uint8_t*>(response.data()), response.size()};
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(in_pktinfo))]{};
+    msghdr msg{};
+    msg.msg_name = const_cast<sockaddr_in*>(&reply.to);
+    msg.msg_namelen = sizeof(reply.to);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    auto* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = IPPROTO_IP;
+    c->cmsg_type = IP_PKTINFO;
+    c->cmsg_len = CMSG_LEN(sizeof(in_pktinfo));
+    in_pktinfo info{};
+    info.ipi_spec_dst.s_addr = htonl(first_ip_ + reply.device);
+    std::memcpy(CMSG_DATA(c), &info, sizeof(info));
+
+    if (::sendmsg(udp_, &msg, 0) == static_cast<ssize_t>(response.size()))
+        ++replies_;
+    else
+        ++send_errors_;
+#else
+    (void)reply;
+#endif
+}
+
+void VirComFleet::run(const std::atomic<bool>& stop)
+{
+    while (!stop.load()) {
+        auto now = Clock::now();
+        while (!pending_.empty() && pending_.front().due <= now) {
+            std::pop_heap(pending_.begin(), pending_.end(), due_later);
+            send_reply(pending_.back());
+            pending_.pop_back();
+        }
+
+        auto wake = now + std::chrono::milliseconds(100);
+        if (!pending_.empty()) wake = std::min(wake, pending_.front().due);
+        pollfd fd{udp_, POLLIN, 0};
+
+        auto wait = std::max(wake - Clock::now(), Clock::duration::zero());
+#ifdef __linux__
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+        timespec timeout{static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+        int rc = ::ppoll(&fd, 1, &timeout, nullptr);
+#else
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(wait).count();
+        int rc = ::poll(&fd, 1, static_cast<int>(ms));
+#endif
+        if (rc < 0 && errno != EINTR) {
+            portable::println(stderr, "Error: poll failed: {}", std::strerror(errno));
+            return;
+        }
+        if (rc > 0) read_searches();
+    }
+}
+
+} // namespace waveshare
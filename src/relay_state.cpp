@@ -0,0 +1,149 @@
+#include "waveshare_modbus_commander/relay_state.hpp"
+#include "waveshare_modbus_commander/operation_stats.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <format>
+#include <sstream>
+
+namespace waveshare {
+
+bool parse_relay_mask(const std::string& text, uint8_t& mask, std::string& error)
+{
+    std::string s = text;
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    s.erase(std::remove(s.begin(), s.end(), '_'), s.end());  // 0b1011_0001
+
+    if (s.empty()) {
+        error = std::format("empty relay pattern '{}' (use 'none' to switch all relays off)", text);
+        return false;
+    }
+    if (s == "none") { mask = 0x00; return true; }
+    if (s == "all")  { mask = 0xFF; return true; }
+
+    auto parse_number = [&](const std::string& digits, int base) -> bool {
+        unsigned value = 0;
+        auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), value, base);
+        if (digits.empty() || ec != std::errc{} || ptr != digits.data() + digits.size()) {
+            error = std::format("invalid relay pattern '{}'", text);
+            return false;
+        }
+        if (value > 0xFF) {
+            error = std::format("relay pattern '{}' has more than {} relays", text, RELAY_COUNT);
+            return false;
+        }
+        mask = static_cast<uint8_t>(value);
+        return true;
+    };
+
+    if (s.starts_with("0b")) return parse_number(s.substr(2), 2);
+    if (s.starts_with("0x")) return parse_number(s.substr(2), 16);
+
+    // Otherwise a list of 1-based relay numbers.
+    uint8_t relays = 0;
+    std::istringstream iss(s);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        int relay = 0;
+        auto [ptr, ec] = std::from_chars(item.data(), item.data() + item.size(), relay);
+        if (item.empty() || ec != std::errc{} || ptr != item.data() + item.size() ||
+            relay < 1 || relay > RELAY_COUNT) {
+            error = std::format("invalid relay number '{}' in '{}' (expected 1-{})", item, text, RELAY_COUNT);
+            return false;
+        }
+        relays = static_cast<uint8_t>(relays | (1u << (relay - 1)));
+    }
+    mask = relays;
+    return true;
+}
+
+std::string format_relay_mask(uint8_t mask)
+{
+    std::string out;
+    for (int i = 0; i < RELAY_COUNT; ++i) {
+        if (!(mask & (1u << i))) continue;
+        if (!out.empty()) out += ',';
+        out += std::to_string(i + 1);
+    }
+    return out.empty() ? "none" : out;
+}
+
+RelayShadow::RelayShadow(modbus_t* ctx)
+    : ctx_(ctx)
+{
+}
+
+bool RelayShadow::refresh()
+{
+    uint8_t bits[RELAY_COUNT]{};
+    ++transactions_;
+    if (timed(StatOp::READ_COILS, [&] { return modbus_read_bits(ctx_, 0x0000, RELAY_COUNT, bits); }) != RELAY_COUNT) {
+        last_error_ = modbus_strerror(errno);
+        state_.reset();
+        return false;
+    }
+    uint8_t current = 0;
+    for (int i = 0; i < RELAY_COUNT; ++i) {
+        if (bits[i]) current = static_cast<uint8_t>(current | (1u << i));
+    }
+    state_ = current;
+    return true;
+}
+
+RelayShadow::Result RelayShadow::apply(uint8_t mask)
+{
+    if (!state_ && !refresh()) return Result::FAILED;
+
+    if (*state_ == mask) return Result::UNCHANGED;
+
+    uint8_t bits[RELAY_COUNT]{};
+    for (int i = 0; i < RELAY_COUNT; ++i) {
+        bits[i] = (mask >> i) & 1u;
+    }
+    ++transactions_;
+    if (timed(StatOp::WRITE_COILS, [&] { return modbus_write_bits(ctx_, 0x0000, RELAY_COUNT, bits); }) != RELAY_COUNT) {
+        last_error_ = modbus_strerror(errno);
+        state_.reset();  // unknown after a failed write
+        return Result::FAILED;
+    }
+    state_ = mask;
+    return Result::WRITTEN;
+}
+
+RelayShadow::Result RelayShadow::apply_change(uint8_t on, uint8_t off)
+{
+    off = static_cast<uint8_t>(off & ~on);
+    uint8_t touched = on | off;
+    if (touched == 0) return Result::UNCHANGED;
+
+    for (int first = 0; first < RELAY_COUNT;) {
+        if (!(touched & (1u << first))) { ++first; continue; }
+        int last = first;
+        while (last + 1 < RELAY_COUNT && (touched & (1u << (last + 1)))) ++last;
+
+        int count = last - first + 1;
+        int written = 0;
+        ++transactions_;
+        if (count == 1) {
+            int value = (on >> first) & 1u;
+            written = timed(StatOp::WRITE_COIL, [&] { return modbus_write_bit(ctx_, first, value); });
+        } else {
+            uint8_t bits[RELAY_COUNT]{};
+            for (int i = 0; i < count; ++i) bits[i] = (on >> (first + i)) & 1u;
+            written = timed(StatOp::WRITE_COILS, [&] { return modbus_write_bits(ctx_, first, count, bits); });
+        }
+        if (written != count) {
+            last_error_ = modbus_strerror(errno);
+            state_.reset();  // unknown after a failed write
+            return Result::FAILED;
+        }
+        first = last + 1;
+    }
+    if (state_) state_ = static_cast<uint8_t>((*state_ | on) & ~off);
+    return Result::WRITTEN;
+}
+
+} // namespace waveshare
@@ -0,0 +1,181 @@
+#include "waveshare_modbus_commander/trace.hpp"
+
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#  include <process.h>
+#else
+#  include <cerrno>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+namespace waveshare {
+
+namespace detail {
+bool tracing_enabled = false;
+}
+
+namespace {
+
+std::mutex g_mutex;
+std::string g_path;
+std::string g_events;   ///< Complete JSON event lines, each ending in ",\n"
+std::unordered_map<std::thread::id, int> g_thread_ids;
+
+int current_pid()
+{
+#ifdef _WIN32
+    return _getpid();
+#else
+    return static_cast<int>(getpid());
+#endif
+}
+
+/// Small stable number for the calling thread (the main thread is 1).
+/// Called with g_mutex held.
+int current_tid()
+{
+    auto [it, inserted] = g_thread_ids.try_emplace(std::this_thread::get_id(),
+                                                   static_cast<int>(g_thread_ids.size()) + 1);
+    return it->second;
+}
+
+/// Microseconds on the monotonic clock.  CLOCK_MONOTONIC is shared by all
+/// processes, so the events of forked children line up with the parent's.
+double to_trace_us(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration<double, std::micro>(t.time_since_epoch()).count();
+}
+
+std::string json_escape(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (unsigned char c : s) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) out += std::format("\\u{:04x}", c);
+            else out += static_cast<char>(c);
+        }
+    }
+    return out;
+}
+
+std::string args_of(const std::string& detail)
+{
+    return detail.empty() ? std::string{} : std::format(R"(,"args":{{"detail":"{}"}})", json_escape(detail));
+}
+
+void add_process_name(const std::string& name)
+{
+    g_events += std::format(R"({{"name":"process_name","ph":"M","pid":{},"tid":0,"args":{{"name":"{}"}}}},)",
+                            current_pid(), json_escape(name));
+    g_events += '\n';
+}
+
+/// Append g_events to the trace file and clear it.  Called with g_mutex
+/// held.
+void write_events()
+{
+    if (g_events.empty()) return;
+#ifdef _WIN32
+    std::ofstream out(g_path, std::ios::app | std::ios::binary);
+    out << g_events;
+#else
+    // One O_APPEND write per flush keeps the lines of concurrently
+    // flushing processes apart.
+    int fd = ::open(g_path.c_str(), O_WRONLY | O_APPEND);
+    if (fd >= 0) {
+        size_t done = 0;
+        while (done < g_events.size()) {
+            auto n = ::write(fd, g_events.data() + done, g_events.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += static_cast<size_t>(n);
+        }
+        ::close(fd);
+    }
+#endif
+    g_events.clear();
+}
+
+/// Buffered bytes after which events are written out, so that long runs
+/// (--watch-digital-inputs, --interlock) do not hold them all in memory.
+constexpr size_t FLUSH_THRESHOLD = 1 << 20;
+
+void add_event(const std::string& line)
+{
+    g_events += line;
+    g_events += '\n';
+    if (g_events.size() >= FLUSH_THRESHOLD) write_events();
+}
+
+} // anonymous namespace
+
+bool start_trace(const std::string& path, std::string& error)
+{
+#if WAVESHARE_HAVE_TRACE
+    std::ofstream out(path, std::ios::trunc);
+    if (!(out << "[\n") || !out.flush()) {
+        error = std::format("cannot write trace file '{}'", path);
+        return false;
+    }
+    std::lock_guard lock(g_mutex);
+    g_path = path;
+    g_events.clear();
+    add_process_name("waveshare-commander");
+    detail::tracing_enabled = true;
+    return true;
+#else
+    error = std::format("cannot write '{}': this build has no tracing (WAVESHARE_TRACING=OFF)", path);
+    return false;
+#endif
+}
+
+void flush_trace()
+{
+    if (!tracing_enabled()) return;
+    std::lock_guard lock(g_mutex);
+    write_events();
+}
+
+void trace_forked(const std::string& name)
+{
+    if (!tracing_enabled()) return;
+    std::lock_guard lock(g_mutex);
+    g_events.clear();
+    g_thread_ids.clear();
+    add_process_name(std::format("waveshare-commander [{}]", name));
+}
+
+void trace_instant(const char* name, const std::string& detail)
+{
+    if (!tracing_enabled()) return;
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard lock(g_mutex);
+    add_event(std::format(R"({{"name":"{}","ph":"i","s":"t","ts":{:.3f},"pid":{},"tid":{}{}}},)",
+                          json_escape(name), to_trace_us(now), current_pid(), current_tid(), args_of(detail)));
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (!name_) return;
+    auto end = std::chrono::steady_clock::now();
+    std::lock_guard lock(g_mutex);
+    add_event(std::format(R"({{"name":"{}","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":{},"tid":{}{}}},)",
+                          json_escape(name_), to_trace_us(start_),
+                          std::chrono::duration<double, std::micro>(end - start_).count(),
+                          current_pid(), current_tid(), args_of(detail_)));
+}
+
+} // namespace waveshare
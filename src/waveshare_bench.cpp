@@ -0,0 +1,280 @@
+// End-to-end benchmark of the commander's actions against the loopback
+// relay simulator: every run is a real waveshare-commander process, so
+// the figures include process start, connect and discovery.
+
+#include "waveshare_modbus_commander/latency_histogram.hpp"
+#include "waveshare_modbus_commander/portable_print.hpp"
+#include "waveshare_modbus_commander/relay_simulator.hpp"
+#include "CLI/CLI.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace
+{
+    /// One benchmarked command line.  Run i uses variants[i % size], so
+    /// writes can alternate and configuration changes are real changes.
+    struct BenchCase {
+        const char* name;
+        std::vector<std::vector<std::string>> variants;
+    };
+
+    std::vector<BenchCase> bench_cases()
+    {
+        return {
+            {"read-coil",           {{"--read-coil", "0"}}},
+            {"read-coils",          {{"--read-coils", "0", "8"}}},
+            {"write-coil",          {{"--write-coil", "0", "on"}, {"--write-coil", "0", "off"}}},
+            {"write-coils",         {{"--write-coils", "0", "on", "1", "off"}, {"--write-coils", "0", "off", "1", "on"}}},
+            {"set-relays",          {{"--set-relays", "0b10110001"}, {"--set-relays", "none"}}},
+            {"read-register",       {{"--read-register", "0"}}},
+            {"read-registers",      {{"--read-registers", "0", "8"}}},
+            {"write-register",      {{"--write-register", "0", "42"}}},
+            {"write-registers",     {{"--write-registers", "0", "1", "2", "3", "4"}}},
+            {"read-digital-inputs", {{"--read-digital-inputs"}}},
+            {"pipelined",           {{"--read-digital-inputs", "--read-coils", "0", "8",
+                                      "--read-registers", "0", "8", "--pipeline", "4"}}},
+            {"scan-network",        {{"--scan-network", "--adaptive-scan", "--scan-timeout", "1000"}}},
+            {"set-name",            {{"--set-name", "BENCH02"}, {"--set-name", "BENCH01"}}},
+        };
+    }
+
+    /// Run @p args to completion with stdout and stderr going to @p out_fd
+    /// (or inherited if -1).  @return the exit code, or -1 if it could
+    /// not be started.
+    int run_process(const std::vector<std::string>& args, int out_fd)
+    {
+        std::vector<char*> argv;
+        for (const auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+        argv.push_back(nullptr);
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        if (out_fd != -1) {
+            posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+            posix_spawn_file_actions_adddup2(&actions, out_fd, STDERR_FILENO);
+        }
+        pid_t pid = -1;
+        int rc = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        if (rc != 0) {
+            portable::println(stderr, "Error: cannot start {}: {}", args[0], std::strerror(rc));
+            return -1;
+        }
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+
+    /// Contents of @p fd from the start.
+    std::string read_all(int fd)
+    {
+        std::string text;
+        char buf[4096];
+        ::lseek(fd, 0, SEEK_SET);
+        ssize_t n;
+        while ((n = ::read(fd, buf, sizeof(buf))) > 0) text.append(buf, static_cast<size_t>(n));
+        return text;
+    }
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    std::string commander, latency, jitter, reboot_time;
+    std::vector<std::string> only;
+    int runs = 0, warmup = 0, port = 0, timeout = 0;
+    double loss = 0;
+    bool list = false, debug = false;
+
+    CLI::App app{"Benchmark the commander's actions end to end against the loopback relay simulator"};
+    app.set_help_flag("-h,--help", "Show all available options");
+    app.set_version_flag("-V,--version", PROJECT_VERSION, "Show program version");
+
+    app.add_option("--commander", commander, "waveshare-commander binary (default: next to this one)");
+    app.add_option("-n,--runs", runs, "Measured runs per action")
+        ->default_val(20)
+        ->check(CLI::PositiveNumber);
+    app.add_option("--warmup", warmup, "Unmeasured runs per action")
+        ->default_val(1)
+        ->check(CLI::NonNegativeNumber);
+    app.add_option("--only", only, "Benchmark only these actions (see --list)");
+    app.add_flag("--list", list, "List the actions and exit");
+    app.add_option("-p,--port", port, "Modbus TCP port of the simulator")
+        ->default_val(5020)
+        ->check(CLI::Range(1, 65535));
+    app.add_option("-t,--timeout", timeout, "Commander timeout in seconds")
+        ->default_val(1)
+        ->check(CLI::PositiveNumber);
+    app.add_option("--latency", latency, "Simulated reply delay (e.g. 2ms)")
+        ->default_val("0");
+    app.add_option("--jitter", jitter, "Random extra reply delay of up to this much")
+        ->default_val("0");
+    app.add_option("--loss", loss, "Probability that the simulator drops a request (0-1)")
+        ->default_val(0.0)
+        ->check(CLI::Range(0.0, 1.0));
+    app.add_option("--reboot-time", reboot_time, "Simulated reboot after a SET_CONFIG")
+        ->default_val("200ms");
+    app.add_flag("-d,--debug", debug, "Show the commander's output");
+
+    try
+    {
+        app.parse(argc, argv);
+    }
+    catch (const CLI::ParseError &e)
+    {
+        return app.exit(e);
+    }
+
+    auto cases = bench_cases();
+    if (list) {
+        for (const auto& c : cases) {
+            std::string line;
+            for (const auto& arg : c.variants.front()) line += " " + arg;
+            portable::println("{:<20}{}", c.name, line);
+        }
+        return EXIT_SUCCESS;
+    }
+    if (!only.empty()) {
+        for (const auto& name : only) {
+            if (std::none_of(cases.begin(), cases.end(), [&](const BenchCase& c) { return name == c.name; })) {
+                portable::println(stderr, "Error: unknown action '{}' (see --list)", name);
+                return EXIT_FAILURE;
+            }
+        }
+        std::erase_if(cases, [&](const BenchCase& c) {
+            return std::find(only.begin(), only.end(), c.name) == only.end();
+        });
+    }
+
+    if (commander.empty()) {
+        auto dir = std::filesystem::path(argv[0]).parent_path();
+        commander = dir.empty() ? "waveshare-commander" : (dir / "waveshare-commander").string();
+    }
+
+    waveshare::SimulatorOptions sim;
+    sim.modbus_port = static_cast<uint16_t>(port);
+    sim.device_name = "BENCH01";
+    sim.loss = loss;
+    auto parse_option = [](const char* name, const std::string& text, auto& out) {
+        std::chrono::nanoseconds d{};
+        if (!waveshare::parse_duration(text, d)) {
+            portable::println(stderr, "Error: invalid {} '{}' (e.g. 1.5s, 20ms or 500us)", name, text);
+            return false;
+        }
+        out = std::chrono::duration_cast<std::remove_reference_t<decltype(out)>>(d);
+        return true;
+    };
+    if (!parse_option("--latency", latency, sim.latency) ||
+        !parse_option("--jitter", jitter, sim.jitter) ||
+        !parse_option("--reboot-time", reboot_time, sim.reboot_time))
+        return EXIT_FAILURE;
+
+    waveshare::RelaySimulator simulator(sim);
+    std::string error;
+    if (!simulator.start(error)) {
+        portable::println(stderr, "Error: {}", error);
+        return EXIT_FAILURE;
+    }
+    std::atomic<bool> stop{false};
+    std::thread server([&] { simulator.run(stop); });
+
+    // Output of the current run, kept for the first failure of an action.
+    char out_path[] = "/tmp/waveshare-bench-XXXXXX";
+    int out_fd = debug ? -1 : ::mkstemp(out_path);
+    if (out_fd != -1) ::unlink(out_path);
+
+    const std::vector<std::string> common = {
+        commander, "-i", sim.ip_address, "-p", std::to_string(port),
+        "-t", std::to_string(timeout), "--no-cache",
+    };
+
+    portable::println("Benchmarking {} against the simulator on {}:{} "
+                      "(latency {}, jitter {}, loss {:.1f} %), {} run(s) per action\n",
+                      commander, sim.ip_address, port, latency, jitter, loss * 100, runs);
+    portable::println("{:<20}  {:>5}  {:>6}  {:>8}  {:>9}  {:>9}  {:>9}  {:>9}  {:>8}",
+                      "Action", "Runs", "Failed", "ops/s", "p50", "p90", "p99", "max", "Packets");
+    portable::println("{:-<20}  {:->5}  {:->6}  {:->8}  {:->9}  {:->9}  {:->9}  {:->9}  {:->8}",
+                      "", "", "", "", "", "", "", "", "");
+    std::string failures;
+
+    int total_failed = 0;
+    for (const auto& c : cases) {
+        waveshare::LatencyHistogram latency_hist;
+        int failed = 0;
+        bool shown = false;
+        std::chrono::nanoseconds busy{};
+        waveshare::SimulatorCounters before{};
+        for (int i = 0; i < warmup + runs; ++i) {
+            if (i == warmup) before = simulator.counters();
+            auto args = common;
+            const auto& variant = c.variants[static_cast<size_t>(i) % c.variants.size()];
+            args.insert(args.end(), variant.begin(), variant.end());
+            if (out_fd != -1 && ::ftruncate(out_fd, 0) == 0) ::lseek(out_fd, 0, SEEK_SET);
+
+            auto start = std::chrono::steady_clock::now();
+            int rc = run_process(args, out_fd);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            if (rc < 0) {
+                stop = true;
+                server.join();
+                return EXIT_FAILURE;
+            }
+            if (i < warmup) continue;
+
+            latency_hist.record(elapsed);
+            busy += elapsed;
+            if (rc != 0) {
+                ++failed;
+                if (!shown && out_fd != -1) {
+                    failures += std::format("\n{} failed (exit {}):\n{}", c.name, rc, read_all(out_fd));
+                    shown = true;
+                }
+            }
+        }
+        auto after = simulator.counters();
+        double packets = static_cast<double>((after.modbus_requests - before.modbus_requests) +
+                                             (after.vircom_requests - before.vircom_requests)) / runs;
+        double ops = busy.count() > 0 ? runs / std::chrono::duration<double>(busy).count() : 0.0;
+        total_failed += failed;
+        portable::println("{:<20}  {:>5}  {:>6}  {:>8.1f}  {:>9}  {:>9}  {:>9}  {:>9}  {:>8.1f}",
+                          c.name, runs, failed, ops,
+                          waveshare::format_duration(latency_hist.percentile(50)),
+                          waveshare::format_duration(latency_hist.percentile(90)),
+                          waveshare::format_duration(latency_hist.percentile(99)),
+                          waveshare::format_duration(latency_hist.max()),
+                          packets);
+        std::fflush(stdout);
+    }
+
+    stop = true;
+    server.join();
+    if (out_fd != -1) ::close(out_fd);
+
+    auto totals = simulator.counters();
+    portable::println("\nSimulator: {} Modbus request(s) ({} dropped) on {} connection(s), "
+                      "{} VirCom request(s) ({} dropped), {} reboot(s).",
+                      totals.modbus_requests, totals.modbus_dropped, totals.connections,
+                      totals.vircom_requests, totals.vircom_dropped, totals.reboots);
+    std::fflush(stdout);
+    if (!failures.empty()) portable::println(stderr, "{}", failures);
+    return total_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
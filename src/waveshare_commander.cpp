@@ -1,16 +1,32 @@
 #include "libmodbus_cpp/modbus_connection.hpp"
-#include "libwaveshare/create_modbus_connection.hpp"
-#include "libwaveshare/network_scanner.hpp"
-#include "libwaveshare/portable_print.hpp"
 #include "waveshare_modbus_commander/cli_parser.hpp"
+#include "waveshare_modbus_commander/commander_daemon.hpp"
+#include "waveshare_modbus_commander/discovery_cache.hpp"
+#include "waveshare_modbus_commander/fleet_runner.hpp"
+#include "waveshare_modbus_commander/input_poller.hpp"
+#include "waveshare_modbus_commander/interlock.hpp"
+#include "waveshare_modbus_commander/modbus_batch.hpp"
+#include "waveshare_modbus_commander/modbus_connection_pool.hpp"
+#include "waveshare_modbus_commander/modbus_pipeline.hpp"
+#include "waveshare_modbus_commander/network_scanner.hpp"
+#include "waveshare_modbus_commander/operation_stats.hpp"
+#include "waveshare_modbus_commander/portable_print.hpp"
+#include "waveshare_modbus_commander/provision_manifest.hpp"
+#include "waveshare_modbus_commander/relay_sequence.hpp"
+#include "waveshare_modbus_commander/relay_state.hpp"
+#include "waveshare_modbus_commander/trace.hpp"
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <csignal>
 #include <cstdlib>
 #include <format>
 #include <functional>
+#include <map>
 #include <optional>
+#include <set>
 #include <stdexcept>
 #include <thread>
 #include <vector>
@@ -25,6 +41,21 @@ namespace
         g_interrupted.store(true, std::memory_order_relaxed);
     }
 
+    /// Sleep until @p deadline in short slices so that Ctrl-C is noticed.
+    /// @return false if interrupted first.
+    bool sleep_until_interruptible(std::chrono::steady_clock::time_point deadline)
+    {
+        constexpr auto SLICE = std::chrono::milliseconds(50);
+        while (!g_interrupted.load(std::memory_order_relaxed))
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+                return true;
+            std::this_thread::sleep_until(std::min(deadline, now + SLICE));
+        }
+        return false;
+    }
+
     bool try_parse_coil_state(const std::string &state_token, bool &state)
     {
         if (state_token == "on" || state_token == "ON" ||
@@ -58,7 +89,9 @@ namespace
                 return;
             }
 
-            if (conn.write_coil(static_cast<uint16_t>(addr), state))
+            if (waveshare::timed(waveshare::StatOp::WRITE_COIL, [&] {
+                    return conn.write_coil(static_cast<uint16_t>(addr), state);
+                }))
             {
                 portable::println("Coil 0x{:04X} = {} (SUCCESS)", addr, state ? "ON" : "OFF");
             }
@@ -74,12 +107,12 @@ namespace
     }
 }
 
-int main(int argc, char *argv[])
+// Execute the actions of @p options against one device or, with several
+// targets, against each of them.
+int run_actions(waveshare::CommandLineOptions options)
 {
     try
     {
-        auto options = waveshare::parse_command_line(argc, argv);
-
         if (options.debug)
         {
             portable::println("========================");
@@ -94,18 +127,206 @@ int main(int argc, char *argv[])
         }
 
         // Check if any action requires a Modbus connection
-        bool needs_connection = false;
-        for (const auto& action : options.actions) {
-            if (action != waveshare::CommandLineAction::SCAN_NETWORK &&
-                action != waveshare::CommandLineAction::SET_STATIC_IP &&
-                action != waveshare::CommandLineAction::SET_DHCP &&
-                action != waveshare::CommandLineAction::SET_MODBUS_TCP &&
-                action != waveshare::CommandLineAction::SET_MODBUS_TCP_PORT &&
-                action != waveshare::CommandLineAction::SET_NAME &&
-                action != waveshare::CommandLineAction::NONE) {
-                needs_connection = true;
-                break;
+        auto needs_modbus = [](waveshare::CommandLineAction action) {
+            return action != waveshare::CommandLineAction::SCAN_NETWORK &&
+                   action != waveshare::CommandLineAction::SET_STATIC_IP &&
+                   action != waveshare::CommandLineAction::SET_DHCP &&
+                   action != waveshare::CommandLineAction::SET_MODBUS_TCP &&
+                   action != waveshare::CommandLineAction::SET_MODBUS_TCP_PORT &&
+                   action != waveshare::CommandLineAction::SET_NAME &&
+                   action != waveshare::CommandLineAction::PROVISION &&
+                   action != waveshare::CommandLineAction::NONE;
+        };
+        bool needs_connection = std::any_of(options.actions.begin(), options.actions.end(), needs_modbus);
+
+        // With --pipeline, coil/register/input actions go through the
+        // pipelined transport instead of the libmodbus connection.
+        auto pipelinable = [&options](waveshare::CommandLineAction action) {
+            if (options.pipeline_depth <= 1) return false;
+            switch (action)
+            {
+            case waveshare::CommandLineAction::READ_COIL:
+            case waveshare::CommandLineAction::READ_COILS:
+            case waveshare::CommandLineAction::WRITE_COIL:
+            case waveshare::CommandLineAction::WRITE_COILS:
+            case waveshare::CommandLineAction::READ_REGISTER:
+            case waveshare::CommandLineAction::READ_REGISTERS:
+            case waveshare::CommandLineAction::WRITE_REGISTER:
+            case waveshare::CommandLineAction::WRITE_REGISTERS:
+            case waveshare::CommandLineAction::READ_DIGITAL_INPUTS:
+                return true;
+            default:
+                return false;
+            }
+        };
+        bool needs_pipeline = std::any_of(options.actions.begin(), options.actions.end(), pipelinable);
+        bool needs_libmodbus = std::any_of(options.actions.begin(), options.actions.end(),
+                                           [&](auto action) { return needs_modbus(action) && !pipelinable(action); });
+
+        // Scan parameters shared by every discovery below.
+        auto scan_options = [&options](std::string target_ip,
+                                       std::function<bool(const waveshare::DiscoveredDevice&)> stop_when) {
+            waveshare::ScanOptions scan;
+            scan.timeout_ms    = options.scan_timeout_ms;
+            scan.debug         = options.debug;
+            scan.target_ip     = std::move(target_ip);
+            scan.extra_subnets = options.extra_subnets;
+            scan.probe_rate    = options.probe_rate;
+            scan.adaptive      = options.adaptive_scan;
+            scan.stop_when     = std::move(stop_when);
+            return scan;
+        };
+
+        // Discovery cache: device addresses rarely change, so a lookup is
+        // first answered from the last scan and confirmed with a single
+        // unicast probe.  Only a miss falls back to the full scan.
+        waveshare::DiscoveryCache cache(options.use_cache
+                                            ? waveshare::DiscoveryCache::default_path()
+                                            : std::string{});
+        cache.load();
+
+        // Fleet members leave the cache to the parent, whose scan has just
+        // refreshed it; concurrent saves would only race each other.
+        auto remember = [&](const std::vector<waveshare::DiscoveredDevice>& devices) {
+            if (!options.use_cache || options.fleet_member || devices.empty()) return;
+            cache.update(devices);
+            if (!cache.save() && options.debug)
+                portable::println("Could not write discovery cache {}", waveshare::DiscoveryCache::default_path());
+        };
+
+        auto lookup_cached = [&](const std::string& mac, const std::string& name, const std::string& ip)
+            -> std::optional<waveshare::DiscoveredDevice>
+        {
+            constexpr int CACHE_PROBE_TIMEOUT_MS = 300;
+            auto hit = cache.find(mac, name, ip, options.cache_ttl_seconds);
+            if (!hit) return std::nullopt;
+
+            auto fresh = waveshare::probe_device(hit->ip_address, hit->mac_address,
+                                                 std::min(options.scan_timeout_ms, CACHE_PROBE_TIMEOUT_MS),
+                                                 options.debug);
+            if (!fresh || (!name.empty() && fresh->device_name != name)) {
+                if (options.debug)
+                    portable::println("Cached address {} of {} did not confirm — scanning",
+                                      hit->ip_address, hit->mac_address);
+                return std::nullopt;
+            }
+            if (options.debug)
+                portable::println("Resolved {} from discovery cache at {}",
+                                  fresh->mac_address, fresh->ip_address);
+            remember({*fresh});
+            return fresh;
+        };
+
+        // Full scan; last-known addresses are probed first and the result
+        // refreshes the cache.
+        auto scan_and_remember = [&](waveshare::ScanOptions scan) {
+            if (options.use_cache)
+                scan.priority_ips = cache.known_ips(options.cache_ttl_seconds);
+            auto devices = waveshare::scan_network(scan);
+            remember(devices);
+            return devices;
+        };
+
+        // Several targets (-i/--mac/--name given more than once, or
+        // --all-discovered): resolve them all with one scan, then run the
+        // actions against every device in parallel.
+        if (options.all_discovered || options.target_ips.size() > 1 ||
+            options.target_macs.size() > 1 || options.target_names.size() > 1)
+        {
+            WAVESHARE_TRACE_SPAN("fleet");
+            for (auto action : options.actions) {
+                if (action == waveshare::CommandLineAction::SCAN_NETWORK ||
+                    action == waveshare::CommandLineAction::PROVISION) {
+                    portable::println(stderr, "Error: --scan-network and --provision cannot be used with several targets.");
+                    return EXIT_FAILURE;
+                }
             }
+
+            std::vector<waveshare::FleetTarget> targets;
+            for (const auto& ip : options.target_ips)
+                targets.push_back({ip, ip, options.port, "", ""});
+
+            if (options.all_discovered || !options.target_macs.empty() || !options.target_names.empty()) {
+                // When only MACs are listed, the scan ends once all of
+                // them have answered.  Names need the full scan, which
+                // shows whether a name is shared by several devices.
+                std::set<std::string> missing(options.target_macs.begin(), options.target_macs.end());
+                std::function<bool(const waveshare::DiscoveredDevice&)> stop_when;
+                if (!options.all_discovered && options.target_names.empty()) {
+                    stop_when = [&](const waveshare::DiscoveredDevice& d) {
+                        missing.erase(d.mac_address);
+                        return missing.empty();
+                    };
+                }
+                auto devices = scan_and_remember(scan_options("", stop_when));
+
+                auto add_device = [&](const waveshare::DiscoveredDevice& d) {
+                    int port = (options.port == 502 && d.port != 0) ? d.port : options.port;
+                    targets.push_back({d.device_name, d.ip_address, port, d.mac_address, ""});
+                };
+                if (options.all_discovered) {
+                    for (const auto& d : devices) add_device(d);
+                }
+                auto add_named = [&](const std::string& mac, const std::string& name) {
+                    std::string error;
+                    if (const auto* dev = waveshare::resolve_target_device(devices, mac, name, "", error))
+                        add_device(*dev);
+                    else
+                        targets.push_back({mac.empty() ? name : mac, "", options.port, mac, "not found"});
+                };
+                for (const auto& mac : options.target_macs)   add_named(mac, "");
+                for (const auto& name : options.target_names) add_named("", name);
+            }
+
+            // A device selected twice runs once; a name shared by several
+            // devices would make the output ambiguous, so those use the IP.
+            std::set<std::string> seen;
+            std::erase_if(targets, [&](const waveshare::FleetTarget& t) {
+                return t.error.empty() && !seen.insert(std::format("{}:{}", t.ip_address, t.port)).second;
+            });
+            std::map<std::string, int> label_count;
+            for (const auto& t : targets) ++label_count[t.label];
+            for (auto& t : targets) {
+                if (t.error.empty() && (t.label.empty() || label_count[t.label] > 1)) t.label = t.ip_address;
+            }
+            if (targets.empty()) {
+                portable::println(stderr, "No devices found on the network.");
+                return EXIT_FAILURE;
+            }
+
+            auto results = waveshare::run_on_fleet(targets, options.parallel,
+                [&options](const waveshare::FleetTarget& target) {
+                    auto single = options;
+                    single.all_discovered    = false;
+                    single.target_ips        = {target.ip_address};
+                    single.target_macs.clear();
+                    single.target_names.clear();
+                    single.ip_address        = target.ip_address;
+                    single.port              = target.port;
+                    // Modbus actions use the address resolved above as is;
+                    // VirCom actions identify the device by its MAC.
+                    single.ip_explicitly_set = true;
+                    single.target_mac        = target.mac_address;
+                    single.fleet_member      = true;
+                    single.target_name.clear();
+                    // The statistics so far belong to the discovery above.
+                    waveshare::reset_operation_stats();
+                    waveshare::trace_forked(target.label);
+                    int rc = EXIT_FAILURE;
+                    {
+                        WAVESHARE_TRACE_SPAN("device", target.label);
+                        rc = run_actions(std::move(single));
+                    }
+                    waveshare::flush_trace();
+                    if (options.stats)
+                        portable::println("\n{}", waveshare::format_operation_stats());
+                    return rc;
+                });
+
+            portable::println("{}", waveshare::format_fleet_results(results));
+            bool all_ok = std::all_of(results.begin(), results.end(),
+                                      [](const auto& r) { return r.ran && r.exit_code == 0; });
+            return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
         }
 
         // When a Modbus connection is needed and --name or --mac was given
@@ -114,9 +335,14 @@ int main(int argc, char *argv[])
             !options.ip_explicitly_set &&
             (!options.target_mac.empty() || !options.target_name.empty()))
         {
-            auto devices = waveshare::scan_network(options.scan_timeout_ms,
-                                                   options.debug, "",
-                                                   options.extra_subnets);
+            WAVESHARE_TRACE_SPAN("resolve target");
+            std::vector<waveshare::DiscoveredDevice> devices;
+            if (auto cached = lookup_cached(options.target_mac, options.target_name, "")) {
+                devices.push_back(std::move(*cached));
+            } else {
+                devices = scan_and_remember(scan_options(
+                    "", waveshare::make_target_matcher(options.target_mac, options.target_name, "")));
+            }
             std::string error;
             auto* dev = waveshare::resolve_target_device(
                 devices, options.target_mac, options.target_name, "", error);
@@ -135,9 +361,21 @@ int main(int argc, char *argv[])
         }
 
         // Create and connect to device (only if needed)
-        std::optional<libmodbus_cpp::ModbusConnection> conn;
-        if (needs_connection) {
-            conn = waveshare::create_modbus_connection(options.ip_address, options.port, options.timeout_seconds);
+        // Connections come from the pool, which a --daemon keeps open
+        // between commands.
+        libmodbus_cpp::ModbusConnection *conn = nullptr;
+        std::optional<waveshare::PipelinedModbusClient> pipeline;
+        if (needs_pipeline) {
+            pipeline.emplace(options.ip_address, options.port, options.timeout_seconds * 1000,
+                             options.pipeline_depth);
+            pipeline->set_debug(options.debug);
+            std::string error;
+            if (!pipeline->connect(error))
+                throw std::runtime_error(std::format("Failed to connect to device: {}\n\nat {}:{}\n",
+                                                     error, options.ip_address, options.port));
+        }
+        if (needs_libmodbus) {
+            conn = &waveshare::modbus_connection_pool().get(options.ip_address, options.port, options.timeout_seconds);
 
             if (options.debug)
             {
@@ -158,18 +396,34 @@ int main(int argc, char *argv[])
         auto resolve_device = [&](std::vector<waveshare::DiscoveredDevice>& devices)
             -> const waveshare::DiscoveredDevice*
         {
+            WAVESHARE_TRACE_SPAN("resolve device");
             std::string target;
             if (options.ip_explicitly_set) target = options.ip_address;
 
-            devices = waveshare::scan_network(options.scan_timeout_ms,
-                                              options.debug, target,
-                                              options.extra_subnets);
-
+            // A fleet member also carries the address its parent resolved,
+            // but the MAC alone identifies it.
+            bool by_mac = !resolved_mac.empty() || (options.fleet_member && !options.target_mac.empty());
             std::string mac  = !resolved_mac.empty() ? resolved_mac : options.target_mac;
             std::string name = !resolved_mac.empty() ? ""           : options.target_name;
-            std::string ip   = !resolved_mac.empty() ? ""
+            std::string ip   = by_mac ? ""
                              : (options.ip_explicitly_set ? options.ip_address : "");
 
+            // A fleet member's address was resolved a moment ago: ask the
+            // device there directly instead of the cache.
+            std::optional<waveshare::DiscoveredDevice> known;
+            if (options.fleet_member && resolved_mac.empty() && !mac.empty())
+                known = waveshare::probe_device(options.ip_address, mac, options.scan_timeout_ms, options.debug);
+            else
+                known = lookup_cached(mac, name, ip);
+
+            // Stop scanning as soon as the wanted device has answered.
+            if (known) {
+                devices = {std::move(*known)};
+            } else {
+                devices = scan_and_remember(scan_options(
+                    target, waveshare::make_target_matcher(mac, name, ip)));
+            }
+
             std::string error;
             const auto* dev = waveshare::resolve_target_device(
                 devices, mac, name, ip, error);
@@ -178,6 +432,7 @@ int main(int argc, char *argv[])
                 auto reappeared = waveshare::wait_for_device_reboot(
                     resolved_mac, options.wait_timeout_ms, options.debug);
                 if (reappeared) {
+                    remember({*reappeared});
                     devices = {*reappeared};
                     return &devices[0];
                 }
@@ -193,23 +448,151 @@ int main(int argc, char *argv[])
             return dev;
         };
 
-        // Resolve target, apply a VirCom configuration, wait for reboot.
-        // `configure` receives the resolved device and returns true on success.
-        auto resolve_configure_wait = [&](
-            std::function<bool(const waveshare::DiscoveredDevice&)> configure) -> int
+        // The part of the VirCom configuration an action changes, or
+        // std::nullopt for actions that are not configuration changes.
+        auto config_change_for = [&](waveshare::CommandLineAction action)
+            -> std::optional<waveshare::DeviceConfigChange>
         {
+            waveshare::DeviceConfigChange change;
+            switch (action)
+            {
+            case waveshare::CommandLineAction::SET_STATIC_IP:
+                change.ip      = options.set_ip_address;
+                change.mask    = options.set_subnet_mask;
+                change.gateway = options.set_gateway;
+                change.dns     = options.set_dns;
+                change.dhcp    = false;
+                return change;
+            case waveshare::CommandLineAction::SET_DHCP:
+                change.dhcp = true;
+                return change;
+            case waveshare::CommandLineAction::SET_MODBUS_TCP:
+                change.modbus_tcp = true;
+                change.port = static_cast<uint16_t>(options.modbus_tcp_port);
+                return change;
+            case waveshare::CommandLineAction::SET_MODBUS_TCP_PORT:
+                change.port = static_cast<uint16_t>(options.set_port_value);
+                return change;
+            case waveshare::CommandLineAction::SET_NAME:
+                change.name = options.set_name;
+                return change;
+            default:
+                return std::nullopt;
+            }
+        };
+
+        // Resolve the target, apply @p change with one SET_CONFIG and wait
+        // for the single reboot that follows.
+        auto configure_device = [&](const waveshare::DeviceConfigChange& change) -> int
+        {
+            portable::println("=== Configure Device: {} ===", waveshare::format_config_change(change));
+
             std::vector<waveshare::DiscoveredDevice> devices;
             const auto* dev = resolve_device(devices);
             if (!dev) return EXIT_FAILURE;
 
-            if (!configure(*dev)) {
-                portable::println(stderr, "Failed to send configuration.");
-                return EXIT_FAILURE;
+            portable::println("Target: {} ({}, {})",
+                              dev->device_name, dev->mac_address, dev->ip_address);
+
+            // Skip the SET_CONFIG (and the reboot it causes) if the device
+            // already has the requested configuration.
+            std::array<uint8_t, waveshare::VIRCOM_PACKET_SIZE> packet{};
+            if (!waveshare::build_config_packet(*dev, change, packet)) return EXIT_FAILURE;
+            auto diff = waveshare::diff_config_packet(*dev, packet);
+            if (diff.empty()) {
+                portable::println("Device {} already configured.", dev->mac_address);
+                return EXIT_SUCCESS;
+            }
+            if (options.dry_run) {
+                portable::println("Dry run: {} byte(s) would change on device {}:",
+                                  diff.size(), dev->mac_address);
+                portable::println("{}", waveshare::format_config_diff(diff));
+                return EXIT_SUCCESS;
             }
 
-            auto reappeared = waveshare::wait_for_device_reboot(
-                dev->mac_address, options.wait_timeout_ms, options.debug);
-            return reappeared ? EXIT_SUCCESS : EXIT_FAILURE;
+            waveshare::RebootWatchOptions watch;
+            watch.wait_timeout_ms = options.wait_timeout_ms;
+            watch.debug           = options.debug;
+            watch.expected_ip     = change.expected_ip();
+            watch.previous_ip     = dev->ip_address;
+            if (options.wait_modbus)
+                watch.modbus_port = change.port.value_or(dev->port);
+
+            // A device that comes back with its old configuration never got
+            // the packet (or its silence was only lost probes): send it
+            // again while the attempt budget lasts.
+            waveshare::ConfigDeliveryOptions delivery_options;
+            delivery_options.debug = options.debug;
+            int attempts_left = delivery_options.max_attempts;
+            while (true) {
+                delivery_options.max_attempts = attempts_left;
+                auto delivery = waveshare::deliver_device_config(*dev, change, delivery_options);
+                if (!delivery.acknowledged) {
+                    portable::println(stderr, "Failed to send configuration.");
+                    return EXIT_FAILURE;
+                }
+                attempts_left -= delivery.attempts;
+                portable::println("Configuration confirmed by device {} ({}; {} attempt(s), {} packet(s), {} ms).",
+                                  dev->mac_address,
+                                  delivery.went_silent ? "rebooting" : "read back",
+                                  delivery.attempts, delivery.packets_sent, delivery.elapsed_ms);
+
+                watch.already_silent = delivery.went_silent;
+                auto reappeared = waveshare::wait_for_device_reboot(dev->mac_address, watch);
+                if (!reappeared) return EXIT_FAILURE;
+                remember({*reappeared});
+                if (!waveshare::diff_config_packet(*reappeared, dev->raw_response).empty()) {
+                    portable::println("{}", waveshare::format_device_table({*reappeared}));
+                    return EXIT_SUCCESS;
+                }
+                if (attempts_left <= 0) {
+                    portable::println(stderr, "Device {} answers with its previous configuration; "
+                                              "the change was not applied.", dev->mac_address);
+                    return EXIT_FAILURE;
+                }
+                portable::println("Device {} answers with its previous configuration; resending "
+                                  "({} attempt(s) left).", dev->mac_address, attempts_left);
+            }
+        };
+
+        // Consecutive configuration actions are merged into one change so
+        // the device is configured and rebooted once.
+        waveshare::DeviceConfigChange pending_config;
+        auto flush_config = [&]() -> int {
+            if (pending_config.empty()) return EXIT_SUCCESS;
+            WAVESHARE_TRACE_SPAN("configure device", waveshare::format_config_change(pending_config));
+            auto rc = configure_device(pending_config);
+            pending_config = {};
+            return rc;
+        };
+
+        if (options.set_name.size() > 9) {
+            portable::println(stderr, "Error: Device name '{}' is too long (max 9 characters, got {}).",
+                              options.set_name, options.set_name.size());
+            return EXIT_FAILURE;
+        }
+
+        // Parse a Modbus address; invalid ones are reported.
+        auto parse_address = [](const std::string& text) -> std::optional<uint16_t> {
+            try {
+                auto addr = std::stoi(text, nullptr, 0);
+                if (addr < 0 || addr > 0xFFFF)
+                    throw std::out_of_range(std::format("address {} out of range", text));
+                return static_cast<uint16_t>(addr);
+            }
+            catch (const std::exception& e) {
+                portable::println("Error: {}", e.what());
+                return std::nullopt;
+            }
+        };
+
+        // Parse the address of each element of `args`, skipping invalid ones.
+        auto collect_addresses = [&parse_address](const auto& args) {
+            std::vector<uint16_t> addresses;
+            for (const auto& a : args) {
+                if (auto addr = parse_address(a.address)) addresses.push_back(*addr);
+            }
+            return addresses;
         };
 
         // Execute a Modbus operation on each element of `args`, converting
@@ -221,23 +604,380 @@ int main(int argc, char *argv[])
             }
         };
 
+        // Relay states read once and tracked across --set-relays patterns.
+        std::optional<waveshare::RelayShadow> relays;
+
+        // Play a relay sequence.  Every step has an absolute deadline
+        // (start + cycle * n + offset), so write latency is not carried
+        // into later steps.  A looping sequence runs until Ctrl-C, which
+        // turns all relays off; the lateness of the steps is reported.
+        auto run_relay_sequence = [&](const waveshare::RelaySequence& sequence) {
+            using Clock = std::chrono::steady_clock;
+            g_interrupted.store(false);
+            auto prev_handler = std::signal(SIGINT, sigint_handler);
+            if (!relays) relays.emplace(conn->get_context());
+
+            waveshare::LatencyHistogram lateness;
+            uint64_t steps = 0, failures = 0;
+            int64_t cycles = 0;
+            auto start = Clock::now();
+            do {
+                auto cycle_start = start + sequence.cycle.value_or(std::chrono::nanoseconds{}) * cycles;
+                for (const auto& step : sequence.steps) {
+                    auto deadline = cycle_start + step.offset;
+                    if (!sleep_until_interruptible(deadline)) break;
+                    auto result = relays->apply(step.mask);
+                    auto late = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - deadline);
+                    double at = std::chrono::duration<double>(deadline - start).count();
+                    ++steps;
+                    if (result == waveshare::RelayShadow::Result::FAILED) {
+                        ++failures;
+                        portable::println("{:>10.3f} s  Relays {} (FAILED): {}", at,
+                                          waveshare::format_relay_mask(step.mask), relays->last_error());
+                        continue;
+                    }
+                    lateness.record(late);
+                    portable::println("{:>10.3f} s  Relays ON: {:<15} late {}", at,
+                                      waveshare::format_relay_mask(step.mask), waveshare::format_duration(late));
+                }
+                ++cycles;
+            } while (sequence.cycle && !g_interrupted.load(std::memory_order_relaxed));
+
+            if (g_interrupted.load(std::memory_order_relaxed)) {
+                // Ensure all relays are off on exit
+                portable::println("\nInterrupted — turning all relays OFF ...");
+                relays->invalidate();
+                if (waveshare::timed(waveshare::StatOp::WRITE_COIL, [&] {
+                        return conn->write_coil(0x00FF, false);
+                    }))
+                    portable::println("All relays OFF (safe shutdown)");
+                else
+                    portable::println("WARNING: failed to turn all relays off: {}", conn->get_last_error());
+            }
+            std::signal(SIGINT, prev_handler);
+
+            portable::println("{} step(s), {} failed write(s)", steps, failures);
+            portable::println("Step lateness: {}", lateness.format_summary());
+            if (lateness.count() > 0)
+                portable::println("{}", lateness.format_buckets());
+        };
+
+        // ── Pipelined Modbus (--pipeline) ──────────────────────────────
+        // Consecutive coil/register/input actions are queued and sent
+        // together; their output is printed in command-line order once
+        // the replies are in.
+        using Reply = waveshare::PipelinedModbusClient::Reply;
+        std::vector<std::function<void()>> pipeline_output;
+
+        auto flush_pipeline = [&]() {
+            if (pipeline_output.empty()) return;
+            WAVESHARE_TRACE_SPAN("pipeline");
+            auto started = std::chrono::steady_clock::now();
+            pipeline->execute();
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - started);
+            if (options.debug)
+                portable::println("{} request(s) pipelined with depth {} in {} ms{}",
+                                  pipeline->size(), pipeline->depth(), elapsed.count(),
+                                  pipeline->fell_back() ? " (device required serial mode)" : "");
+            for (const auto& print : pipeline_output) print();
+            pipeline_output.clear();
+            pipeline->clear();
+        };
+
+        // Queue one read per run of adjacent @p addresses.  Unlike
+        // read_coils_batched(), gaps are not bridged: a failed range could
+        // only be retried address by address after the requests queued
+        // behind it, which may be writes, have run.
+        using QueuedRange = std::pair<waveshare::AddressRange, size_t>;
+        auto queue_ranges = [&](const std::vector<uint16_t>& addresses, int max_count, auto read_range) {
+            std::vector<QueuedRange> queued;
+            for (const auto& range : waveshare::coalesce_addresses(addresses, 0, max_count))
+                queued.emplace_back(range, read_range(range.start, range.count));
+            return queued;
+        };
+
+        // The range in @p queued covering @p addr, or queued.end().
+        auto find_range = [](const std::vector<QueuedRange>& queued, uint16_t addr) {
+            return std::find_if(queued.begin(), queued.end(), [addr](const QueuedRange& q) {
+                return addr >= q.first.start && addr < q.first.start + q.first.count;
+            });
+        };
+
+        // Reply covering @p addr and its offset within it (nullptr if no
+        // request covers it).
+        auto range_reply = [&](const std::vector<QueuedRange>& queued, uint16_t addr)
+            -> std::pair<const Reply*, size_t>
+        {
+            auto it = find_range(queued, addr);
+            if (it == queued.end()) return {nullptr, 0};
+            return {&pipeline->reply(it->second), addr - it->first.start};
+        };
+
+        // Queue @p action on the pipelined transport.
+        // @return false if the action does not go through the pipeline.
+        auto queue_pipelined = [&](waveshare::CommandLineAction action) -> bool
+        {
+            if (!pipeline || !pipelinable(action)) return false;
+            auto& client = *pipeline;
+            auto read_coils = [&client](uint16_t start, uint16_t count) { return client.read_coils(start, count); };
+            auto read_registers = [&client](uint16_t start, uint16_t count) { return client.read_registers(start, count); };
+
+            switch (action)
+            {
+            case waveshare::CommandLineAction::READ_COIL:
+            {
+                auto addresses = collect_addresses(options.read_coil_args);
+                auto queued = queue_ranges(addresses, MODBUS_MAX_READ_BITS, read_coils);
+                pipeline_output.push_back([=, &range_reply] {
+                    portable::println("=== Read Coil ===");
+                    for (auto addr : addresses) {
+                        auto [reply, offset] = range_reply(queued, addr);
+                        if (!reply)
+                            portable::println("Failed to read coil 0x{:04X}: not requested", addr);
+                        else if (reply->ok)
+                            portable::println("Coil 0x{:04X}: {} ({})", addr, reply->bits[offset] ? "ON" : "OFF",
+                                              static_cast<bool>(reply->bits[offset]));
+                        else
+                            portable::println("Failed to read coil 0x{:04X}: {}", addr, reply->error);
+                    }
+                });
+                break;
+            }
+
+            case waveshare::CommandLineAction::READ_COILS:
+                pipeline_output.push_back([] { portable::println("=== Read Coils ==="); });
+                for_each_addr(options.read_coils_args, [&](const auto& args) {
+                    auto addr = std::stoi(args.address, nullptr, 0);
+                    auto count = std::stoi(args.count, nullptr, 0);
+                    auto id = client.read_coils(static_cast<uint16_t>(addr), static_cast<uint16_t>(count));
+                    pipeline_output.push_back([&client, id, addr, count] {
+                        const auto& reply = client.reply(id);
+                        if (reply.ok) {
+                            portable::println("Read {} coils starting at 0x{:04X}:", count, addr);
+                            for (int i = 0; i < count; ++i) {
+                                bool bit = reply.bits[i];
+                                portable::println("  Coil 0x{:04X} ({}): {} ({})", addr + i, addr + i, bit ? "ON" : "OFF", bit);
+                            }
+                        } else {
+                            portable::println("Failed to read coils 0x{:04X}-0x{:04X}: {}", addr, addr + count - 1, reply.error);
+                        }
+                    });
+                });
+                break;
+
+            case waveshare::CommandLineAction::WRITE_COIL:
+                pipeline_output.push_back([] { portable::println("=== Write Coil ==="); });
+                for_each_addr(options.write_coil_args, [&](const auto& args) {
+                    auto addr = std::stoi(args.address, nullptr, 0);
+                    bool state = false;
+                    if (!try_parse_coil_state(args.state, state)) {
+                        pipeline_output.push_back([state_text = args.state] {
+                            portable::println("Invalid coil state '{}'. Use one of: on|off|true|false|1|0", state_text);
+                        });
+                        return;
+                    }
+                    auto id = client.write_coil(static_cast<uint16_t>(addr), state);
+                    pipeline_output.push_back([&client, id, addr, state] {
+                        const auto& reply = client.reply(id);
+                        if (reply.ok)
+                            portable::println("Coil 0x{:04X} = {} (SUCCESS)", addr, state ? "ON" : "OFF");
+                        else
+                            portable::println("Coil 0x{:04X} = {} (FAILED): {}", addr, state ? "ON" : "OFF", reply.error);
+                    });
+                });
+                break;
+
+            case waveshare::CommandLineAction::WRITE_COILS:
+            {
+                // Last write per coil wins; each contiguous run is one FC15
+                // (a lone coil FC05), and the runs are in flight together.
+                std::vector<waveshare::CoilWrite> writes;
+                std::vector<std::string> invalid;
+                for (const auto& args : options.write_coils_args) {
+                    bool state = false;
+                    if (!try_parse_coil_state(args.state, state)) {
+                        invalid.push_back(args.state);
+                        continue;
+                    }
+                    if (auto addr = parse_address(args.address)) writes.push_back({*addr, state});
+                }
+                std::map<uint16_t, bool> final_state;
+                for (const auto& w : writes) final_state[w.address] = w.state;
+                std::vector<uint16_t> addresses;
+                for (const auto& [addr, state] : final_state) addresses.push_back(addr);
+
+                std::vector<QueuedRange> queued;
+                for (const auto& run : waveshare::coalesce_addresses(addresses, 0, MODBUS_MAX_WRITE_BITS)) {
+                    std::vector<bool> states;
+                    for (uint16_t i = 0; i < run.count; ++i)
+                        states.push_back(final_state.at(static_cast<uint16_t>(run.start + i)));
+                    queued.emplace_back(run, run.count == 1 ? client.write_coil(run.start, states[0])
+                                                            : client.write_coils(run.start, states));
+                }
+
+                pipeline_output.push_back([&client, &find_range, writes, invalid, queued] {
+                    portable::println("=== Write Coil Pairs ===");
+                    for (const auto& state_text : invalid)
+                        portable::println("Invalid coil state '{}'. Use one of: on|off|true|false|1|0", state_text);
+                    for (size_t i = 0; i < writes.size(); ++i) {
+                        const auto& w = writes[i];
+                        bool superseded = std::any_of(writes.begin() + static_cast<std::ptrdiff_t>(i) + 1, writes.end(),
+                                                      [&](const auto& later) { return later.address == w.address; });
+                        auto it = find_range(queued, w.address);
+                        if (superseded)
+                            portable::println("Coil 0x{:04X} = {} (SUPERSEDED)", w.address, w.state ? "ON" : "OFF");
+                        else if (it == queued.end())
+                            portable::println("Coil 0x{:04X} = {} (FAILED): not sent", w.address, w.state ? "ON" : "OFF");
+                        else if (const auto& reply = client.reply(it->second); reply.ok)
+                            portable::println("Coil 0x{:04X} = {} (SUCCESS)", w.address, w.state ? "ON" : "OFF");
+                        else
+                            portable::println("Coil 0x{:04X} = {} (FAILED): {}", w.address, w.state ? "ON" : "OFF", reply.error);
+                    }
+                });
+                break;
+            }
+
+            case waveshare::CommandLineAction::READ_REGISTER:
+            {
+                auto addresses = collect_addresses(options.read_register_args);
+                auto queued = queue_ranges(addresses, MODBUS_MAX_READ_REGISTERS, read_registers);
+                pipeline_output.push_back([=, &range_reply] {
+                    portable::println("=== Read Register ===");
+                    for (auto addr : addresses) {
+                        auto [reply, offset] = range_reply(queued, addr);
+                        if (!reply)
+                            portable::println("Failed to read register 0x{:04X}: not requested", addr);
+                        else if (reply->ok)
+                            portable::println("Register 0x{:04X}: {} (0x{:04X})", addr,
+                                              reply->registers[offset], reply->registers[offset]);
+                        else
+                            portable::println("Failed to read register 0x{:04X}: {}", addr, reply->error);
+                    }
+                });
+                break;
+            }
+
+            case waveshare::CommandLineAction::READ_REGISTERS:
+                pipeline_output.push_back([] { portable::println("=== Read Registers ==="); });
+                for_each_addr(options.read_registers_args, [&](const auto& args) {
+                    auto addr = std::stoi(args.address, nullptr, 0);
+                    auto count = std::stoi(args.count, nullptr, 0);
+                    auto id = client.read_registers(static_cast<uint16_t>(addr), static_cast<uint16_t>(count));
+                    pipeline_output.push_back([&client, id, addr, count] {
+                        const auto& reply = client.reply(id);
+                        if (reply.ok) {
+                            portable::println("Read {} registers starting at 0x{:04X}:", count, addr);
+                            for (int i = 0; i < count; ++i)
+                                portable::println("  Register 0x{:04X}: {} (0x{:04X})", addr + i,
+                                                  reply.registers[i], reply.registers[i]);
+                        } else {
+                            portable::println("Failed to read registers 0x{:04X}-0x{:04X}: {}", addr, addr + count - 1, reply.error);
+                        }
+                    });
+                });
+                break;
+
+            case waveshare::CommandLineAction::WRITE_REGISTER:
+                pipeline_output.push_back([] { portable::println("=== Write Register ==="); });
+                for_each_addr(options.write_register_args, [&](const auto& args) {
+                    auto addr  = std::stoi(args.address, nullptr, 0);
+                    auto value = std::stoi(args.value, nullptr, 0);
+                    auto id = client.write_register(static_cast<uint16_t>(addr), static_cast<uint16_t>(value));
+                    pipeline_output.push_back([&client, id, addr, value] {
+                        const auto& reply = client.reply(id);
+                        if (reply.ok)
+                            portable::println("Register 0x{:04X} = {} (0x{:04X}) (SUCCESS)", addr, value, value);
+                        else
+                            portable::println("Register 0x{:04X} = {} (FAILED): {}", addr, value, reply.error);
+                    });
+                });
+                break;
+
+            case waveshare::CommandLineAction::WRITE_REGISTERS:
+                pipeline_output.push_back([] { portable::println("=== Write Registers ==="); });
+                for_each_addr(options.write_registers_args, [&](const auto& args) {
+                    auto addr = std::stoi(args.address, nullptr, 0);
+                    std::vector<uint16_t> values;
+                    for (const auto& v : args.values)
+                        values.push_back(static_cast<uint16_t>(std::stoi(v, nullptr, 0)));
+                    auto id = client.write_registers(static_cast<uint16_t>(addr), values);
+                    pipeline_output.push_back([&client, id, addr, values] {
+                        const auto& reply = client.reply(id);
+                        if (reply.ok) {
+                            portable::println("Successfully wrote {} registers starting at 0x{:04X}:", values.size(), addr);
+                            for (std::size_t i = 0; i < values.size(); ++i)
+                                portable::println("  Register 0x{:04X}: {} (0x{:04X})", addr + i, values[i], values[i]);
+                        } else {
+                            portable::println("Failed to write registers starting at 0x{:04X}: {}", addr, reply.error);
+                        }
+                    });
+                });
+                break;
+
+            case waveshare::CommandLineAction::READ_DIGITAL_INPUTS:
+            {
+                constexpr uint16_t di_count = 8;
+                auto id = client.read_discrete_inputs(0x0000, di_count);
+                pipeline_output.push_back([&client, id] {
+                    portable::println("=== Read Digital Inputs ===");
+                    const auto& reply = client.reply(id);
+                    if (reply.ok) {
+                        std::string header, states;
+                        for (uint16_t i = 0; i < di_count; ++i) {
+                            if (i > 0) { header += '\t'; states += '\t'; }
+                            header += std::format("DI{}", i + 1);
+                            states += (reply.bits[i] ? "ON" : "OFF");
+                        }
+                        portable::println("{}", header);
+                        portable::println("{}", states);
+                    } else {
+                        portable::println("Failed to read digital inputs: {}", reply.error);
+                    }
+                });
+                break;
+            }
+
+            default:
+                return false;
+            }
+            return true;
+        };
+
         // ── Action loop ────────────────────────────────────────────────
 
         for (const auto &action : options.actions)
         {
+            WAVESHARE_TRACE_SPAN("action", waveshare::action_to_string(action));
+            if (auto change = config_change_for(action))
+            {
+                flush_pipeline();
+                pending_config.merge(*change);
+                continue;
+            }
+            if (auto rc = flush_config(); rc != EXIT_SUCCESS) return rc;
+            if (queue_pipelined(action)) continue;
+            flush_pipeline();
+
             switch (action)
             {
             case waveshare::CommandLineAction::READ_COIL:
+            {
                 portable::println("=== Read Coil ===");
-                for_each_addr(options.read_coil_args, [&](const auto& args) {
-                    auto addr = std::stoi(args.address, nullptr, 0);
-                    bool value;
-                    if (conn->read_coil(static_cast<uint16_t>(addr), value))
-                        portable::println("Coil 0x{:04X}: {} ({})", addr, value ? "ON" : "OFF", value);
+                // Nearby addresses are merged into FC01 range reads.
+                int transactions = 0;
+                auto addresses = collect_addresses(options.read_coil_args);
+                for (const auto& r : waveshare::read_coils_batched(conn->get_context(), addresses,
+                                                                   options.coalesce_gap, &transactions)) {
+                    if (r.ok)
+                        portable::println("Coil 0x{:04X}: {} ({})", r.address, r.value ? "ON" : "OFF", r.value);
                     else
-                        portable::println("Failed to read coil 0x{:04X}: {}", addr, conn->get_last_error());
-                });
+                        portable::println("Failed to read coil 0x{:04X}: {}", r.address, r.error);
+                }
+                if (options.debug)
+                    portable::println("{} coil(s) read in {} transaction(s)", addresses.size(), transactions);
                 break;
+            }
 
             case waveshare::CommandLineAction::READ_COILS:
                 portable::println("=== Read Coils ===");
@@ -245,7 +985,9 @@ int main(int argc, char *argv[])
                     auto addr = std::stoi(args.address, nullptr, 0);
                     auto count = std::stoi(args.count, nullptr, 0);
                     std::vector<uint8_t> values(count);
-                    if (conn->read_coils(static_cast<uint16_t>(addr), static_cast<uint16_t>(count), values.data())) {
+                    if (waveshare::timed(waveshare::StatOp::READ_COILS, [&] {
+                            return conn->read_coils(static_cast<uint16_t>(addr), static_cast<uint16_t>(count), values.data());
+                        })) {
                         portable::println("Read {} coils starting at 0x{:04X}:", count, addr);
                         for (int i = 0; i < count; ++i) {
                             bool bit = (values[i / 8] & (1 << (i % 8))) != 0;
@@ -264,22 +1006,50 @@ int main(int argc, char *argv[])
                 break;
 
             case waveshare::CommandLineAction::WRITE_COILS:
+            {
                 portable::println("=== Write Coil Pairs ===");
-                for (const auto &args : options.write_coils_args)
-                    execute_write_coil(*conn, args);
+                // Contiguous coils are written together with FC15.
+                std::vector<waveshare::CoilWrite> writes;
+                for (const auto& args : options.write_coils_args) {
+                    bool state = false;
+                    if (!try_parse_coil_state(args.state, state)) {
+                        portable::println("Invalid coil state '{}'. Use one of: on|off|true|false|1|0", args.state);
+                        continue;
+                    }
+                    if (auto addr = parse_address(args.address)) writes.push_back({*addr, state});
+                }
+
+                int transactions = 0;
+                for (const auto& r : waveshare::write_coils_batched(conn->get_context(), writes, &transactions)) {
+                    if (r.superseded)
+                        portable::println("Coil 0x{:04X} = {} (SUPERSEDED)", r.address, r.state ? "ON" : "OFF");
+                    else if (r.ok)
+                        portable::println("Coil 0x{:04X} = {} (SUCCESS)", r.address, r.state ? "ON" : "OFF");
+                    else
+                        portable::println("Coil 0x{:04X} = {} (FAILED): {}", r.address, r.state ? "ON" : "OFF", r.error);
+                }
+                if (options.debug)
+                    portable::println("{} coil(s) written in {} transaction(s)", writes.size(), transactions);
                 break;
+            }
 
             case waveshare::CommandLineAction::READ_REGISTER:
+            {
                 portable::println("=== Read Register ===");
-                for_each_addr(options.read_register_args, [&](const auto& args) {
-                    auto addr = std::stoi(args.address, nullptr, 0);
-                    uint16_t value;
-                    if (conn->read_register(static_cast<uint16_t>(addr), value))
-                        portable::println("Register 0x{:04X}: {} (0x{:04X})", addr, value, value);
+                // Nearby addresses are merged into FC03 range reads.
+                int transactions = 0;
+                auto addresses = collect_addresses(options.read_register_args);
+                for (const auto& r : waveshare::read_registers_batched(conn->get_context(), addresses,
+                                                                       options.coalesce_gap, &transactions)) {
+                    if (r.ok)
+                        portable::println("Register 0x{:04X}: {} (0x{:04X})", r.address, r.value, r.value);
                     else
-                        portable::println("Failed to read register 0x{:04X}: {}", addr, conn->get_last_error());
-                });
+                        portable::println("Failed to read register 0x{:04X}: {}", r.address, r.error);
+                }
+                if (options.debug)
+                    portable::println("{} register(s) read in {} transaction(s)", addresses.size(), transactions);
                 break;
+            }
 
             case waveshare::CommandLineAction::READ_REGISTERS:
                 portable::println("=== Read Registers ===");
@@ -287,7 +1057,9 @@ int main(int argc, char *argv[])
                     auto addr = std::stoi(args.address, nullptr, 0);
                     auto count = std::stoi(args.count, nullptr, 0);
                     std::vector<uint16_t> values(count);
-                    if (conn->read_registers(static_cast<uint16_t>(addr), static_cast<uint16_t>(count), values.data())) {
+                    if (waveshare::timed(waveshare::StatOp::READ_REGISTERS, [&] {
+                            return conn->read_registers(static_cast<uint16_t>(addr), static_cast<uint16_t>(count), values.data());
+                        })) {
                         portable::println("Read {} registers starting at 0x{:04X}:", count, addr);
                         for (int i = 0; i < count; ++i)
                             portable::println("  Register 0x{:04X}: {} (0x{:04X})", addr + i, values[i], values[i]);
@@ -302,7 +1074,9 @@ int main(int argc, char *argv[])
                 for_each_addr(options.write_register_args, [&](const auto& args) {
                     auto addr  = std::stoi(args.address, nullptr, 0);
                     auto value = std::stoi(args.value, nullptr, 0);
-                    if (conn->write_register(static_cast<uint16_t>(addr), static_cast<uint16_t>(value)))
+                    if (waveshare::timed(waveshare::StatOp::WRITE_REGISTER, [&] {
+                            return conn->write_register(static_cast<uint16_t>(addr), static_cast<uint16_t>(value));
+                        }))
                         portable::println("Register 0x{:04X} = {} (0x{:04X}) (SUCCESS)", addr, value, value);
                     else
                         portable::println("Register 0x{:04X} = {} (FAILED): {}", addr, value, conn->get_last_error());
@@ -317,7 +1091,9 @@ int main(int argc, char *argv[])
                     for (const auto& v : args.values)
                         values.push_back(static_cast<uint16_t>(std::stoi(v, nullptr, 0)));
                     auto count = values.size();
-                    if (conn->write_registers(static_cast<uint16_t>(addr), static_cast<uint16_t>(count), values.data())) {
+                    if (waveshare::timed(waveshare::StatOp::WRITE_REGISTERS, [&] {
+                            return conn->write_registers(static_cast<uint16_t>(addr), static_cast<uint16_t>(count), values.data());
+                        })) {
                         portable::println("Successfully wrote {} registers starting at 0x{:04X}:", count, addr);
                         for (std::size_t i = 0; i < count; ++i)
                             portable::println("  Register 0x{:04X}: {} (0x{:04X})", addr + i, values[i], values[i]);
@@ -332,7 +1108,9 @@ int main(int argc, char *argv[])
                 portable::println("=== Read Digital Inputs ===");
                 constexpr uint16_t di_count = 8;
                 uint8_t values[di_count]{};
-                if (conn->read_discrete_inputs(0x0000, di_count, values)) {
+                if (waveshare::timed(waveshare::StatOp::READ_DISCRETE_INPUTS, [&] {
+                        return conn->read_discrete_inputs(0x0000, di_count, values);
+                    })) {
                     // Header row
                     std::string header, states;
                     for (uint16_t i = 0; i < di_count; ++i) {
@@ -348,82 +1126,250 @@ int main(int argc, char *argv[])
                 break;
             }
 
-            case waveshare::CommandLineAction::ITERATE_RELAY_SWITCHES:
+            case waveshare::CommandLineAction::WATCH_DIGITAL_INPUTS:
             {
-                portable::println("=== Iterate Relay Switches (Ctrl-C to stop) ===");
+                std::chrono::nanoseconds period{};
+                std::string error;
+                if (!waveshare::parse_rate(options.watch_rate, period, error)) {
+                    portable::println(stderr, "Error: {}", error);
+                    return EXIT_FAILURE;
+                }
+                constexpr uint16_t di_count = 8;
+                portable::println("=== Watch Digital Inputs at {:.4g} Hz (Ctrl-C to stop) ===", 1e9 / period.count());
 
-                // Install SIGINT handler
                 g_interrupted.store(false);
                 auto prev_handler = std::signal(SIGINT, sigint_handler);
 
-                // Turn all relays off first (address 0x00FF = all relays)
-                if (!conn->write_coil(0x00FF, false))
+                waveshare::InputPoller poller(conn->get_context(), period, di_count);
+                auto seconds_since_start = [&poller]() {
+                    return std::chrono::duration<double>(poller.sampled_at() - poller.started()).count();
+                };
+
+                std::optional<uint32_t> previous;
+                uint64_t edges = 0;
+                bool failing = false;
+                while (!g_interrupted.load(std::memory_order_relaxed))
                 {
-                    portable::println("FAILED to turn all relays off: {}", conn->get_last_error());
-                    break;
+                    uint32_t inputs = 0;
+                    if (!poller.poll(inputs)) {
+                        // Report a run of failures once, not at the poll rate.
+                        if (!failing)
+                            portable::println(stderr, "Failed to read digital inputs: {}", poller.last_error());
+                        failing = true;
+                        continue;
+                    }
+                    if (failing) {
+                        portable::println(stderr, "Reading digital inputs again");
+                        failing = false;
+                    }
+
+                    if (!previous) {
+                        std::string states;
+                        for (uint16_t i = 0; i < di_count; ++i)
+                            states += std::format("  DI{} {}", i + 1, (inputs >> i) & 1 ? "ON" : "OFF");
+                        portable::println("{:>12.6f} s {}", seconds_since_start(), states);
+                    } else if (uint32_t changed = inputs ^ *previous) {
+                        for (uint16_t i = 0; i < di_count; ++i) {
+                            if (!((changed >> i) & 1)) continue;
+                            ++edges;
+                            portable::println("{:>12.6f} s   DI{} {} -> {}", seconds_since_start(), i + 1,
+                                              (inputs >> i) & 1 ? "OFF" : "ON", (inputs >> i) & 1 ? "ON" : "OFF");
+                        }
+                    } else {
+                        continue;
+                    }
+                    std::fflush(stdout);    // edges are read live through pipes, too
+                    previous = inputs;
                 }
-                portable::println("All relays OFF");
+                std::signal(SIGINT, prev_handler);
 
-                constexpr int NUM_COILS = 8;
-                constexpr auto ON_DURATION = std::chrono::seconds(1);
-                constexpr auto PAUSE_BETWEEN_CYCLES = std::chrono::seconds(3);
+                auto watched = std::chrono::duration<double>(waveshare::InputPoller::Clock::now() - poller.started());
+                portable::println("\nWatched {:.3f} s: {} poll(s), {} edge(s), {} missed deadline(s), {} failed read(s)",
+                                  watched.count(), poller.polls(), edges, poller.missed(), poller.failures());
+                portable::println("Poll latency: {}", poller.latency().format_summary());
+                if (poller.latency().count() > 0)
+                    portable::println("{}", poller.latency().format_buckets());
+                break;
+            }
 
+            case waveshare::CommandLineAction::INTERLOCK:
+            {
+                std::vector<waveshare::InterlockRule> rules;
+                std::chrono::nanoseconds period{};
+                std::string error;
+                if (!waveshare::parse_interlock_rules(options.interlock_args, rules, error) ||
+                    !waveshare::parse_rate(options.watch_rate, period, error)) {
+                    portable::println(stderr, "Error: {}", error);
+                    return EXIT_FAILURE;
+                }
+                portable::println("=== Interlock at {:.4g} Hz (Ctrl-C to stop) ===", 1e9 / period.count());
+                for (const auto& rule : rules)
+                    portable::println("  {}", rule.text);
+
+                if (!relays) relays.emplace(conn->get_context());
+                if (!relays->refresh()) {
+                    portable::println("Failed to read relays: {}", relays->last_error());
+                    return EXIT_FAILURE;
+                }
+                portable::println("Relays ON: {}", waveshare::format_relay_mask(*relays->state()));
+
+                g_interrupted.store(false);
+                auto prev_handler = std::signal(SIGINT, sigint_handler);
+
+                waveshare::InputPoller poller(conn->get_context(), period, waveshare::INPUT_COUNT);
+                waveshare::LatencyHistogram reaction;
+                std::optional<uint32_t> previous;
+                std::vector<size_t> fired;
+                uint64_t firings = 0, writes = 0, failed_writes = 0;
+                bool read_failing = false, write_failing = false;
                 while (!g_interrupted.load(std::memory_order_relaxed))
                 {
-                    for (int i = 0; i < NUM_COILS && !g_interrupted.load(std::memory_order_relaxed); ++i)
-                    {
-                        uint16_t addr = static_cast<uint16_t>(i);
+                    uint32_t inputs = 0;
+                    if (!poller.poll(inputs)) {
+                        if (!read_failing)
+                            portable::println(stderr, "Failed to read digital inputs: {}", poller.last_error());
+                        read_failing = true;
+                        continue;
+                    }
+                    read_failing = false;
 
-                        // Turn coil on
-                        if (!conn->write_coil(addr, true))
-                        {
-                            portable::println("FAILED to turn coil {} ON: {}", i + 1, conn->get_last_error());
-                            continue;
-                        }
-                        portable::println("Coil {} ON", i + 1);
+                    // After a failed write the relay state is unknown; read it
+                    // before applying rules to it.
+                    if (!relays->state() && !relays->refresh()) {
+                        if (!write_failing)
+                            portable::println(stderr, "Failed to read relays: {}", relays->last_error());
+                        write_failing = true;
+                        continue;
+                    }
 
-                        // Wait 1 second (check for interrupt every 100ms)
-                        for (int t = 0; t < 10 && !g_interrupted.load(std::memory_order_relaxed); ++t)
-                        {
-                            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                        }
+                    uint8_t target = waveshare::apply_interlock_rules(rules, previous, inputs, *relays->state(), fired);
+                    if (fired.empty()) {
+                        previous = inputs;
+                        continue;
+                    }
 
-                        // Turn coil off
-                        if (!conn->write_coil(addr, false))
-                        {
-                            portable::println("FAILED to turn coil {} OFF: {}", i + 1, conn->get_last_error());
-                        }
-                        else
-                        {
-                            portable::println("Coil {} OFF", i + 1);
-                        }
+                    // Write only the relays the fired rules switch, so relays
+                    // other clients changed since the shadow copy was read
+                    // stay as they are.  Write first, report afterwards:
+                    // printing is not on the reaction path.
+                    auto change = waveshare::interlock_change(rules, fired);
+                    auto result = relays->apply_change(change.on, change.off);
+                    auto acknowledged = waveshare::InputPoller::Clock::now();
+                    if (result == waveshare::RelayShadow::Result::FAILED) {
+                        // previous stays as it is, so the rules fire again on
+                        // the next poll and the write is retried.
+                        ++failed_writes;
+                        if (!write_failing)
+                            portable::println(stderr, "Failed to write relays: {}", relays->last_error());
+                        write_failing = true;
+                        continue;
                     }
+                    write_failing = false;
 
-                    if (g_interrupted.load(std::memory_order_relaxed))
-                        break;
+                    auto reaction_time = acknowledged - poller.sampled_at();
+                    bool written = result == waveshare::RelayShadow::Result::WRITTEN;
+                    if (written) {
+                        ++writes;
+                        reaction.record(reaction_time);
+                    }
+                    firings += fired.size();
 
-                    portable::println("--- Cycle complete, waiting 3 seconds ---");
+                    double t = std::chrono::duration<double>(poller.sampled_at() - poller.started()).count();
+                    for (auto i : fired)
+                        portable::println("{:>12.6f} s   {}", t, rules[i].text);
+                    if (written)
+                        portable::println("{:>12.6f} s   Relays ON: {} (reaction {})", t,
+                                          waveshare::format_relay_mask(target),
+                                          waveshare::format_duration(
+                                              std::chrono::duration_cast<std::chrono::microseconds>(reaction_time)));
+                    else
+                        portable::println("{:>12.6f} s   Relays ON: {} (unchanged)", t,
+                                          waveshare::format_relay_mask(target));
+                    std::fflush(stdout);
+                    previous = inputs;
+                }
+                std::signal(SIGINT, prev_handler);
 
-                    // Wait 3 seconds between cycles (check for interrupt every 100ms)
-                    for (int t = 0; t < 30 && !g_interrupted.load(std::memory_order_relaxed); ++t)
-                    {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                auto ran = std::chrono::duration<double>(waveshare::InputPoller::Clock::now() - poller.started());
+                portable::println("\nInterlock ran {:.3f} s: {} poll(s), {} rule firing(s), {} relay write(s), "
+                                  "{} failed write(s), {} missed deadline(s), {} failed read(s)",
+                                  ran.count(), poller.polls(), firings, writes, failed_writes,
+                                  poller.missed(), poller.failures());
+                portable::println("Reaction (edge seen -> relays acknowledged): {}", reaction.format_summary());
+                if (reaction.count() > 0)
+                    portable::println("{}", reaction.format_buckets());
+                portable::println("Poll latency: {}", poller.latency().format_summary());
+                break;
+            }
+
+            case waveshare::CommandLineAction::SET_RELAYS:
+            {
+                portable::println("=== Set Relays ===");
+                if (!relays) relays.emplace(conn->get_context());
+                for (const auto& pattern : options.set_relays_args) {
+                    uint8_t mask = 0;
+                    std::string error;
+                    if (!waveshare::parse_relay_mask(pattern, mask, error)) {
+                        portable::println(stderr, "Error: {}", error);
+                        return EXIT_FAILURE;
+                    }
+                    auto result = relays->apply(mask);
+                    if (result == waveshare::RelayShadow::Result::FAILED) {
+                        portable::println("Relays {} (FAILED): {}",
+                                          waveshare::format_relay_mask(mask), relays->last_error());
+                        return EXIT_FAILURE;
                     }
+                    portable::println("Relays ON: {} (0b{:08b}) ({})",
+                                      waveshare::format_relay_mask(mask), mask,
+                                      result == waveshare::RelayShadow::Result::WRITTEN ? "SUCCESS" : "UNCHANGED");
                 }
+                if (options.debug)
+                    portable::println("{} pattern(s) applied in {} transaction(s)",
+                                      options.set_relays_args.size(), relays->transactions());
+                break;
+            }
 
-                // Ensure all relays are off on exit
-                portable::println("\nInterrupted — turning all relays OFF ...");
-                if (conn->write_coil(0x00FF, false))
-                {
-                    portable::println("All relays OFF (safe shutdown)");
-                }
-                else
+            case waveshare::CommandLineAction::ITERATE_RELAY_SWITCHES:
+            {
+                portable::println("=== Iterate Relay Switches (Ctrl-C to stop) ===");
+
+                // Turn all relays off first (address 0x00FF = all relays)
+                if (!waveshare::timed(waveshare::StatOp::WRITE_COIL, [&] {
+                        return conn->write_coil(0x00FF, false);
+                    }))
                 {
-                    portable::println("WARNING: failed to turn all relays off: {}", conn->get_last_error());
+                    portable::println("FAILED to turn all relays off: {}", conn->get_last_error());
+                    break;
                 }
+                portable::println("All relays OFF");
+                if (relays) relays->invalidate();
 
-                // Restore previous signal handler
-                std::signal(SIGINT, prev_handler);
+                // Each relay on for 1 s in turn, then 3 s with all off.
+                constexpr auto ON_DURATION = std::chrono::seconds(1);
+                constexpr auto PAUSE_BETWEEN_CYCLES = std::chrono::seconds(3);
+                waveshare::RelaySequence sequence;
+                for (int i = 0; i < waveshare::RELAY_COUNT; ++i)
+                    sequence.steps.push_back({ON_DURATION * i, static_cast<uint8_t>(1u << i), 0});
+                sequence.steps.push_back({ON_DURATION * waveshare::RELAY_COUNT, 0, 0});
+                sequence.cycle = ON_DURATION * waveshare::RELAY_COUNT + PAUSE_BETWEEN_CYCLES;
+                run_relay_sequence(sequence);
+                break;
+            }
+
+            case waveshare::CommandLineAction::SEQUENCE:
+            {
+                waveshare::RelaySequence sequence;
+                std::string error;
+                if (!waveshare::load_relay_sequence(options.sequence_file, sequence, error)) {
+                    portable::println(stderr, "Error: {}", error);
+                    return EXIT_FAILURE;
+                }
+                portable::println("=== Relay Sequence: {} step(s){} (Ctrl-C to stop) ===", sequence.steps.size(),
+                                  sequence.cycle ? std::format(", repeating every {}",
+                                                               waveshare::format_duration(std::chrono::duration_cast<
+                                                                   std::chrono::microseconds>(*sequence.cycle)))
+                                                 : std::string{});
+                run_relay_sequence(sequence);
                 break;
             }
 
@@ -441,106 +1387,113 @@ int main(int argc, char *argv[])
                 if (options.ip_explicitly_set) {
                     target = options.ip_address;
                 }
-                auto devices = waveshare::scan_network(options.scan_timeout_ms,
-                                                       options.debug,
-                                                       target,
-                                                       options.extra_subnets);
+                auto devices = scan_and_remember(scan_options(target, {}));
                 portable::println("{}", waveshare::format_device_table(devices));
                 break;
             }
 
             case waveshare::CommandLineAction::SET_STATIC_IP:
-            {
-                portable::println("=== Set Static IP ===");
-                auto rc = resolve_configure_wait([&](const waveshare::DiscoveredDevice& dev) {
-                    portable::println("Target: {} ({}, {})",
-                                      dev.device_name, dev.mac_address, dev.ip_address);
-                    if (!waveshare::set_device_ip(dev, options.set_ip_address,
-                                                  options.set_subnet_mask, options.set_gateway,
-                                                  options.set_dns, options.debug))
-                        return false;
-                    portable::println("Static IP configuration sent to device {}.", dev.mac_address);
-                    portable::println("New IP: {}, Mask: {}, Gateway: {}, DNS: {}",
-                                      options.set_ip_address, options.set_subnet_mask,
-                                      options.set_gateway, options.set_dns);
-                    return true;
-                });
-                if (rc != EXIT_SUCCESS) return rc;
+            case waveshare::CommandLineAction::SET_DHCP:
+            case waveshare::CommandLineAction::SET_MODBUS_TCP:
+            case waveshare::CommandLineAction::SET_MODBUS_TCP_PORT:
+            case waveshare::CommandLineAction::SET_NAME:
+                // Merged by config_change_for() / flush_config().
                 break;
-            }
 
-            case waveshare::CommandLineAction::SET_DHCP:
+            case waveshare::CommandLineAction::PROVISION:
             {
-                portable::println("=== Set DHCP Mode ===");
+                portable::println("=== Provision Devices ===");
 
-                std::vector<waveshare::DiscoveredDevice> devices;
-                const auto* target_dev = resolve_device(devices);
-                if (!target_dev) return EXIT_FAILURE;
+                std::vector<waveshare::ProvisionEntry> entries;
+                std::string error;
+                if (!waveshare::load_provision_manifest(options.provision_manifest, entries, error)) {
+                    portable::println(stderr, "{}", error);
+                    return EXIT_FAILURE;
+                }
 
-                portable::println("Switching device {} ({}) to DHCP mode ...",
-                                  target_dev->mac_address, target_dev->ip_address);
+                // One shared scan, ending as soon as every listed device answered.
+                std::set<std::string> missing;
+                for (const auto& e : entries) missing.insert(e.mac_address);
+                auto devices = scan_and_remember(scan_options(
+                    options.ip_explicitly_set ? options.ip_address : "",
+                    [&missing](const waveshare::DiscoveredDevice& d) {
+                        missing.erase(d.mac_address);
+                        return missing.empty();
+                    }));
 
-                auto result = waveshare::set_device_dhcp(*target_dev,
-                                                         options.wait_timeout_ms,
-                                                         options.debug);
-                if (!result.empty()) {
-                    portable::println("Device is now at {} (DHCP)", result[0].ip_address);
-                    portable::println("{}", waveshare::format_device_table(result));
-                }
-                break;
-            }
+                // Plan: skip devices that are absent or already configured.
+                std::vector<waveshare::ProvisionOutcome> report(entries.size());
+                std::vector<waveshare::ProvisionTarget> targets;
+                std::vector<size_t> target_entry;
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    auto& outcome = report[i];
+                    outcome.mac_address = entries[i].mac_address;
+                    auto dev = std::find_if(devices.begin(), devices.end(),
+                                            [&](const auto& d) { return d.mac_address == outcome.mac_address; });
+                    if (dev == devices.end()) {
+                        outcome.status = waveshare::ProvisionStatus::NOT_FOUND;
+                        continue;
+                    }
+                    outcome.device = *dev;
 
-            case waveshare::CommandLineAction::SET_MODBUS_TCP:
-            {
-                portable::println("=== Set Modbus TCP Protocol ===");
-                auto rc = resolve_configure_wait([&](const waveshare::DiscoveredDevice& dev) {
-                    if (!waveshare::set_device_modbus_tcp(
-                            dev, static_cast<uint16_t>(options.modbus_tcp_port), options.debug))
-                        return false;
-                    portable::println("Modbus TCP configuration sent to device {}.", dev.mac_address);
-                    portable::println("Protocol: Modbus TCP, Work Mode: TCP Server, Port: {}",
-                                      options.modbus_tcp_port);
-                    return true;
-                });
-                if (rc != EXIT_SUCCESS) return rc;
-                break;
-            }
+                    // An address without mask/gateway/DNS keeps the device's current ones.
+                    auto change = entries[i].change;
+                    if (change.ip) {
+                        if (!change.mask)    change.mask    = dev->subnet_mask;
+                        if (!change.gateway) change.gateway = dev->gateway;
+                        if (!change.dns)     change.dns     = dev->dns_server;
+                    }
 
-            case waveshare::CommandLineAction::SET_MODBUS_TCP_PORT:
-            {
-                portable::println("=== Set Modbus TCP Port ===");
-                auto rc = resolve_configure_wait([&](const waveshare::DiscoveredDevice& dev) {
-                    if (!waveshare::set_device_port(
-                            dev, static_cast<uint16_t>(options.set_port_value), options.debug))
-                        return false;
-                    portable::println("Port changed to {} on device {}.",
-                                      options.set_port_value, dev.mac_address);
-                    return true;
-                });
-                if (rc != EXIT_SUCCESS) return rc;
-                break;
-            }
+                    std::array<uint8_t, waveshare::VIRCOM_PACKET_SIZE> packet{};
+                    if (!waveshare::build_config_packet(*dev, change, packet)) {
+                        outcome.status = waveshare::ProvisionStatus::INVALID;
+                        continue;
+                    }
+                    auto diff = waveshare::diff_config_packet(*dev, packet);
+                    if (diff.empty()) {
+                        outcome.status = waveshare::ProvisionStatus::ALREADY_CONFIGURED;
+                        continue;
+                    }
+                    if (options.dry_run) {
+                        portable::println("Dry run: {} byte(s) would change on device {}:",
+                                          diff.size(), dev->mac_address);
+                        portable::println("{}", waveshare::format_config_diff(diff));
+                        continue;
+                    }
+                    targets.push_back({*dev, std::move(change)});
+                    target_entry.push_back(i);
+                }
+                if (options.dry_run) break;
 
-            case waveshare::CommandLineAction::SET_NAME:
-            {
-                if (options.set_name.size() > 9) {
-                    portable::println(stderr, "Error: Device name '{}' is too long (max 9 characters, got {}).",
-                                      options.set_name, options.set_name.size());
-                    return EXIT_FAILURE;
+                if (!targets.empty()) {
+                    portable::println("Configuring {} device(s) ...", targets.size());
+                    waveshare::ConfigDeliveryOptions delivery_options;
+                    delivery_options.debug = options.debug;
+                    auto outcomes = waveshare::provision_devices(targets, delivery_options,
+                                                                 options.wait_timeout_ms);
+                    std::vector<waveshare::DiscoveredDevice> back;
+                    for (size_t t = 0; t < outcomes.size(); ++t) {
+                        if (outcomes[t].status == waveshare::ProvisionStatus::CONFIGURED)
+                            back.push_back(outcomes[t].device);
+                        report[target_entry[t]] = std::move(outcomes[t]);
+                    }
+                    remember(back);
                 }
-                auto rc = resolve_configure_wait([&](const waveshare::DiscoveredDevice& dev) {
-                    if (!waveshare::set_device_name(dev, options.set_name, options.debug))
-                        return false;
-                    portable::println("Device name set to '{}' on device {}.",
-                                      options.set_name, dev.mac_address);
-                    return true;
+
+                portable::println("{}", waveshare::format_provision_table(report));
+                bool all_ok = std::all_of(report.begin(), report.end(), [](const auto& o) {
+                    return o.status == waveshare::ProvisionStatus::CONFIGURED ||
+                           o.status == waveshare::ProvisionStatus::ALREADY_CONFIGURED;
                 });
-                if (rc != EXIT_SUCCESS) return rc;
+                if (!all_ok) return EXIT_FAILURE;
                 break;
             }
             }
         }
 
+        flush_pipeline();
+        if (auto rc = flush_config(); rc != EXIT_SUCCESS) return rc;
+
         return EXIT_SUCCESS;
     }
     catch (const std::exception &e)
@@ -549,3 +1502,57 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 }
+
+// Execute one command line.  @p served is true when a --daemon runs it
+// on behalf of a --via-daemon client.
+int run_commander(int argc, char *argv[], bool served)
+{
+    try
+    {
+        auto options = waveshare::parse_command_line(argc, argv);
+
+        if (!served && (options.daemon || options.via_daemon))
+        {
+            auto socket_path = options.daemon_socket.empty() ? waveshare::default_daemon_socket_path()
+                                                             : options.daemon_socket;
+            if (options.daemon)
+                return waveshare::run_daemon(socket_path,
+                                             [](int c, char *v[]) { return run_commander(c, v, true); },
+                                             options.debug);
+            return waveshare::run_via_daemon(socket_path, argc, argv);
+        }
+
+        bool stats = options.stats;
+        if (stats)
+            waveshare::enable_operation_stats();
+        if (!options.trace_file.empty())
+        {
+            std::string error;
+            if (!waveshare::start_trace(options.trace_file, error))
+            {
+                portable::println(stderr, "Error: {}", error);
+                return EXIT_FAILURE;
+            }
+        }
+        int rc = EXIT_FAILURE;
+        {
+            WAVESHARE_TRACE_SPAN("command");
+            rc = run_actions(std::move(options));
+        }
+        waveshare::flush_trace();
+        if (stats)
+            portable::println("\n{}", waveshare::format_operation_stats());
+        return rc;
+    }
+    catch (const std::exception &e)
+    {
+        waveshare::flush_trace();
+        portable::println(stderr, "Error: {}", e.what());
+        return EXIT_FAILURE;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    return run_commander(argc, argv, false);
+}
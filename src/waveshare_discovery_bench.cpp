@@ -0,0 +1,253 @@
+// Discovery-at-scale benchmark: scan_network() against a simulated fleet
+// of hundreds to thousands of VirCom devices on loopback addresses, plus
+// resolve_target_device() and format_device_table() on the result.
+
+#include "waveshare_modbus_commander/latency_histogram.hpp"
+#include "waveshare_modbus_commander/network_scanner.hpp"
+#include "waveshare_modbus_commander/portable_print.hpp"
+#include "waveshare_modbus_commander/relay_simulator.hpp"
+#include "CLI/CLI.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <format>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <time.h>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    /// CPU time consumed by the calling thread so far.
+    std::chrono::nanoseconds thread_cpu_time()
+    {
+        timespec ts{};
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+    }
+
+    /// Mean wall time of one call of @p fn over enough calls to measure.
+    template <typename Fn>
+    std::chrono::nanoseconds time_per_call(Fn&& fn)
+    {
+        constexpr auto MIN_TIME = std::chrono::milliseconds(20);
+        size_t calls = 0;
+        auto start = Clock::now();
+        auto elapsed = Clock::duration::zero();
+        do {
+            fn();
+            ++calls;
+            elapsed = Clock::now() - start;
+        } while (elapsed < MIN_TIME);
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed) / calls;
+    }
+
+    /// Outcome of one scan of the fleet.
+    struct ScanRun {
+        size_t found = 0;
+        uint64_t unanswered = 0;            ///< Searches that never reached a device
+        uint64_t dropped = 0;               ///< Dropped by the simulated devices
+        uint64_t undelivered = 0;           ///< Sent by a device, not seen by the scanner
+        std::chrono::nanoseconds last_found{};  ///< Until the last new device answered
+        std::chrono::nanoseconds wall{};    ///< The whole scan_network() call
+        std::chrono::nanoseconds cpu{};     ///< CPU time of the scanning thread
+        std::vector<waveshare::DiscoveredDevice> devices;
+    };
+
+    ScanRun scan_fleet(const waveshare::VirComFleet& fleet, waveshare::ScanOptions scan, bool stop_when_complete)
+    {
+        ScanRun run;
+        auto before = fleet.counters();
+        auto start = Clock::now();
+
+        // Called for every new device: note when the last one came in,
+        // and end the scan once the whole fleet has answered.
+        size_t seen = 0;
+        scan.stop_when = [&](const waveshare::DiscoveredDevice&) {
+            run.last_found = Clock::now() - start;
+            return ++seen == fleet.size() && stop_when_complete;
+        };
+
+        auto cpu_before = thread_cpu_time();
+        run.devices = waveshare::scan_network(scan);
+        run.cpu = thread_cpu_time() - cpu_before;
+        run.wall = Clock::now() - start;
+
+        // Replies still in flight when the scan ended would be counted as
+        // undelivered; the fleet has nothing left to send by now unless
+        // its delays outlast the scan.
+        auto after = fleet.counters();
+        uint64_t searches = after.searches - before.searches;
+        run.found = run.devices.size();
+        run.unanswered = fleet.size() > searches ? fleet.size() - searches : 0;
+        run.dropped = after.dropped - before.dropped;
+        uint64_t replies = after.replies - before.replies;
+        run.undelivered = replies > run.found ? replies - run.found : 0;
+        return run;
+    }
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    std::vector<uint32_t> sizes = {500, 1000, 2000, 5000};
+    std::string first_ip, latency, delay_spread;
+    double loss = 0, loss_spread = 0;
+    int runs = 0, timeout = 0, probe_rate = 0;
+    uint32_t seed = 0;
+    bool adaptive = false, debug = false;
+
+    CLI::App app{"Benchmark VirCom discovery against a simulated fleet of devices on loopback"};
+    app.set_help_flag("-h,--help", "Show all available options");
+    app.set_version_flag("-V,--version", PROJECT_VERSION, "Show program version");
+
+    app.add_option("--devices", sizes, "Fleet sizes to benchmark")
+        ->default_str("500 1000 2000 5000")
+        ->check(CLI::Range(1u, waveshare::VirComFleet::MAX_DEVICES));
+    app.add_option("-n,--runs", runs, "Scans per fleet size")
+        ->default_val(5)
+        ->check(CLI::PositiveNumber);
+    app.add_option("--first-ip", first_ip, "Address of the first device (must be local)")
+        ->default_val("127.1.0.1");
+    app.add_option("-t,--timeout", timeout, "Scan timeout in milliseconds")
+        ->default_val(3000)
+        ->check(CLI::PositiveNumber);
+    app.add_option("--probe-rate", probe_rate, "Sweep probes per second (0 = unpaced)")
+        ->default_val(0)
+        ->check(CLI::NonNegativeNumber);
+    app.add_flag("--adaptive", adaptive,
+                 "End each scan with the adaptive cut-off instead of as soon as every device has answered");
+    app.add_option("--latency", latency, "Response delay of every device (e.g. 2ms)")
+        ->default_val("0");
+    app.add_option("--delay-spread", delay_spread, "Each device adds its own fixed delay of up to this much")
+        ->default_val("0");
+    app.add_option("--loss", loss, "Probability that a device ignores a search (0-1)")
+        ->default_val(0.0)
+        ->check(CLI::Range(0.0, 1.0));
+    app.add_option("--loss-spread", loss_spread, "Each device adds its own fixed loss of up to this much")
+        ->default_val(0.0)
+        ->check(CLI::Range(0.0, 1.0));
+    app.add_option("--seed", seed, "Seed for the per-device delays and loss (0 = random)")
+        ->default_val(0);
+    app.add_flag("-d,--debug", debug, "Show the scanner's diagnostics");
+
+    try
+    {
+        app.parse(argc, argv);
+    }
+    catch (const CLI::ParseError &e)
+    {
+        return app.exit(e);
+    }
+
+    waveshare::FleetOptions fleet_options;
+    fleet_options.first_ip = first_ip;
+    fleet_options.loss = loss;
+    fleet_options.loss_spread = loss_spread;
+    fleet_options.seed = seed;
+    auto parse_option = [](const char* name, const std::string& text, auto& out) {
+        std::chrono::nanoseconds d{};
+        if (!waveshare::parse_duration(text, d)) {
+            portable::println(stderr, "Error: invalid {} '{}' (e.g. 1.5s, 20ms or 500us)", name, text);
+            return false;
+        }
+        out = std::chrono::duration_cast<std::remove_reference_t<decltype(out)>>(d);
+        return true;
+    };
+    if (!parse_option("--latency", latency, fleet_options.latency) ||
+        !parse_option("--delay-spread", delay_spread, fleet_options.delay_spread))
+        return EXIT_FAILURE;
+
+    portable::println("Discovery of a simulated fleet from {} (latency {}, delay spread {}, loss {:.1f} % + {:.1f} %), "
+                      "{} scan(s) per size, {}\n",
+                      first_ip, latency, delay_spread, loss * 100, loss_spread * 100, runs,
+                      adaptive ? "adaptive cut-off" : "stopping when all have answered");
+    portable::println("{:>7}  {:>14}  {:>6}  {:>16}  {:>9}  {:>9}  {:>9}  {:>9}  {:>9}  {:>9}  {:>9}",
+                      "Devices", "Range", "Found", "Lost (-/drop/rx)", "All p50", "All max",
+                      "Scan p50", "CPU p50", "CPU/dev", "Resolve", "Table");
+    portable::println("{:->7}  {:->14}  {:->6}  {:->16}  {:->9}  {:->9}  {:->9}  {:->9}  {:->9}  {:->9}  {:->9}",
+                      "", "", "", "", "", "", "", "", "", "", "");
+
+    bool all_found = true;
+    for (auto size : sizes) {
+        fleet_options.count = size;
+        try {
+            waveshare::VirComFleet fleet(fleet_options);
+            std::string error;
+            if (!fleet.start(error)) {
+                portable::println(stderr, "Error: {}", error);
+                return EXIT_FAILURE;
+            }
+            std::atomic<bool> stop{false};
+            std::thread server([&] { fleet.run(stop); });
+
+            waveshare::ScanOptions scan;
+            scan.timeout_ms = timeout;
+            scan.debug = debug;
+            scan.unicast_only = true;
+            scan.adaptive = adaptive;
+            scan.probe_rate = probe_rate;
+            scan.extra_subnets = {fleet.subnet()};
+
+            waveshare::LatencyHistogram to_all, wall, cpu;
+            size_t min_found = size;
+            uint64_t unanswered = 0, dropped = 0, undelivered = 0;
+            std::vector<waveshare::DiscoveredDevice> devices;
+            for (int i = 0; i < runs; ++i) {
+                auto run = scan_fleet(fleet, scan, !adaptive);
+                if (run.found == size) to_all.record(run.last_found);
+                wall.record(run.wall);
+                cpu.record(run.cpu);
+                min_found = std::min(min_found, run.found);
+                unanswered += run.unanswered;
+                dropped += run.dropped;
+                undelivered += run.undelivered;
+                if (run.devices.size() >= devices.size()) devices = std::move(run.devices);
+            }
+            stop = true;
+            server.join();
+            all_found = all_found && min_found == size;
+
+            // Look up the device the scan found last, the worst case of a
+            // linear search, by each kind of identifier.
+            std::string resolve = "-", table = "-";
+            if (!devices.empty()) {
+                const auto& last = devices.back();
+                std::string error;
+                auto per_call = time_per_call([&] {
+                    waveshare::resolve_target_device(devices, last.mac_address, "", "", error);
+                    waveshare::resolve_target_device(devices, "", last.device_name, "", error);
+                    waveshare::resolve_target_device(devices, "", "", last.ip_address, error);
+                }) / 3;
+                resolve = waveshare::format_duration(std::chrono::duration_cast<std::chrono::microseconds>(per_call));
+                if (per_call < std::chrono::microseconds(1)) resolve = std::format("{} ns", per_call.count());
+                auto format = time_per_call([&] { (void)waveshare::format_device_table(devices); });
+                table = waveshare::format_duration(std::chrono::duration_cast<std::chrono::microseconds>(format));
+            }
+
+            auto per_device = std::chrono::nanoseconds(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(cpu.percentile(50)) / size);
+            auto lost = unanswered + dropped + undelivered;
+            portable::println("{:>7}  {:>14}  {:>6}  {:>16}  {:>9}  {:>9}  {:>9}  {:>9}  {:>9}  {:>9}  {:>9}",
+                              size, fleet.subnet(), min_found,
+                              std::format("{} ({}/{}/{})", lost, unanswered, dropped, undelivered),
+                              to_all.count() ? waveshare::format_duration(to_all.percentile(50)) : "-",
+                              to_all.count() ? waveshare::format_duration(to_all.max()) : "-",
+                              waveshare::format_duration(wall.percentile(50)),
+                              waveshare::format_duration(cpu.percentile(50)),
+                              std::format("{:.2f} us", per_device.count() / 1000.0),
+                              resolve, table);
+            std::fflush(stdout);
+        } catch (const std::exception& e) {
+            portable::println(stderr, "Error: {}", e.what());
+            return EXIT_FAILURE;
+        }
+    }
+    return all_found ? EXIT_SUCCESS : EXIT_FAILURE;
+}
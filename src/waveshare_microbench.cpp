@@ -0,0 +1,339 @@
+// Microbenchmarks of the VirCom packet codec and the device table paths:
+// response parsing, duplicate detection, target resolution and table
+// formatting, on synthetic and captured 170-byte responses.  No network
+// access; results can be saved and compared against a baseline.
+
+#include "waveshare_modbus_commander/latency_histogram.hpp"
+#include "waveshare_modbus_commander/network_scanner.hpp"
+#include "waveshare_modbus_commander/portable_print.hpp"
+#include "CLI/CLI.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+    using Packet = std::array<uint8_t, waveshare::VIRCOM_PACKET_SIZE>;
+
+    constexpr const char* RESULTS_HEADER = "# waveshare-microbench v1";
+
+    /// Results feed into this, so the measured calls cannot be optimised away.
+    volatile size_t g_sink = 0;
+
+    /// Search response of synthetic device @p index, laid out like the
+    /// response of a real module: 10.0.0.0/16 addresses, a locally
+    /// administered MAC and a "dsp=" parameter string.
+    Packet synthetic_response(uint32_t index)
+    {
+        Packet p{};
+        p[0] = 0x5A;
+        p[1] = 0x4C;
+        p[2] = 0x01;                                    // search response
+        uint32_t host = index + 2;                      // 10.0.0.1 is the gateway
+        const uint8_t ip[4] = {10, 0, static_cast<uint8_t>(host >> 8), static_cast<uint8_t>(host)};
+        const uint8_t mask[4] = {255, 255, 0, 0};
+        const uint8_t gateway[4] = {10, 0, 0, 1};
+        std::copy(ip, ip + 4, &p[0x03]);
+        std::copy(mask, mask + 4, &p[0x07]);
+        std::copy(gateway, gateway + 4, &p[0x0B]);
+        std::copy(gateway, gateway + 4, &p[0x0F]);     // DNS
+        p[0x13] = 502 >> 8;
+        p[0x14] = 502 & 0xFF;
+        p[0x16] = 0x07;                                 // baud rate index
+        auto module_id = std::format("MB8R{:06}", index);
+        std::copy(module_id.begin(), module_id.end(), &p[0x18]);
+        const uint8_t mac[6] = {0x02, 0x00, 0x02, static_cast<uint8_t>(index >> 16),
+                                static_cast<uint8_t>(index >> 8), static_cast<uint8_t>(index)};
+        std::copy(mac, mac + 6, &p[0x22]);
+        auto name = std::format("DEV{:05}", index);
+        std::copy(name.begin(), name.end(), &p[0x29]);
+        p[0x3A] = 0x03;                                 // Modbus TCP
+        p[0x3F] = 0x01;
+        p[0x74] = 0x06;
+        std::string parameters = "dsp=4196&ipm=0&bd=7";
+        std::copy(parameters.begin(), parameters.end(), &p[0x78]);
+        return p;
+    }
+
+    /// Read captured responses from @p path: the last tab- or
+    /// space-separated field of every line that is not a comment, as 340
+    /// hex digits.  This takes a discovery cache file as well as plain
+    /// hex dumps, one packet per line.
+    bool load_captured(const std::string& path, std::vector<Packet>& packets)
+    {
+        std::ifstream in(path);
+        if (!in) {
+            portable::println(stderr, "Error: cannot open '{}'", path);
+            return false;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream fields(line);
+            std::string hex, field;
+            while (fields >> field) hex = field;
+            if (hex.size() != 2 * waveshare::VIRCOM_PACKET_SIZE) continue;
+
+            Packet p{};
+            bool valid = true;
+            for (size_t i = 0; i < p.size() && valid; ++i) {
+                unsigned byte = 0;
+                auto [ptr, ec] = std::from_chars(hex.data() + 2 * i, hex.data() + 2 * i + 2, byte, 16);
+                valid = ec == std::errc{} && ptr == hex.data() + 2 * i + 2;
+                p[i] = static_cast<uint8_t>(byte);
+            }
+            waveshare::DiscoveredDevice dev;
+            if (valid && waveshare::parse_vircom_response(p.data(), p.size(), dev)) packets.push_back(p);
+        }
+        if (packets.empty()) {
+            portable::println(stderr, "Error: no VirCom responses in '{}'", path);
+            return false;
+        }
+        return true;
+    }
+
+    /// One benchmark: @p run performs @p ops_per_run operations per call.
+    struct Benchmark {
+        std::string name;
+        size_t ops_per_run = 1;
+        std::function<void()> run;
+    };
+
+    /// Measured cost of one operation of a benchmark.
+    struct Result {
+        double ns_per_op = 0;
+        uint64_t ops = 0;           ///< Operations timed in the best repetition
+    };
+
+    /// Time @p bench: repeat it for at least @p min_time, @p repetitions
+    /// times, and keep the fastest repetition, which is the least
+    /// disturbed by the rest of the system.
+    Result measure(const Benchmark& bench, std::chrono::nanoseconds min_time, int repetitions)
+    {
+        bench.run();                                    // warm caches and allocators
+        Result best;
+        for (int r = 0; r < repetitions; ++r) {
+            uint64_t runs = 0;
+            auto start = Clock::now();
+            auto elapsed = Clock::duration::zero();
+            do {
+                bench.run();
+                ++runs;
+                elapsed = Clock::now() - start;
+            } while (elapsed < min_time);
+            auto ops = runs * bench.ops_per_run;
+            double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) /
+                        static_cast<double>(ops);
+            if (r == 0 || ns < best.ns_per_op) best = {ns, ops};
+        }
+        return best;
+    }
+
+    /// "85.2 ns", "12.34 us", "1.50 ms".
+    std::string format_ns(double ns)
+    {
+        if (ns < 1e3) return std::format("{:.1f} ns", ns);
+        if (ns < 1e6) return std::format("{:.2f} us", ns / 1e3);
+        return std::format("{:.2f} ms", ns / 1e6);
+    }
+
+    /// Read a results file written by --output.
+    bool load_results(const std::string& path, std::map<std::string, double>& results)
+    {
+        std::ifstream in(path);
+        if (!in) {
+            portable::println(stderr, "Error: cannot open baseline '{}'", path);
+            return false;
+        }
+        std::string line;
+        if (!std::getline(in, line) || line != RESULTS_HEADER) {
+            portable::println(stderr, "Error: '{}' is not a waveshare-microbench results file", path);
+            return false;
+        }
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            std::string name;
+            double ns = 0;
+            if (std::getline(fields, name, '\t') && fields >> ns) results[name] = ns;
+        }
+        return true;
+    }
+
+    /// All benchmarks, at each of the device list sizes @p sizes.
+    std::vector<Benchmark> make_benchmarks(const std::vector<Packet>& captured, const std::vector<uint32_t>& sizes)
+    {
+        std::vector<Benchmark> benches;
+
+        // Parsing, over a pool larger than the L1 cache as in a scan.
+        auto synthetic = std::make_shared<std::vector<Packet>>();
+        for (uint32_t i = 0; i < 1024; ++i) synthetic->push_back(synthetic_response(i));
+        auto parse_all = [](std::shared_ptr<const std::vector<Packet>> packets) {
+            return [packets] {
+                waveshare::DiscoveredDevice dev;
+                for (const auto& p : *packets) {
+                    waveshare::parse_vircom_response(p.data(), p.size(), dev);
+                    g_sink = g_sink + dev.parameters.size();
+                }
+            };
+        };
+        benches.push_back({"parse/synthetic", synthetic->size(), parse_all(synthetic)});
+        if (!captured.empty()) {
+            auto pool = std::make_shared<const std::vector<Packet>>(captured);
+            benches.push_back({"parse/captured", pool->size(), parse_all(pool)});
+        }
+
+        for (auto size : sizes) {
+            auto devices = std::make_shared<std::vector<waveshare::DiscoveredDevice>>(size);
+            for (uint32_t i = 0; i < size; ++i) {
+                auto p = synthetic_response(i);
+                waveshare::parse_vircom_response(p.data(), p.size(), (*devices)[i]);
+            }
+            const auto& last = devices->back();
+
+            // Every device answers twice (e.g. broadcast and unicast), as
+            // the scan loop sees it: the second round is all duplicates.
+            benches.push_back({std::format("dedup/{}", size), 2 * size_t{size}, [devices] {
+                std::vector<waveshare::DiscoveredDevice> found;
+                for (int round = 0; round < 2; ++round) {
+                    for (const auto& dev : *devices) {
+                        if (!waveshare::is_duplicate_device(found, dev)) found.push_back(dev);
+                    }
+                }
+                g_sink = g_sink + found.size();
+            }});
+
+            // The device found last is the worst case for the linear searches.
+            auto resolve = [devices](std::string mac, std::string name, std::string ip) {
+                return [devices, mac, name, ip] {
+                    std::string error;
+                    g_sink = g_sink + (waveshare::resolve_target_device(*devices, mac, name, ip, error) != nullptr);
+                };
+            };
+            benches.push_back({std::format("resolve-mac/{}", size), 1, resolve(last.mac_address, "", "")});
+            benches.push_back({std::format("resolve-name/{}", size), 1, resolve("", last.device_name, "")});
+            benches.push_back({std::format("resolve-ip/{}", size), 1, resolve("", "", last.ip_address)});
+
+            benches.push_back({std::format("table/{}", size), 1, [devices] {
+                g_sink = g_sink + waveshare::format_device_table(*devices).size();
+            }});
+        }
+        return benches;
+    }
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    std::vector<uint32_t> sizes = {10, 100, 1000, 5000};
+    std::string captured_path, output, baseline, filter, min_time_text;
+    int repetitions = 0;
+    double threshold = 0;
+    bool list = false;
+
+    CLI::App app{"Microbenchmarks of VirCom response parsing and the device table paths"};
+    app.set_help_flag("-h,--help", "Show all available options");
+    app.set_version_flag("-V,--version", PROJECT_VERSION, "Show program version");
+
+    app.add_option("--devices", sizes, "Device list sizes for dedup, resolve and table")
+        ->default_str("10 100 1000 5000")
+        ->check(CLI::Range(1u, 65534u));
+    app.add_option("--captured", captured_path,
+                   "Also parse the responses captured in this file (a discovery cache or one hex packet per line)");
+    app.add_option("--filter", filter, "Run only the benchmarks whose name contains this");
+    app.add_flag("--list", list, "List the benchmarks and exit");
+    app.add_option("-r,--repetitions", repetitions, "Repetitions per benchmark; the fastest counts")
+        ->default_val(5)
+        ->check(CLI::PositiveNumber);
+    app.add_option("--min-time", min_time_text, "Minimum duration of one repetition")
+        ->default_val("50ms");
+    app.add_option("-o,--output", output, "Write the results to this file (- for stdout instead of the table)");
+    app.add_option("--baseline", baseline, "Compare with results written by --output earlier");
+    app.add_option("--threshold", threshold, "Percentage by which a benchmark may be slower than the baseline")
+        ->default_val(10.0)
+        ->check(CLI::NonNegativeNumber);
+
+    try
+    {
+        app.parse(argc, argv);
+    }
+    catch (const CLI::ParseError &e)
+    {
+        return app.exit(e);
+    }
+
+    std::chrono::nanoseconds min_time{};
+    if (!waveshare::parse_duration(min_time_text, min_time)) {
+        portable::println(stderr, "Error: invalid --min-time '{}' (e.g. 1.5s, 20ms or 500us)", min_time_text);
+        return EXIT_FAILURE;
+    }
+    std::vector<Packet> captured;
+    if (!captured_path.empty() && !load_captured(captured_path, captured)) return EXIT_FAILURE;
+    std::map<std::string, double> base;
+    if (!baseline.empty() && !load_results(baseline, base)) return EXIT_FAILURE;
+
+    auto benches = make_benchmarks(captured, sizes);
+    std::erase_if(benches, [&](const Benchmark& b) { return b.name.find(filter) == std::string::npos; });
+    if (list) {
+        for (const auto& b : benches) portable::println("{}", b.name);
+        return EXIT_SUCCESS;
+    }
+
+    bool table = output != "-";
+    if (table) {
+        portable::println("{:<20}  {:>12}  {:>12}  {:>10}", "Benchmark", "Per op", "Ops", "vs base");
+        portable::println("{:-<20}  {:->12}  {:->12}  {:->10}", "", "", "", "");
+    }
+    std::string results = std::format("{}\n", RESULTS_HEADER);
+    int regressions = 0;
+    for (const auto& bench : benches) {
+        auto result = measure(bench, min_time, repetitions);
+        results += std::format("{}\t{:.3f}\t{}\n", bench.name, result.ns_per_op, result.ops);
+
+        std::string versus, verdict;
+        if (auto it = base.find(bench.name); it != base.end() && it->second > 0) {
+            double change = (result.ns_per_op / it->second - 1.0) * 100.0;
+            versus = std::format("{:+.1f} %", change);
+            if (change > threshold) {
+                verdict = "  REGRESSION";
+                ++regressions;
+            } else if (change < -threshold) {
+                verdict = "  faster";
+            }
+        } else if (!base.empty()) {
+            versus = "new";
+        }
+        if (table) {
+            portable::println("{:<20}  {:>12}  {:>12}  {:>10}{}", bench.name, format_ns(result.ns_per_op),
+                              result.ops, versus, verdict);
+            std::fflush(stdout);
+        }
+    }
+
+    if (output == "-") {
+        std::fputs(results.c_str(), stdout);
+    } else if (!output.empty()) {
+        std::ofstream out(output, std::ios::trunc);
+        if (!(out << results)) {
+            portable::println(stderr, "Error: cannot write '{}'", output);
+            return EXIT_FAILURE;
+        }
+    }
+    if (regressions > 0) {
+        portable::println(stderr, "{} benchmark(s) more than {:.0f} % slower than {}", regressions, threshold, baseline);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+// Loopback stand-in for a Waveshare Modbus POE ETH relay board, or for a
+// fleet of VirCom devices, so the commander can be exercised and
+// benchmarked without hardware.
+
+#include "waveshare_modbus_commander/latency_histogram.hpp"
+#include "waveshare_modbus_commander/portable_print.hpp"
+#include "waveshare_modbus_commander/relay_simulator.hpp"
+#include "waveshare_modbus_commander/relay_state.hpp"
+#include "CLI/CLI.hpp"
+
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <exception>
+#include <string>
+
+namespace
+{
+    std::atomic<bool> g_interrupted{false};
+
+    void sigint_handler(int /*signum*/)
+    {
+        g_interrupted.store(true, std::memory_order_relaxed);
+    }
+
+    /// Parse the duration option @p text of @p name into @p out.
+    template <typename Duration>
+    bool parse_duration_option(const std::string& name, const std::string& text, Duration& out)
+    {
+        std::chrono::nanoseconds d{};
+        if (!waveshare::parse_duration(text, d)) {
+            portable::println(stderr, "Error: invalid {} '{}' (e.g. 1.5s, 20ms or 500us)", name, text);
+            return false;
+        }
+        out = std::chrono::duration_cast<Duration>(d);
+        return true;
+    }
+
+    /// Serve @p options until interrupted.
+    int serve_fleet(const waveshare::FleetOptions& options)
+    {
+        try {
+            waveshare::VirComFleet fleet(options);
+            std::string error;
+            if (!fleet.start(error)) {
+                portable::println(stderr, "Error: {}", error);
+                return EXIT_FAILURE;
+            }
+            std::signal(SIGINT, sigint_handler);
+            std::signal(SIGTERM, sigint_handler);
+
+            portable::println("Simulating {} VirCom device(s) {} to {} on UDP 1092 (sweep {}). Ctrl-C to stop.",
+                              fleet.size(), fleet.ip_address(0), fleet.ip_address(fleet.size() - 1),
+                              fleet.subnet());
+            fleet.run(g_interrupted);
+
+            auto c = fleet.counters();
+            portable::println("\nAnswered {} of {} search(es) ({} dropped, {} send error(s)).",
+                              c.replies, c.searches, c.dropped, c.send_errors);
+        } catch (const std::exception& e) {
+            portable::println(stderr, "Error: {}", e.what());
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    waveshare::SimulatorOptions options;
+    waveshare::FleetOptions fleet;
+    std::string latency, jitter, reboot_time, inputs, input_period, delay_spread;
+    int port = 0;
+    bool no_vircom = false;
+
+    CLI::App app{"Waveshare relay board simulator - serves Modbus TCP and VirCom on loopback"};
+    app.set_help_flag("-h,--help", "Show all available options");
+    app.set_version_flag("-V,--version", PROJECT_VERSION, "Show program version");
+
+    app.add_option("--ip", options.ip_address, "Address of the simulated board")
+        ->default_val("127.0.0.1");
+    app.add_option("-p,--port", port, "Modbus TCP port")
+        ->default_val(5020)
+        ->check(CLI::Range(1, 65535));
+    app.add_option("--mac", options.mac_address, "MAC address reported over VirCom")
+        ->default_val("02:00:00:00:00:01");
+    app.add_option("--name", options.device_name, "Device name reported over VirCom (max 9 characters)")
+        ->default_val("SIM01");
+    app.add_option("--latency", latency, "Delay of every reply (e.g. 2ms)")
+        ->default_val("0");
+    app.add_option("--jitter", jitter, "Random extra delay of up to this much per reply")
+        ->default_val("0");
+    app.add_option("--loss", options.loss, "Probability that a request goes unanswered (0-1)")
+        ->default_val(0.0)
+        ->check(CLI::Range(0.0, 1.0));
+    app.add_option("--reboot-time", reboot_time, "Silence after a SET_CONFIG")
+        ->default_val("3s");
+    app.add_option("--inputs", inputs, "Digital inputs in the --set-relays syntax (e.g. 0b00000101)")
+        ->default_val("none");
+    app.add_option("--input-period", input_period, "Count the inputs up in binary at this period (0 = fixed)")
+        ->default_val("0");
+    app.add_option("--seed", options.seed, "Seed for jitter and loss (0 = random)")
+        ->default_val(0);
+    app.add_flag("--no-vircom", no_vircom, "Do not answer VirCom on UDP port 1092");
+    app.add_option("--fleet", fleet.count,
+                   "Instead of one board, serve this many VirCom-only devices from consecutive addresses")
+        ->default_val(0)
+        ->check(CLI::Range(0u, waveshare::VirComFleet::MAX_DEVICES));
+    app.add_option("--fleet-ip", fleet.first_ip, "Address of the first --fleet device")
+        ->default_val("127.1.0.1");
+    app.add_option("--delay-spread", delay_spread, "With --fleet: each device adds its own fixed delay of up to this much")
+        ->default_val("0");
+    app.add_flag("-d,--debug", options.debug, "Log every request");
+
+    try
+    {
+        app.parse(argc, argv);
+    }
+    catch (const CLI::ParseError &e)
+    {
+        return app.exit(e);
+    }
+
+    if (fleet.count > 0) {
+        fleet.loss = options.loss;
+        fleet.seed = options.seed;
+        fleet.debug = options.debug;
+        if (!parse_duration_option("--latency", latency, fleet.latency) ||
+            !parse_duration_option("--delay-spread", delay_spread, fleet.delay_spread))
+            return EXIT_FAILURE;
+        return serve_fleet(fleet);
+    }
+
+    options.modbus_port = static_cast<uint16_t>(port);
+    options.vircom = !no_vircom;
+    std::string error;
+    if (!parse_duration_option("--latency", latency, options.latency) ||
+        !parse_duration_option("--jitter", jitter, options.jitter) ||
+        !parse_duration_option("--reboot-time", reboot_time, options.reboot_time) ||
+        !parse_duration_option("--input-period", input_period, options.input_period))
+        return EXIT_FAILURE;
+    if (!waveshare::parse_relay_mask(inputs, options.inputs, error)) {
+        portable::println(stderr, "Error: --inputs: {}", error);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        waveshare::RelaySimulator simulator(options);
+        if (!simulator.start(error)) {
+            portable::println(stderr, "Error: {}", error);
+            return EXIT_FAILURE;
+        }
+        std::signal(SIGINT, sigint_handler);
+        std::signal(SIGTERM, sigint_handler);
+
+        portable::println("Simulating {} ({}): Modbus TCP on {}:{}{}. Ctrl-C to stop.",
+                          options.device_name, options.mac_address, options.ip_address, options.modbus_port,
+                          options.vircom ? ", VirCom on UDP 1092" : "");
+        simulator.run(g_interrupted);
+
+        auto c = simulator.counters();
+        portable::println("\nServed {} Modbus request(s) ({} dropped) on {} connection(s), "
+                          "{} VirCom request(s) ({} dropped), {} reboot(s).",
+                          c.modbus_requests, c.modbus_dropped, c.connections,
+                          c.vircom_requests, c.vircom_dropped, c.reboots);
+    } catch (const std::exception& e) {
+        portable::println(stderr, "Error: {}", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}